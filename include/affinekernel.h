@@ -0,0 +1,34 @@
+#ifndef AFFINEKERNEL_H
+#define AFFINEKERNEL_H
+
+#include <QPointF>
+#include <QTransform>
+#include <cstddef>
+
+// Affine maps over contiguous point arrays, for transforming whole
+// selections at once. QPointF is a pair of doubles, so an array of them
+// is walked two lanes at a time with SSE2 where the target has it, and
+// with plain scalar code elsewhere.
+class AffineKernel
+{
+public:
+    // points[i] = transform.map(points[i]); the transform must be affine
+    static void map(const QTransform &transform, QPointF *points, std::size_t count);
+
+    // Component-wise extremes of count > 0 points
+    static void bounds(const QPointF *points, std::size_t count, QPointF &min, QPointF &max);
+
+    // What the transform does to a shape placed by a box and a rotation:
+    // axis scale factors and rotation (degrees). Exact for translations,
+    // rotations and uniform scales.
+    struct Parts {
+        double scaleX;
+        double scaleY;
+        double angle;
+    };
+    static Parts decompose(const QTransform &transform);
+
+    static bool isVectorised();
+};
+
+#endif // AFFINEKERNEL_H
@@ -0,0 +1,72 @@
+#ifndef BATCHRENDERER_H
+#define BATCHRENDERER_H
+
+#include <QColor>
+#include <QRectF>
+#include <vector>
+
+#ifdef ENABLE_CAIRO
+#include <cairo.h>
+
+class Shape;
+
+// Draws shapes on a Cairo context in the order given, merging runs of
+// consecutive shapes with the same style (StyleTable index) into one path
+// that is filled and stroked once. Draw order stays exact: a shape that
+// overlaps an earlier member of a filled or translucent run starts a new
+// run, since merging would put the first outline above the second fill
+// or blend the overlap once instead of twice. Rotated shapes, and shapes
+// that cannot describe themselves with Shape::buildPath(), are drawn on
+// their own, between runs.
+class BatchRenderer
+{
+public:
+    struct Stats {
+        int shapes = 0;         // Visible shapes handed to draw()
+        int batches = 0;        // Merged paths submitted
+        int single = 0;         // Shapes drawn on their own
+        int stateChanges = 0;   // Source colour and line width settings
+    };
+
+    explicit BatchRenderer(cairo_t *cr, bool batching = true);
+    ~BatchRenderer();           // Flushes
+
+    cairo_t* context() const { return m_cr; }
+
+    void draw(Shape *shape);
+    // Solid rectangle in world coordinates, merged with neighbouring
+    // rectangles of the same colour (the LOD stand-ins for tiny shapes)
+    void fillRect(const QRectF &rect, const QColor &color);
+    // Submits the pending run; needed before drawing on the context directly
+    void flush();
+
+    const Stats& stats() const { return m_stats; }
+
+private:
+    enum RunKind {
+        NoRun,
+        ShapeRun,
+        RectRun
+    };
+
+    void drawSingle(Shape *shape);
+    bool overlapsRun(const QRectF &bounds) const;
+
+    cairo_t *m_cr;
+    bool m_batching;
+
+    RunKind m_run = NoRun;
+    int m_count = 0;
+    quint32 m_style = 0;            // ShapeRun
+    QRgb m_color = 0;               // RectRun
+    bool m_fill = false;
+    bool m_stroke = false;
+    bool m_checkOverlap = false;
+    QRectF m_runBounds;             // Union of m_bounds
+    std::vector<QRectF> m_bounds;   // Members, when m_checkOverlap
+
+    Stats m_stats;
+};
+#endif
+
+#endif // BATCHRENDERER_H
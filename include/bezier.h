@@ -4,6 +4,10 @@
 #include "shape.h"
 #include <QVector>
 #include <QPointF>
+#include <QPainterPath>
+#include <QPolygonF>
+#include <atomic>
+#include <mutex>
 
 #ifdef ENABLE_CAIRO
 #include <cairo.h>
@@ -14,21 +18,29 @@ class Bezier : public Shape
 {
 public:
     Bezier();
-    ~Bezier() override = default;
+    ~Bezier() override;
 
     // Hybrid draw methods
     void draw(QPainter &painter) override;
 	#ifdef ENABLE_CAIRO
     void draw(cairo_t *cr) override;
+    bool buildPath(cairo_t *cr) const override;
 	#endif
 
     bool contains(const QPointF &point) const override;
+    QPolygonF getOutline() const override;      // flattened(), as drawn
+    void getSnapPoints(std::vector<SnapPoint> &points) const override;  // Anchors and box
     Type getType() const override { return Shape::Bezier; }
     Bezier* clone() const override;
 
+    // Transformations act on the control points, which are what gets drawn
+    void move(const QPointF &offset) override;
+    void scale(double factor) override;
+
     // Bezier-specific methods
     void addPoint(const QPointF &point);
     void setPoint(int index, const QPointF &point);
+    void setPoints(const QVector<QPointF> &points);     // Replace all, one rescan
     QPointF getPoint(int index) const;
     QList<QPointF> getPoints() const;
     int getPointCount() const;
@@ -37,9 +49,46 @@ public:
     void setClosed(bool closed);
     bool isClosed() const;
 
+    // Geometry derived from the control points, built on first use and
+    // kept until the points or closure change. Safe to call from several
+    // render threads at once; the shape itself must not change meanwhile.
+    const QPainterPath& path() const;
+    const QPolygonF& flattened() const;         // Polyline of path()
+#ifdef ENABLE_CAIRO
+    const cairo_path_t* cairoPath() const;      // World coordinates
+#endif
+
+protected:
+    void gatherPoints(std::vector<QPointF> &points) const override;
+    void scatterPoints(const QPointF *points, const AffineKernel::Parts &parts) override;
+
 private:
+    enum CacheBits : quint8 {
+        PathCached = 0x01,
+        PolygonCached = 0x02,
+        CairoCached = 0x04
+    };
+
+    void updateBounds();            // Full rescan of m_points
+    void extendBounds(const QPointF &point);
+    void storeBounds();             // m_minPoint/m_maxPoint -> position, size
+    void invalidateGeometry();
+
     QVector<QPointF> m_points;
     bool m_closed;
+
+    // Exact extremes of m_points, kept incrementally so appending a point
+    // is O(1); position and size are derived from them
+    QPointF m_minPoint;
+    QPointF m_maxPoint;
+
+    mutable std::mutex m_cacheMutex;
+    mutable std::atomic<quint8> m_cached{0};
+    mutable QPainterPath m_path;
+    mutable QPolygonF m_flattened;
+#ifdef ENABLE_CAIRO
+    mutable cairo_path_t *m_cairoPath = nullptr;
+#endif
 };
 
 #endif // BEZIER_H
@@ -8,9 +8,18 @@
 #include <QColor>
 #include <QString>
 #include <QList>
+#include <QRectF>
+#include <QRegion>
+#include <QPolygonF>
+#include <QTransform>
+#include "strokefitter.h"
+#include "snapindex.h"
 
 #ifdef ENABLE_CAIRO
 #include <cairo.h>
+#include "tilecache.h"
+#include "lodpolicy.h"
+#include "batchrenderer.h"
 #endif
 
 
@@ -20,6 +29,7 @@ class Line;
 class Rectangle;
 class Ellipse;
 class Bezier;
+class Layer;
 
 class Canvas : public QWidget
 {
@@ -36,6 +46,18 @@ public:
         Tool_Text
     };
 
+    // Shapes handed to draw() vs. skipped by viewport culling in the last
+    // paint; the tile counters are only used by the Cairo backend.
+    struct RenderStats {
+        int drawn = 0;
+        int culled = 0;
+        int tilesRendered = 0;
+        int tilesReused = 0;
+        int simplified = 0;     // Drawn as a point or box, or skipped, by the LOD policy
+        int batches = 0;        // Merged same-style paths submitted to Cairo
+        int stateChanges = 0;   // Cairo source colour / line width settings
+    };
+
     explicit Canvas(QWidget *parent = nullptr);
     ~Canvas();
 
@@ -54,16 +76,43 @@ public:
     void zoomIn();
     void zoomOut();
 
-    // Cairo surface
+    // Cairo tile cache budget (bytes) and multi-threaded tile rasterisation
 	#ifdef ENABLE_CAIRO
-    cairo_surface_t* createCairoSurface();
+    void setTileCacheLimit(qint64 bytes);
+    qint64 getTileCacheLimit() const;
+    void setParallelRendering(bool enabled);
+    bool isParallelRendering() const;
+    // Level-of-detail thresholds of the Cairo renderer
+    void setLodPolicy(const LodPolicy &policy);
+    const LodPolicy& getLodPolicy() const;
+    // Merging runs of same-styled shapes into one fill and stroke
+    void setBatchedRendering(bool enabled);
+    bool isBatchedRendering() const;
 	#endif
 
+    // Native documents (.vgd)
+    bool loadDocument(const QString &filename);
+    bool saveDocument(const QString &filename);
+
     // SVG and editing operations
     void loadSVG(const QString &filename);
     void saveSVG(const QString &filename);
     void importSVG(const QString &filename);
 
+    // Multi-selection. The last shape selected is the primary one, which
+    // the style setters act on; transforms apply to the whole set.
+    void selectShapes(const QList<Shape*> &shapes);
+    void selectAll();                 // Every shape of the active layer
+    const QList<Shape*>& getSelection() const { return m_selection; }
+    // Applies transform to every selected shape in one bulk pass
+    // (Layer::transformShapes) and repaints once
+    void transformSelection(const QTransform &transform);
+    // Z-order of the selection within its layer
+    void bringToFront();
+    void bringForward();
+    void sendBackward();
+    void sendToBack();
+
     // Clipboard operations
     void cutSelection();
     void copySelection();
@@ -72,6 +121,11 @@ public:
     // View options
     void toggleGrid();
     void toggleSnapToGrid();
+    // Object snapping to endpoints, midpoints, centres, Bezier anchors and
+    // box corners/edges of the active layer's shapes (takes precedence
+    // over the grid when a candidate is in reach)
+    void setSnapToObjects(bool enabled);
+    bool isSnapToObjects() const { return m_snapToObjects; }
 
     // Shape styling
     void setFillColor(const QColor &color);
@@ -81,6 +135,9 @@ public:
     void setStrokePen(const QPen &pen) { m_strokePen = pen; }
     void setFillBrush(const QBrush &brush) { m_fillBrush = brush; }
 
+    // Profiling
+    RenderStats getRenderStats() const { return m_renderStats; }
+
 protected:
     // Event handlers
     void paintEvent(QPaintEvent *event) override;
@@ -94,13 +151,41 @@ protected:
 private:
     // Drawing helpers
     void drawBackground(QPainter &painter);
-    void drawWithCairo(QPainter &painter);     // Cairo backend
+    void drawWithCairo(QPainter &painter, const QRegion &dirty);  // Cairo backend
     void drawSelectionHandles(QPainter &painter);
+    void drawSelectionBand(QPainter &painter);  // Rubber band or lasso being dragged
     void drawGrid(QPainter &painter);
 
     // Coordinate helpers
     QPointF screenToWorld(const QPoint &screenPos) const;
     QPointF worldToScreen(const QPointF &worldPos) const;
+    QRect worldToScreenRect(const QRectF &worldRect) const;
+    QRectF screenToWorldRect(const QRect &screenRect) const;
+
+    // Dirty-rect repaint: schedule only the screen area a shape covered
+    // before a change (oldBounds, from getIndexBounds) and covers now.
+    void updateWorldRect(const QRectF &worldRect);
+    void updateShape(const QRectF &oldBounds, const Shape *shape);
+    void updateAll();                 // Drops cached tiles as well
+    // Repaint only, for what is drawn over the tiles (the shape being
+    // drawn); the cached tiles underneath stay valid
+    void updateOverlay(const QRectF &worldRect);
+
+    // Viewport culling: shapes of the active layer that can touch worldRect,
+    // bottom-to-top. Updates m_renderStats.
+    QList<Shape*> collectVisibleShapes(const QRectF &worldRect);
+
+	#ifdef ENABLE_CAIRO
+    struct TileJob {
+        int tx;
+        int ty;
+        QList<Shape*> shapes;
+        QImage image;
+        LodPolicy::Counts lod;
+        BatchRenderer::Stats batch;
+    };
+    static void renderTile(TileJob &job, const LodPolicy &lod, bool batching, double zoom);
+	#endif
 
     // Tool handling
     void handleSelectTool(QMouseEvent *event);
@@ -115,9 +200,34 @@ private:
     // Shape selection
     void selectShapeAt(const QPointF &point);
     void clearSelection();
+    void setSelection(const QList<Shape*> &shapes);
+    void removeSelection();           // Deletes every selected shape
+    // Gestures: a single shape goes through its own move/scale/rotate,
+    // several through transformSelection about the selection centre
+    void moveSelection(const QPointF &offset);
+    void scaleSelection(double factor);
+    void rotateSelection(double degrees);
+    QPointF selectionCenter() const;
+    // Undo: edits of shapes already in the document run inside a
+    // transaction that snapshots them first (Document::aboutToModify).
+    // A drag or rotate gesture keeps one open from press to release, so
+    // all of it becomes a single history entry.
+    void beginEdit(const QList<Shape*> &shapes);
+    void endEdit();
+    void beginGesture();
+    void endGesture();
+    void restackSelection(void (Layer::*restack)(const QList<Shape*> &));
+    // Region selection (drag from empty canvas with Tool_Select): the live
+    // band only repaints itself; the layer is queried on release
+    QRectF selectionBand() const;     // World bounds of the band or lasso
+    void finishRegionSelection();
 
     // Grid snapping
     QPointF snapToGrid(const QPointF &point) const;
+    // Object snapping, then grid snapping, as enabled; moves the marker
+    QPointF snap(const QPointF &point);
+    void setSnapTarget(bool found, const SnapPoint &target);
+    QRect snapMarkerRect() const;
 
 private:
     Document *m_document;             // Current document
@@ -125,25 +235,38 @@ private:
     double m_zoom;                    // Zoom factor
     QPointF m_panOffset;              // Canvas pan offset
 
-    Shape *m_selectedShape;           // Currently selected shape
+    Shape *m_selectedShape;           // Primary selected shape
+    QList<Shape*> m_selection;        // All selected shapes, m_selectedShape last
+    QRectF m_selectionBounds;         // Union of their index bounds
     bool m_isSelecting;               // Selection state
     bool m_isDrawing;                 // Drawing state
 
     QPointF m_selectionStart;         // Selection start point
+    QPointF m_selectionCurrent;       // Rubber band corner under the pointer
+    QPolygonF m_lasso;                // Lasso path, world coordinates
+    bool m_lassoSelect = false;       // Ctrl-drag: lasso instead of rubber band
+    bool m_addToSelection = false;    // Shift-drag: extend the selection
     QPointF m_drawStart;              // Drawing start point
     QPointF m_drawCurrent;            // Drawing current point
 
     Shape *m_currentShape;            // Shape being drawn
     QList<QPointF> m_bezierPoints;    // Points for Bezier curves
+    StrokeFitter m_strokeFitter;      // Pen tool samples -> cubic segments
 
 	#ifdef ENABLE_CAIRO
-    cairo_surface_t *m_cairoSurface;  // Cairo surface
-    cairo_t *m_cairoContext;          // Cairo context
+    TileCache m_tileCache;            // Rasterised tiles of m_tileLayer
+    Layer *m_tileLayer = nullptr;     // Layer the cached tiles show
+    bool m_parallelRendering = true;  // Rasterise missing tiles on the thread pool
+    LodPolicy m_lodPolicy;            // Simplification of tiny shapes when zoomed out
+    bool m_batchedRendering = true;   // Submit same-styled runs as one path
 	#endif
 
     bool m_showGrid;                  // Grid visibility
     int m_gridSize;                   // Grid size
     bool m_snapToGrid;                // Snap-to-grid state
+    bool m_snapToObjects = false;     // Snap to other shapes' points
+    bool m_hasSnapTarget = false;     // m_snapTarget is shown
+    SnapPoint m_snapTarget;           // Point the pointer last snapped to
 
     QPen m_strokePen { Qt::black, 2 };     // Default black pen, width 2
     QBrush m_fillBrush { Qt::NoBrush };    // Default no fill
@@ -154,6 +277,9 @@ private:
 	bool m_isRotating = false;
 	QPointF m_rotationStart;
 	double m_lastRotationAngle = 0.0;
+    bool m_inGesture = false;         // Holds a document transaction open
+
+    RenderStats m_renderStats;        // Culling counters of the last paint
 
 
 
@@ -6,7 +6,16 @@
 #include <QString>
 #include <QSizeF>
 #include <QColor>
+#include <QMetaType>
+#include <QPolygonF>
+#include <QSet>
+#include <QElapsedTimer>
+#include <functional>
+#include <memory>
 #include "shape.h"
+#include "spatialindex.h"
+#include "shapecolumns.h"
+#include "snapindex.h"
 
 // === LAYER CLASS ===
 class Layer : public QObject
@@ -17,9 +26,54 @@ public:
     ~Layer();
 
     void addShape(Shape *shape);
+    void addShapes(const QList<Shape*> &shapes);    // In order, on top; bulk-indexed
+    // Removal leaves a tombstone in the shape's row, so it costs the same
+    // however large the layer is. Rows are compacted in one pass the next
+    // time getShapes() or getColumns() is called.
     void removeShape(Shape *shape);
+    void removeShapes(const QList<Shape*> &shapes);
     void clear();
-    QList<Shape*> getShapes() const;
+    const QList<Shape*>& getShapes() const;         // Draw order, no copy
+    int shapeCount() const { return m_shapes.size() - m_tombstones; }
+
+    // Spatial queries (served by the layer's R-tree)
+    Shape* getShapeAt(const QPointF &point) const;   // Topmost visible hit
+    QList<Shape*> getShapesIn(const QRectF &rect) const; // Bottom-to-top order
+    // Region selection: visible shapes whose outline lies entirely inside
+    // rect, or inside lasso (odd-even rule), bottom-to-top. Candidates come
+    // from getShapesIn() by bounds; the outline test runs on the thread pool.
+    QList<Shape*> getShapesEnclosedBy(const QRectF &rect) const;
+    QList<Shape*> getShapesEnclosedBy(const QPolygonF &lasso) const;
+    const SpatialIndex& getSpatialIndex() const { return m_index; }
+
+    // Culling columns (bounds, style, flags) of the shapes, in draw order
+    const ShapeColumns& getColumns() const;
+
+    // Object snapping candidates of the shapes. Built on first use and
+    // kept in step with every change after that, until released.
+    const SnapIndex& getSnapIndex();
+    void releaseSnapIndex();
+
+    // Applies transform to every one of shapes that belongs to this layer:
+    // their points go through AffineKernel as one array, and the index and
+    // columns are brought up to date once at the end. The out parameters
+    // receive the union of the shapes' index bounds before and after.
+    void transformShapes(const QList<Shape*> &shapes, const QTransform &transform,
+                         QRectF *oldBounds = nullptr, QRectF *newBounds = nullptr);
+
+    // Z-order. Shapes carry spaced-out order labels, so restacking k of
+    // them relabels just those k and moves their rows to the end; the rows
+    // are put back in draw order by the same lazy pass as removals.
+    void bringToFront(const QList<Shape*> &shapes);
+    void sendToBack(const QList<Shape*> &shapes);
+    // One step: each shape goes just above (below) the nearest shape
+    // above (below) it that it overlaps; shapes with nothing there stay
+    void bringForward(const QList<Shape*> &shapes);
+    void sendBackward(const QList<Shape*> &shapes);
+
+    // Called by Shape whenever its index bounds may have changed
+    void shapeGeometryChanged(Shape *shape);
+    void shapeStateChanged(Shape *shape);
 
     QString getName() const;
     void setName(const QString &name);
@@ -29,11 +83,60 @@ public:
     void setLocked(bool locked);
 
 private:
+    // Fraction of the layer's extent a query rect must cover before
+    // getShapesIn() scans the columns instead of the R-tree
+    static constexpr double ScanCoverage = 0.25;
+    // Fraction of the layer a bulk transform or removal must touch before
+    // the R-tree is repacked from scratch instead of updated entry by entry
+    static constexpr double RepackShare = 0.25;
+
+    // Order labels start mid-range so the layer can grow both ways, and
+    // are ZGap apart, which leaves room to slot restacked shapes in between
+    static constexpr quint64 ZBase = quint64(1) << 62;
+    static constexpr quint64 ZGap = quint64(1) << 20;
+
+    // Shapes per thread pool task in the region selection's outline test
+    static constexpr int EnclosedChunk = 2048;
+
+    QRectF rowBounds(int row) const;
+    void compact() const;
+    QList<Shape*> ownedByZOrder(const QList<Shape*> &shapes) const;
+    void moveRowToEnd(Shape *shape, quint64 zOrder);
+    void restackStep(const QList<Shape*> &shapes, bool up);
+    void relabel(quint64 gap);
+    void repackIndex();
+    QList<Shape*> filterEnclosed(const QRectF &bounds,
+                                 const std::function<bool(const QPolygonF&)> &encloses) const;
+
+    void sortByZOrder(QList<Shape*> &shapes) const;
+
     QString m_name;
-    QList<Shape*> m_shapes;
+    mutable QList<Shape*> m_shapes;     // nullptr marks a removed shape's row
+    mutable int m_tombstones = 0;
+    mutable int m_sortedRows = 0;       // Rows before this one are in draw order
     bool m_visible;
     bool m_locked;
+
+    SpatialIndex m_index;
+    mutable ShapeColumns m_columns;     // Row i mirrors m_shapes[i]
+    SnapIndex m_snap;
+    bool m_snapBuilt = false;   // m_snap is live
+    quint64 m_nextZOrder;       // Highest order label handed out
+    quint64 m_bottomZOrder;     // Lowest
+};
+
+// === CHANGE SET ===
+// What one edit, or one transaction of edits, did to a document's shapes.
+// Reported through Document::changed().
+struct ChangeSet {
+    QList<quint64> added;       // Shape ids (Shape::getId)
+    QList<quint64> removed;
+    QList<quint64> modified;
+    QRectF bounds;              // Union of the affected shapes' index bounds
+
+    bool isEmpty() const { return added.isEmpty() && removed.isEmpty() && modified.isEmpty(); }
 };
+Q_DECLARE_METATYPE(ChangeSet)
 
 // === DOCUMENT CLASS ===
 class Document : public QObject
@@ -61,7 +164,15 @@ public:
 
     // Shape management
     void addShape(Shape *shape);
+    void addShapes(const QList<Shape*> &shapes);     // Active layer, bulk-indexed, one undo step
     void removeShape(Shape *shape);
+    void removeShapes(const QList<Shape*> &shapes);  // One undo step
+    // In-place edits (move, scale, rotate, style) are made undoable by
+    // calling this with the shapes just before changing them, inside a
+    // transaction so that changed() is sent on commit, after the edit.
+    // Only a shape's first call counts, and on commit the fields the edit
+    // left alone are dropped; a drag is a single compact entry.
+    void aboutToModify(const QList<Shape*> &shapes);
     Shape* getShapeAt(const QPointF &point) const;
     QList<Shape*> getShapes() const;
     QList<Shape*> getAllShapes() const;
@@ -76,8 +187,25 @@ public:
     bool save(const QString &filename);
     bool load(const QString &filename);
 
-    // Undo/Redo
+    // Transactions: edits between beginTransaction() and the matching
+    // commitTransaction() become one undo step, and their notifications are
+    // held back and sent once on commit as a single changed() plus
+    // documentChanged(). Transactions nest; only the outermost commits.
+    // Outside a transaction, bulk edits report the same way, while single
+    // addShape()/removeShape() calls also emit shapeAdded/shapeRemoved.
+    void beginTransaction();
+    void commitTransaction();
+    bool inTransaction() const { return m_transactionDepth > 0; }
+
+    // Undo/Redo. Consecutive modification steps on the same shapes within
+    // CoalesceMs of each other merge into one (wheel and key repeats).
+    // Steps are costed in bytes, including the removed shapes only the
+    // history still holds; past the budget the oldest steps are dropped
+    // and those shapes freed. The newest step is always kept.
     void clearHistory();
+    void setHistoryBudget(size_t bytes);
+    size_t getHistoryBudget() const { return m_historyBudget; }
+    size_t getHistoryBytes() const { return m_historyBytes; }
     bool canUndo() const;
     bool canRedo() const;
     void undo();
@@ -91,6 +219,8 @@ signals:
     void layerRemoved(Layer *layer);
     void shapeAdded(Shape *shape);
     void shapeRemoved(Shape *shape);
+    void changed(const ChangeSet &changes);
+    void documentReset();               // clear() deleted every layer and shape
 
 private:
     QList<Layer*> m_layers;
@@ -99,15 +229,49 @@ private:
     QSizeF m_size;
     QColor m_backgroundColor;
 
+    static constexpr qint64 CoalesceMs = 500;
+    static constexpr size_t DefaultHistoryBudget = size_t(64) * 1024 * 1024;
+
     struct Command {
         enum Type { AddShape, RemoveShape, ModifyShape };
         Type type;
         Shape *shape;
         Layer *layer;
+        // ModifyShape: the values on the other side of the edit, exchanged
+        // with the shape's on every undo and redo
+        std::shared_ptr<Shape::State> delta;
+    };
+
+    struct UndoStep {                   // Undone and redone as a whole
+        QList<Command> commands;
+        qint64 time = 0;                // Recorded (m_clock ms)
+        size_t bytes = 0;               // stepBytes() on the stack it is on
     };
 
-    QList<Command> m_undoStack;
-    QList<Command> m_redoStack;
+    void record(UndoStep step, const ChangeSet &changes);
+    void push(UndoStep step);
+    bool coalesce(const UndoStep &step);
+    void replay(const UndoStep &step, bool backwards, ChangeSet &changes);
+    static void compactDeltas(UndoStep &step);
+    // Removed shapes belong to the undo stack's RemoveShape commands, and
+    // to the redo stack's AddShape commands
+    static size_t stepBytes(const UndoStep &step, bool redo);
+    static void discard(const UndoStep &step, bool redo);
+    // Drops the commands on a layer about to be deleted, freeing the
+    // shapes only they held
+    void forgetLayer(Layer *layer);
+    void trimHistory();
+
+    QList<UndoStep> m_undoStack;
+    QList<UndoStep> m_redoStack;
+    size_t m_historyBudget = DefaultHistoryBudget;
+    size_t m_historyBytes = 0;
+    QElapsedTimer m_clock;
+
+    int m_transactionDepth = 0;
+    UndoStep m_pendingStep;             // Recorded by the open transaction
+    ChangeSet m_pendingChanges;
+    QSet<const Shape*> m_pendingModified;   // Shapes with a ModifyShape in it
 };
 
 #endif // DOCUMENT_H
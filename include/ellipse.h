@@ -20,10 +20,12 @@ public:
     void draw(QPainter &painter) override;   // Qt drawing
 	#ifdef ENABLE_CAIRO
     void draw(cairo_t *cr) override;        // Cairo drawing
+    bool buildPath(cairo_t *cr) const override;
 	#endif
 
     // Logic
     bool contains(const QPointF &point) const override;
+    QPolygonF getOutline() const override;
     Type getType() const override { return Shape::Ellipse; }
     Ellipse* clone() const override;
 
@@ -34,6 +36,10 @@ public:
     double getEndAngle() const;
 
 private:
+	#ifdef ENABLE_CAIRO
+    void addOutline(cairo_t *cr, bool pie) const;
+	#endif
+
     double m_startAngle;  // Degrees
     double m_endAngle;    // Degrees
 };
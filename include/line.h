@@ -20,13 +20,20 @@ public:
 
 #ifdef ENABLE_CAIRO
     void draw(cairo_t *cr) override;
+    bool buildPath(cairo_t *cr) const override;
 #endif
 
     // Shape logic
     bool contains(const QPointF &point) const override;
+    QPolygonF getOutline() const override;
+    void getSnapPoints(std::vector<SnapPoint> &points) const override;
     Type getType() const override { return Shape::Line; }
     Line* clone() const override;
 
+    // Transformations act on the endpoints, which are what gets drawn
+    void move(const QPointF &offset) override;
+    void scale(double factor) override;
+
     // Line-specific methods
     void setStartPoint(const QPointF &point);
     void setEndPoint(const QPointF &point);
@@ -36,7 +43,14 @@ public:
     void setLineWidth(double width);
     double getLineWidth() const;
 
+protected:
+    void gatherPoints(std::vector<QPointF> &points) const override;
+    void scatterPoints(const QPointF *points, const AffineKernel::Parts &parts) override;
+
 private:
+    void updateBounds();
+    void storeBounds();             // Endpoints -> position, size
+
     QPointF m_startPoint;
     QPointF m_endPoint;
     double m_lineWidth;
@@ -0,0 +1,57 @@
+#ifndef LODPOLICY_H
+#define LODPOLICY_H
+
+#include <QList>
+#include <QRectF>
+
+class Shape;
+class BatchRenderer;
+
+// Level-of-detail rules for the Cairo renderer.
+// Zoomed out, most shapes of a dense drawing cover a pixel or less, and a
+// full Shape::draw spends its time on state changes and path setup that
+// cannot show. Shapes are judged by the on-screen size of their index
+// bounds (the larger side, in device pixels):
+//   below skipBelow     not drawn
+//   below pointBelow    one device pixel in the shape's colour
+//   below outlineBelow  filled rectangles and ellipses: their bounds in the
+//                       fill colour, outline dropped
+//   otherwise           in full, with curves flattened more coarsely the
+//                       further the view is zoomed out
+// Points and boxes go to the BatchRenderer as plain rectangles, so runs
+// of the same colour become a single fill.
+struct LodPolicy {
+    enum Level {
+        Skip,
+        Point,
+        Box,
+        Full
+    };
+
+    bool enabled = true;
+    double skipBelow = 0.1;         // Device pixels
+    double pointBelow = 1.0;
+    double outlineBelow = 4.0;
+    double tolerance = 0.1;         // Flattening tolerance at zoom >= 1 (Cairo's default)
+    double maxTolerance = 0.5;      // Cap when zoomed out
+
+    struct Counts {
+        int full = 0;
+        int reduced = 0;            // Drawn as a point or a box
+        int skipped = 0;
+    };
+
+    Level classify(const Shape *shape, double zoom) const;
+    double flatteningTolerance(double zoom) const;
+
+#ifdef ENABLE_CAIRO
+    // Draws shapes in order through renderer, whose context's user space
+    // is world coordinates scaled by zoom. Flush the renderer afterwards.
+    Counts draw(BatchRenderer &renderer, const QList<Shape*> &shapes, double zoom) const;
+#endif
+
+    bool operator==(const LodPolicy &other) const;
+    bool operator!=(const LodPolicy &other) const { return !(*this == other); }
+};
+
+#endif // LODPOLICY_H
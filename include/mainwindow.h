@@ -57,6 +57,10 @@ private slots:
     void cut();
     void copy();
     void paste();
+    void bringToFront();
+    void bringForward();
+    void sendBackward();
+    void sendToBack();
 
     // Tools
     void selectTool();
@@ -74,6 +78,7 @@ private slots:
     void fitToView();
     void showGrid();
     void snapToGrid();
+    void snapToObjects(bool enabled);
 
     // Layers
     void addLayer();
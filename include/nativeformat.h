@@ -0,0 +1,35 @@
+#ifndef NATIVEFORMAT_H
+#define NATIVEFORMAT_H
+
+#include <QString>
+
+class Document;
+
+// Native binary document format (.vgd), behind Document::save/load.
+//
+//   Header   magic, byte-order mark, version, document size and
+//            background, then count and file offset of every section
+//   Styles   one record per distinct pen + brush pair
+//   Layers   name, visibility, lock, number of shape records
+//   Shapes   packed per-type records in layer and draw order, each
+//            naming its style by index
+//   Points   Bezier control points, one pool for all curves
+//   Strings  UTF-8 layer names and text
+//
+// Records are fixed-size structs in host byte order (files written on a
+// host of the other endianness are rejected by the byte-order mark). A
+// file is loaded through one read-only mapping and copied straight into
+// shapes; saving streams the sections through a fixed buffer.
+class NativeFormat
+{
+public:
+    static constexpr const char *Suffix = "vgd";
+
+    static bool save(const Document *document, const QString &filename);
+
+    // Replaces the document's layers only once the whole file has been
+    // read; on failure the document is left as it was.
+    static bool load(Document *document, const QString &filename);
+};
+
+#endif // NATIVEFORMAT_H
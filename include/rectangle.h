@@ -21,6 +21,7 @@ public:
     void draw(QPainter &painter) override;      // Qt-based drawing (for UI rendering)
 	#ifdef ENABLE_CAIRO
     void draw(cairo_t *cr) override;           // Cairo-based drawing (for export)
+    bool buildPath(cairo_t *cr) const override;
 	#endif
 
     bool contains(const QPointF &point) const override;
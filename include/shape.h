@@ -8,11 +8,17 @@
 #include <QBrush>
 #include <QRectF>
 #include <QPainter>
+#include <QPolygonF>
+#include <vector>
+#include "affinekernel.h"
+#include "styletable.h"
 
 #ifdef ENABLE_CAIRO
 #include <cairo.h>
 #endif
 
+class Layer;
+struct SnapPoint;
 
 class Shape
 {
@@ -26,13 +32,28 @@ public:
     };
 
     Shape();
-    virtual ~Shape() = default;
+    Shape(const Shape &other);              // Copies start outside any layer
+    Shape &operator=(const Shape &) = delete;
+    virtual ~Shape();
+
+    // Every subclass (and clone()) is allocated from ShapePool
+    static void* operator new(size_t size);
+    static void operator delete(void *block, size_t size);
 
     // ========================
     // Pure virtual methods
     // ========================
 	#ifdef ENABLE_CAIRO
     virtual void draw(cairo_t *cr) = 0;          // Cairo-based drawing
+    // Rotates cr the way draw(QPainter&) rotates the shape: by m_rotation
+    // about the centre of the bounding rect
+    void rotateContext(cairo_t *cr) const;
+
+    // Appends the outline, in world coordinates and without the rotation,
+    // to cr's current path so BatchRenderer can fill and stroke a run of
+    // same-styled shapes at once. Returns false, appending nothing, if the
+    // shape must go through draw().
+    virtual bool buildPath(cairo_t *cr) const;
     #endif
 
 	virtual void draw(QPainter &painter) = 0;    // QPainter-based drawing
@@ -49,11 +70,16 @@ public:
     void setSize(const QSizeF &size);
     QSizeF getSize() const;
 
+    // Pen and brush live in the shared StyleTable; setting either interns
+    // the new pair and leaves other shapes with the old style untouched
     void setPen(const QPen &pen);
-    QPen getPen() const;
+    const QPen& getPen() const;
 
     void setBrush(const QBrush &brush);
-    QBrush getBrush() const;
+    const QBrush& getBrush() const;
+
+    void setStyle(quint32 style);           // StyleTable index, held by the caller
+    quint32 getStyle() const { return m_style; }
 
     void setVisible(bool visible);
     bool isVisible() const;
@@ -75,14 +101,93 @@ public:
     // ========================
     virtual QRectF getBoundingRect() const;
 
+    // World-space box covering the shape as drawn and as hit-tested
+    // (rotation, stroke width and pick tolerance included). This is the
+    // key the owning layer's spatial index is maintained with.
+    virtual QRectF getIndexBounds() const;
+
+    // World-space points along the outline as drawn (rotation included).
+    // Region selection counts the shape as enclosed when all of them are.
+    // The default is the corners of the bounding rect.
+    virtual QPolygonF getOutline() const;
+
+    // Appends the points other geometry snaps to (SnapIndex), as drawn.
+    // The default is the corners, edge midpoints and centre of the box.
+    virtual void getSnapPoints(std::vector<SnapPoint> &points) const;
+
+    // Owning layer (set by Layer::addShape, cleared by removeShape)
+    Layer* getLayer() const { return m_layer; }
+
+    // Unique for the lifetime of the process; copies get their own
+    quint64 getId() const { return m_id; }
+
+    // ========================
+    // Undo history
+    // ========================
+    // The properties that in-place edits change. Document keeps the
+    // fields an edit changed, and undoes or redoes it by exchanging them
+    // with the shape's current values.
+    struct State {
+        enum Field : quint8 {
+            Position = 0x01,
+            Size = 0x02,
+            Rotation = 0x04,
+            Style = 0x08,
+            Points = 0x10       // Line and Bezier: gatherPoints()
+        };
+
+        quint8 fields = 0;      // Which members hold values
+        QPointF position;
+        QSizeF size;
+        double rotation = 0.0;
+        StyleRef style;         // Held while the state is kept
+        std::vector<QPointF> points;
+
+        // Drops the fields equal in other; false if none are left
+        bool dropUnchanged(const State &other);
+        // Takes the fields of other this one does not have
+        void merge(const State &other);
+        size_t memoryUsage() const;
+    };
+
+    State saveState() const;
+    // Applies the fields state holds and returns their previous values,
+    // so exchanging the result back reverts the call
+    State exchangeState(const State &state);
+
 protected:
+    // Bulk transforms (Layer::transformShapes) run over one flat array
+    // holding the defining points of every shape involved. gatherPoints()
+    // appends this shape's; scatterPoints() reads the same number back,
+    // transformed, and updates the shape without notifying the layer. The
+    // default is the centre of the box, with size and rotation following
+    // the transform's parts.
+    virtual void gatherPoints(std::vector<QPointF> &points) const;
+    virtual void scatterPoints(const QPointF *points, const AffineKernel::Parts &parts);
+
+    // points rotated the way draw() rotates the shape: by m_rotation about
+    // the centre of the bounding rect
+    QPolygonF asDrawn(const QPolygonF &points) const;
+
+    // Must be called after any change that can move the index bounds
+    void geometryChanged();
+    // After visibility, selection or fill changes
+    void stateChanged();
+
     QPointF m_position;
     QSizeF m_size;
-    QPen m_pen;
-    QBrush m_brush;
+    StyleRef m_style;
     bool m_visible;
     bool m_selected;
     double m_rotation;
+
+private:
+    friend class Layer;
+
+    quint64 m_id;
+    Layer *m_layer;         // Owning layer, if any
+    quint64 m_zOrder;       // Draw order key within the owning layer
+    int m_row;              // Row in the owning layer's ShapeColumns
 };
 
 #endif // SHAPE_H
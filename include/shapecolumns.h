@@ -0,0 +1,63 @@
+#ifndef SHAPECOLUMNS_H
+#define SHAPECOLUMNS_H
+
+#include <QRectF>
+#include <QList>
+#include <vector>
+
+class Shape;
+
+// Structure-of-arrays culling table of a layer's shapes, one row per shape
+// in draw order. The Shape objects stay authoritative; the owning Layer
+// refreshes a row whenever its shape changes. Loops that only need bounds,
+// style or flags (viewport culling, region queries, export filtering) walk
+// these contiguous columns instead of dereferencing every Shape* (and its
+// vtable) on the heap: a scan reads 33 bytes per shape in sequence rather
+// than a scattered object. Only what those loops read is kept, so the
+// table costs 45 bytes per shape on top of the objects.
+class ShapeColumns
+{
+public:
+    enum Flag : quint8 {
+        Visible = 0x01,
+        Selected = 0x02
+    };
+
+    void append(Shape *shape);
+    void remove(int row);           // Later rows move down by one
+    void removeRows(const std::vector<char> &doomed);  // Rows flagged non-zero, in one pass
+    void clearRow(int row);         // Tombstone: no shape, matches no query
+    void reorder(const std::vector<int> &rows);  // Row i becomes old row rows[i]; others dropped
+    void update(int row);           // Re-read everything from the shape
+    void updateState(int row);      // Flags and style only
+    void clear();
+    void reserve(int count);
+
+    int size() const { return static_cast<int>(m_shapes.size()); }
+    Shape* shape(int row) const { return m_shapes[row]; }
+
+    // Columns, size() entries each
+    const double* minX() const { return m_minX.data(); }      // Index bounds
+    const double* minY() const { return m_minY.data(); }
+    const double* maxX() const { return m_maxX.data(); }
+    const double* maxY() const { return m_maxY.data(); }
+    const quint32* style() const { return m_style.data(); }   // StyleTable index
+    const quint8* flags() const { return m_flags.data(); }
+
+    // Shapes whose index bounds touch rect (edges inclusive, like
+    // SpatialIndex) and that have all of requiredFlags set, in draw order
+    QList<Shape*> query(const QRectF &rect, quint8 requiredFlags = 0) const;
+
+    // Bytes held by the columns
+    size_t memoryUsage() const;
+
+private:
+    void store(int row);
+
+    std::vector<Shape*> m_shapes;
+    std::vector<double> m_minX, m_minY, m_maxX, m_maxY;
+    std::vector<quint32> m_style;
+    std::vector<quint8> m_flags;
+};
+
+#endif // SHAPECOLUMNS_H
@@ -0,0 +1,30 @@
+#ifndef SHAPEPOOL_H
+#define SHAPEPOOL_H
+
+#include <cstddef>
+
+// Size-class allocator behind Shape::operator new/delete.
+// Blocks are carved out of 64 KB slabs, one size class per 16 bytes up to
+// 256, so every shape type gets its own densely packed free list. Each
+// thread keeps a small cache of free blocks and only touches the shared,
+// locked lists in batches, which keeps parallel SVG import cheap. Larger
+// objects go straight to the global allocator.
+class ShapePool
+{
+public:
+    static void* allocate(std::size_t size);
+    static void deallocate(void *block, std::size_t size);
+
+    // Hand slabs that no longer hold a live block back to the system
+    // (called after Document::clear has deleted its shapes). Only the
+    // calling thread's cache is flushed first: other threads' caches are
+    // unlocked, so blocks they hold (at most 256 per size class, e.g. on
+    // the import workers) keep their slabs until those threads free past
+    // that limit or exit.
+    static void trim();
+
+    // Bytes currently held in slabs, live or free
+    static std::size_t reservedBytes();
+};
+
+#endif // SHAPEPOOL_H
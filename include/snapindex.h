@@ -0,0 +1,74 @@
+#ifndef SNAPINDEX_H
+#define SNAPINDEX_H
+
+#include <QPointF>
+#include <QHash>
+#include <functional>
+#include <vector>
+
+class Shape;
+
+// A point that the pointer can snap to
+struct SnapPoint {
+    enum Kind : quint8 {
+        Endpoint,       // Ends of lines and open curves
+        Anchor,         // On-curve Bezier points
+        Midpoint,       // Middle of a line
+        Corner,         // Bounding box corners
+        Edge,           // Bounding box edge midpoints
+        Center          // Bounding box centre
+    };
+
+    QPointF point;
+    Kind kind = Center;
+};
+
+// Snap candidates of a layer's shapes in a uniform grid hash.
+// Every cell lists the points that fall inside it, so a query only visits
+// the few cells its radius overlaps, however many points the layer has.
+// Shapes are re-inserted one at a time as they change (the owning Layer
+// does this), which costs a handful of points rather than a rebuild.
+class SnapIndex
+{
+public:
+    explicit SnapIndex(double cellSize = 32.0);
+
+    SnapIndex(const SnapIndex &) = delete;
+    SnapIndex &operator=(const SnapIndex &) = delete;
+
+    // Maintenance
+    void insert(const Shape *shape);
+    void remove(const Shape *shape);
+    void update(const Shape *shape);
+    void clear();
+
+    bool contains(const Shape *shape) const;
+    int size() const { return m_count; }        // Candidate points
+
+    // Closest candidate within radius of point, ignoring shapes skip
+    // accepts (the ones being dragged, say). Equally close candidates go
+    // by kind, endpoints first. Returns false if there is none.
+    bool nearest(const QPointF &point, double radius, SnapPoint &result,
+                 const std::function<bool(const Shape*)> &skip = nullptr) const;
+
+private:
+    using Key = quint64;
+
+    struct Entry {
+        QPointF point;
+        const Shape *shape;
+        SnapPoint::Kind kind;
+    };
+
+    int cellOf(double coordinate) const;
+    static Key key(int cx, int cy);
+
+    double m_cellSize;
+    QHash<Key, std::vector<Entry>> m_cells;
+    QHash<const Shape*, std::vector<Key>> m_shapeCells;    // Cells holding each shape's points
+    int m_count = 0;
+
+    std::vector<SnapPoint> m_scratch;
+};
+
+#endif // SNAPINDEX_H
@@ -0,0 +1,84 @@
+#ifndef SPATIALINDEX_H
+#define SPATIALINDEX_H
+
+#include <QRectF>
+#include <QPointF>
+#include <QList>
+#include <QHash>
+#include <utility>
+#include <vector>
+
+class Shape;
+
+// R-tree over shape bounding boxes (Guttman, quadratic split).
+// Each Layer owns one and keeps it in sync with its shapes, so point and
+// rectangle queries only visit the branches that can contain a hit.
+class SpatialIndex
+{
+public:
+    SpatialIndex();
+    ~SpatialIndex();
+
+    SpatialIndex(const SpatialIndex &) = delete;
+    SpatialIndex &operator=(const SpatialIndex &) = delete;
+
+    // Maintenance
+    void insert(Shape *shape, const QRectF &bounds);
+    // Many at once: packed bottom-up (sort-tile-recursive) into an empty
+    // index, which is far quicker and gives tighter nodes than one by one
+    void insert(const std::vector<std::pair<Shape*, QRectF>> &items);
+    void remove(Shape *shape);
+    void update(Shape *shape, const QRectF &bounds);
+    void clear();
+
+    bool contains(Shape *shape) const;
+    QRectF bounds(Shape *shape) const;
+    QRectF extent() const;          // Union of all entries (null when empty)
+    int size() const;
+
+    // Queries (unordered; callers sort by z-order when it matters)
+    QList<Shape*> query(const QPointF &point) const;
+    QList<Shape*> query(const QRectF &rect) const;
+
+private:
+    static constexpr int MaxEntries = 16;
+    static constexpr int MinEntries = 6;
+
+    struct Node;
+
+    // Stored as min/max corners: QRectF keeps x + width, and recomputing
+    // right() from a united rect can drift by an ulp and break containment.
+    struct Box {
+        double x1, y1, x2, y2;
+    };
+
+    struct Entry {
+        Box bounds;
+        Node *child = nullptr;     // Internal nodes
+        Shape *shape = nullptr;    // Leaf nodes
+    };
+
+    struct Node {
+        bool leaf = true;
+        Node *parent = nullptr;
+        std::vector<Entry> entries;
+    };
+
+    Node* chooseLeaf(const Box &bounds) const;
+    Node* findLeaf(Node *node, Shape *shape, const Box &bounds) const;
+    void insertEntry(const Entry &entry);
+    std::vector<Entry> packLevel(std::vector<Entry> &entries, bool leaf);
+    void adjustTree(Node *node, Node *split);
+    Node* splitNode(Node *node);
+    void condenseTree(Node *leaf);
+    void collectShapes(Node *node, std::vector<Entry> &out) const;
+    void destroy(Node *node);
+
+    static Box toBox(const QRectF &rect);
+    static Box nodeBounds(const Node *node);
+
+    Node *m_root;
+    QHash<Shape*, QRectF> m_bounds;
+};
+
+#endif // SPATIALINDEX_H
@@ -0,0 +1,61 @@
+#ifndef STROKEFITTER_H
+#define STROKEFITTER_H
+
+#include <QPointF>
+#include <QVector>
+
+// Online cubic curve fitting for freehand strokes (after Schneider,
+// "An Algorithm for Automatically Fitting Digitized Curves", Graphics
+// Gems 1990).
+//
+// Raw samples collect in a window that starts at the end of the last
+// finished segment. After every sample the whole window is fitted with
+// one cubic (least squares on chord-length parameters, refined by
+// Newton-Raphson). While that cubic stays within the tolerance it is
+// the provisional tail. Once it no longer fits, the previous fit is
+// committed and a new window starts at its end, tangent-continuous with
+// it. Each sample costs at most one fit of a bounded window.
+//
+// Output is in Bezier's point layout: the start point, then
+// (control 1, control 2, end) per cubic.
+class StrokeFitter
+{
+public:
+    explicit StrokeFitter(double tolerance = 2.0);
+
+    // Largest distance allowed between a sample and the fitted curve, in
+    // the samples' units (the Canvas passes screen pixels / zoom)
+    void setTolerance(double tolerance);
+    double getTolerance() const { return m_tolerance; }
+
+    void begin(const QPointF &point);
+    // Returns false when the sample was dropped as jitter (closer than a
+    // quarter of the tolerance to the previous one)
+    bool addSample(const QPointF &point);
+
+    // Committed segments plus the provisional tail
+    QVector<QPointF> points() const;
+    int committedPointCount() const { return m_fitted.size(); }
+
+    // Whole stroke in one go: begin() with the first sample, the rest
+    // through addSample(), then points()
+    static QVector<QPointF> fit(const QVector<QPointF> &samples, double tolerance);
+
+private:
+    struct Cubic {
+        QPointF p0, c1, c2, p3;
+    };
+
+    Cubic fitWindow(int count, double &maxError) const;
+    QPointF leftTangent(int count) const;
+    QPointF rightTangent(int count) const;
+
+    double m_tolerance;
+    QVector<QPointF> m_fitted;      // Committed, in Bezier layout
+    QVector<QPointF> m_window;      // Samples since the last committed point
+    QPointF m_anchorTangent;        // Direction leaving m_window[0] (null: free)
+    Cubic m_tail;
+    bool m_hasTail = false;
+};
+
+#endif // STROKEFITTER_H
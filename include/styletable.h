@@ -0,0 +1,114 @@
+#ifndef STYLETABLE_H
+#define STYLETABLE_H
+
+#include <QPen>
+#include <QBrush>
+#include <atomic>
+#include <memory>
+#include <mutex>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+class StyleRef;
+
+// Interned pen + brush pairs shared by all shapes.
+// A shape stores only the index of its style; editing a shape's pen or
+// brush interns the edited pair and switches the index, so styles are
+// copy-on-write and never change while in use. Entries are counted by
+// StyleRef and recycled once the last reference is gone (the default
+// style is never recycled). Entries are never moved: references
+// returned by pen()/brush() stay valid while the style is held, and
+// reads need no lock. Interning may be called from any thread.
+class StyleTable
+{
+public:
+    static constexpr quint32 DefaultStyle = 0;     // Black 1px pen, white fill
+
+    static StyleTable& instance();
+
+    // Throws std::bad_alloc when MaxChunks * ChunkSize styles are in use
+    StyleRef intern(const QPen &pen, const QBrush &brush);
+
+    const QPen& pen(quint32 style) const { return entry(style).pen; }
+    const QBrush& brush(quint32 style) const { return entry(style).brush; }
+
+    int size() const;                               // Styles in use
+
+private:
+    friend class StyleRef;
+
+    StyleTable();
+    StyleTable(const StyleTable &) = delete;
+    StyleTable &operator=(const StyleTable &) = delete;
+
+    struct Entry {
+        QPen pen;
+        QBrush brush;
+        mutable std::atomic<quint32> refs{0};
+        mutable std::atomic<quint32> generation{0}; // Bumped on recycling
+        bool live = false;                          // Guarded by m_mutex
+    };
+
+    static constexpr int ChunkBits = 10;
+    static constexpr quint32 ChunkSize = 1u << ChunkBits;
+    static constexpr int MaxChunks = 4096;          // 4M distinct styles
+
+    const Entry& entry(quint32 style) const
+    {
+        return m_chunks[style >> ChunkBits][style & (ChunkSize - 1)];
+    }
+
+    static size_t hash(const QPen &pen, const QBrush &brush);
+
+    void acquire(quint32 style) const;
+    bool tryAcquire(quint32 style) const;           // Fails if the entry is free
+    void release(quint32 style);
+
+    std::unique_ptr<Entry[]> m_chunks[MaxChunks];
+    std::atomic<quint32> m_size{0};
+
+    mutable std::mutex m_mutex;                     // Guards m_lookup, m_free and appends
+    std::unordered_multimap<size_t, quint32> m_lookup;
+    std::vector<quint32> m_free;
+};
+
+// Counted reference to a StyleTable entry. Anything that keeps a style
+// index past the life of the shapes using it (undo history, a loader's
+// record table) holds one of these instead of the bare index.
+class StyleRef
+{
+public:
+    StyleRef() = default;                           // DefaultStyle
+    explicit StyleRef(quint32 style) : m_style(style)   // style must be held elsewhere
+    {
+        if (m_style != StyleTable::DefaultStyle) StyleTable::instance().acquire(m_style);
+    }
+    StyleRef(const StyleRef &other) : StyleRef(other.m_style) {}
+    StyleRef(StyleRef &&other) noexcept : m_style(other.m_style)
+    {
+        other.m_style = StyleTable::DefaultStyle;
+    }
+    ~StyleRef()
+    {
+        if (m_style != StyleTable::DefaultStyle) StyleTable::instance().release(m_style);
+    }
+
+    StyleRef &operator=(StyleRef other) noexcept
+    {
+        std::swap(m_style, other.m_style);
+        return *this;
+    }
+
+    operator quint32() const { return m_style; }
+
+private:
+    friend class StyleTable;
+
+    enum AdoptTag { Adopt };
+    StyleRef(quint32 style, AdoptTag) : m_style(style) {}
+
+    quint32 m_style = StyleTable::DefaultStyle;
+};
+
+#endif // STYLETABLE_H
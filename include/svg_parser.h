@@ -3,9 +3,12 @@
 
 #include <QString>
 #include <QList>
-#include <QTextStream>
-// #include <libxml/parser.h>
-// #include <libxml/tree.h>
+#include <QColor>
+#include <deque>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
 #include "shape.h"
 #include "rectangle.h"
 #include "ellipse.h"
@@ -13,6 +16,11 @@
 #include "bezier.h"
 
 class Document;
+class Layer;
+class SvgWriter;
+#ifdef ENABLE_LIBXML2
+struct _xmlTextReader;
+#endif
 
 class SVGParser
 {
@@ -32,7 +40,58 @@ public:
     // Generate SVG string
     QString generateSVGString(Document *document);
 
+    // Threads used by importFromFile: 0 = one per core (default), 1 = the
+    // single-pass reader. With more, large files are split between the
+    // top-level elements and the pieces parsed concurrently.
+    void setImportThreadCount(int count);
+    int getImportThreadCount() const;
+
 private:
+    // fill/stroke value: not given (keep inherited/default), "none", or a colour
+    struct SvgPaint {
+        enum Kind { Unset, None, Color };
+        Kind kind = Unset;
+        QColor color;
+    };
+
+    // Presentation state inherited from enclosing <svg>/<g> elements
+    struct SvgStyle {
+        SvgPaint fill;
+        SvgPaint stroke;
+        double strokeWidth = -1.0;  // < 0: not given
+        QPointF offset;             // Accumulated translate() of the groups
+    };
+
+    // Attributes of the current element as views into the parser's own
+    // buffers; only valid until the reader moves on.
+    struct SvgAttributes {
+        std::vector<std::pair<std::string_view, std::string_view>> items;
+        std::deque<std::string> owned;  // Values that had to be assembled (entities)
+        std::string_view value(std::string_view name) const;
+        bool contains(std::string_view name) const;
+    };
+
+    // What one reader pass produced, in document order
+    struct SvgContent {
+        QList<Shape*> shapes;
+        bool hasSize = false;
+        QSizeF size;
+    };
+
+    // Streaming import (libxml2 xmlTextReader over the memory-mapped file,
+    // UTF-8 parsed in place), serial or split into chunks
+#ifdef ENABLE_LIBXML2
+    bool importStreaming(const QString &filename, Document *document);
+    bool importChunked(const std::vector<std::string_view> &chunks, std::string_view openTag,
+                       std::string_view closeTag, const QByteArray &url, Document *document);
+    bool readElements(_xmlTextReader *reader, SvgContent &content);
+#endif
+    Layer* resetDocument(Document *document);
+    SvgStyle inheritStyle(const SvgStyle &parent, const SvgAttributes &attributes);
+    Shape* createShape(std::string_view tag, const SvgAttributes &attributes, const SvgStyle &style);
+    Bezier* parsePathData(std::string_view data);
+    void applyStyle(Shape *shape, const SvgStyle &style);
+
     // Import helpers
     void parseBasicShapes(const QString &svgString, Document *document);
     void parseRectElement(const QString &element, Document *document);
@@ -40,17 +99,20 @@ private:
     void parseLineElement(const QString &element, Document *document);
     void parseShapeStyle(const QString &element, Shape *shape);
     
-    // Export helpers
-    void writeShape(QTextStream &stream, Shape *shape);
-    void writeRectangle(QTextStream &stream, Rectangle *rect);
-    void writeEllipse(QTextStream &stream, Ellipse *ellipse);
-    void writeLine(QTextStream &stream, Line *line);
-    void writeBezier(QTextStream &stream, Bezier *bezier);
+    // Export helpers (buffered UTF-8 output, see SvgWriter)
+    void writeDocument(SvgWriter &out, Document *document);
+    void writeShape(SvgWriter &out, const Shape *shape);
+    void writeStyle(SvgWriter &out, const Shape *shape, bool filled);
+    void writeRectangle(SvgWriter &out, const Rectangle *rect);
+    void writeEllipse(SvgWriter &out, const Ellipse *ellipse);
+    void writeLine(SvgWriter &out, const Line *line);
+    void writeBezier(SvgWriter &out, const Bezier *bezier);
     
     // Utility functions
     QColor parseColor(const QString &colorString);
     QString extractAttribute(const QString &element, const QString &attribute);
-    QString colorToString(const QColor &color);
+
+    int m_importThreads;
 };
 
 #endif // SVG_PARSER_H 
\ No newline at end of file
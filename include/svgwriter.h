@@ -0,0 +1,44 @@
+#ifndef SVGWRITER_H
+#define SVGWRITER_H
+
+#include <QColor>
+#include <QIODevice>
+#include <memory>
+#include <string_view>
+
+// Buffered UTF-8 output for the SVG exporter.
+// Text collects in one fixed buffer that is handed to the device only when
+// it fills up, so exporting any number of shapes needs BufferSize bytes and
+// no allocation per shape. Numbers use std::to_chars: the shortest text
+// that reads back to the same double.
+class SvgWriter
+{
+public:
+    static constexpr int BufferSize = 64 * 1024;
+
+    explicit SvgWriter(QIODevice *device);
+    ~SvgWriter();                                   // Flushes what is left
+
+    SvgWriter(const SvgWriter &) = delete;
+    SvgWriter &operator=(const SvgWriter &) = delete;
+
+    SvgWriter& operator<<(std::string_view text);
+    SvgWriter& operator<<(const char *text);
+    SvgWriter& operator<<(char c);
+    SvgWriter& operator<<(double value);
+    SvgWriter& operator<<(const QColor &color);     // #rrggbb
+
+    // Hand the buffer to the device; false once any write has failed
+    bool flush();
+    bool hasError() const;
+
+private:
+    void reserve(int bytes);                        // Flush unless bytes still fit
+
+    QIODevice *m_device;
+    std::unique_ptr<char[]> m_buffer;
+    int m_used;
+    bool m_error;
+};
+
+#endif // SVGWRITER_H
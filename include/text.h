@@ -12,7 +12,7 @@ public:
 
     void draw(QPainter &painter) override;
 #ifdef ENABLE_CAIRO
-    void draw(cairo_t *cr) override {}
+    void draw(cairo_t *cr) override;
 #endif
 
     bool contains(const QPointF &point) const override;
@@ -0,0 +1,62 @@
+#ifndef THREADPOOL_H
+#define THREADPOOL_H
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Work-stealing thread pool.
+// Every worker owns a deque: it pops its own work from the back and, when
+// that runs dry, steals from the front of the others. Uneven jobs (a tile
+// full of shapes next to an empty one) therefore balance out on their own.
+class ThreadPool
+{
+public:
+    using Task = std::function<void()>;
+
+    explicit ThreadPool(int threadCount = 0);   // 0 = one per core
+    ~ThreadPool();
+
+    ThreadPool(const ThreadPool &) = delete;
+    ThreadPool &operator=(const ThreadPool &) = delete;
+
+    // Shared pool for rendering and parsing
+    static ThreadPool& globalInstance();
+
+    int threadCount() const;
+
+    // Queue a task (on the calling worker's own deque when called from a task)
+    void submit(Task task);
+
+    // Run body(0) .. body(count - 1) on the pool and wait for all of them.
+    // The calling thread helps out instead of sleeping, so this may also be
+    // used from inside a task.
+    void parallelFor(int count, const std::function<void(int)> &body);
+
+private:
+    struct Worker {
+        std::mutex mutex;
+        std::deque<Task> tasks;
+    };
+
+    void run(int index);
+    bool popLocal(int index, Task &task);
+    bool steal(int thief, Task &task);
+    bool runPendingTask();          // One task from anywhere, if there is one
+
+    std::vector<std::unique_ptr<Worker>> m_workers;
+    std::vector<std::thread> m_threads;
+
+    std::mutex m_sleepMutex;
+    std::condition_variable m_wake;
+    std::atomic<int> m_queued{0};   // Submitted but not yet picked up
+    std::atomic<bool> m_stop{false};
+    std::atomic<unsigned> m_nextWorker{0};
+};
+
+#endif // THREADPOOL_H
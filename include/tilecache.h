@@ -0,0 +1,62 @@
+#ifndef TILECACHE_H
+#define TILECACHE_H
+
+#include <QCache>
+#include <QImage>
+#include <QRect>
+#include <QRectF>
+#include <QHash>
+
+// Retained raster tiles for the Cairo backend.
+// Tiles are TileSize x TileSize ARGB32 images in unpanned device space
+// (world * zoom), keyed by (zoom, tile x, tile y). Panning therefore only
+// changes where tiles are blitted, and a shape edit only drops the tiles
+// its bounds touch. Eviction is least-recently-used under a byte budget.
+class TileCache
+{
+public:
+    static constexpr int TileSize = 256;
+    static constexpr qint64 TileBytes = qint64(TileSize) * TileSize * 4;
+
+    explicit TileCache(qint64 maxBytes = 64 * 1024 * 1024);
+
+    // Memory cap (bytes); least recently used tiles are evicted beyond it
+    void setMaxBytes(qint64 bytes);
+    qint64 maxBytes() const;
+    qint64 usedBytes() const;
+    int tileCount() const;
+
+    // Cached tile or nullptr; a hit marks the tile as most recently used
+    QImage* tile(double zoom, int tx, int ty) const;
+    // Takes a copy of image; returns the cached tile, or nullptr if the
+    // cap is too small to hold even a single tile
+    QImage* insert(double zoom, int tx, int ty, const QImage &image);
+
+    // Drop every tile (at any zoom) that worldRect touches
+    void invalidate(const QRectF &worldRect);
+    void clear();
+
+    // Tile geometry
+    static QRect tilesCovering(const QRect &deviceRect);   // Tile coordinates, inclusive
+    static QRect tileDeviceRect(int tx, int ty);
+    static QRectF tileWorldRect(double zoom, int tx, int ty);
+
+private:
+    struct Key {
+        double zoom;
+        int x;
+        int y;
+
+        bool operator==(const Key &other) const {
+            return zoom == other.zoom && x == other.x && y == other.y;
+        }
+    };
+
+    friend inline size_t qHash(const Key &key, size_t seed = 0) {
+        return qHash(key.zoom, seed) ^ (uint(key.x) * 73856093u) ^ (uint(key.y) * 19349663u);
+    }
+
+    QCache<Key, QImage> m_tiles;
+};
+
+#endif // TILECACHE_H
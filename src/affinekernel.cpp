@@ -0,0 +1,97 @@
+#include "affinekernel.h"
+#include <algorithm>
+#include <cmath>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define AFFINEKERNEL_SSE2
+#include <emmintrin.h>
+#endif
+
+#ifdef AFFINEKERNEL_SSE2
+// The kernels read QPointF arrays as packed (x, y) doubles
+static_assert(sizeof(QPointF) == 2 * sizeof(double), "QPointF must be two doubles");
+#endif
+
+void AffineKernel::map(const QTransform &transform, QPointF *points, std::size_t count)
+{
+#ifdef AFFINEKERNEL_SSE2
+    // x' = m11 x + m21 y + dx,  y' = m12 x + m22 y + dy: one point per
+    // register, as x * (m11, m12) + y * (m21, m22) + (dx, dy)
+    const __m128d column1 = _mm_set_pd(transform.m12(), transform.m11());
+    const __m128d column2 = _mm_set_pd(transform.m22(), transform.m21());
+    const __m128d offset = _mm_set_pd(transform.dy(), transform.dx());
+    double *data = reinterpret_cast<double*>(points);
+
+    std::size_t i = 0;
+    for (; i + 2 <= count; i += 2) {
+        const __m128d p0 = _mm_loadu_pd(data + 2 * i);
+        const __m128d p1 = _mm_loadu_pd(data + 2 * i + 2);
+        const __m128d r0 = _mm_add_pd(_mm_add_pd(_mm_mul_pd(_mm_unpacklo_pd(p0, p0), column1),
+                                                 _mm_mul_pd(_mm_unpackhi_pd(p0, p0), column2)), offset);
+        const __m128d r1 = _mm_add_pd(_mm_add_pd(_mm_mul_pd(_mm_unpacklo_pd(p1, p1), column1),
+                                                 _mm_mul_pd(_mm_unpackhi_pd(p1, p1), column2)), offset);
+        _mm_storeu_pd(data + 2 * i, r0);
+        _mm_storeu_pd(data + 2 * i + 2, r1);
+    }
+    if (i < count) {
+        const __m128d p = _mm_loadu_pd(data + 2 * i);
+        _mm_storeu_pd(data + 2 * i, _mm_add_pd(_mm_add_pd(_mm_mul_pd(_mm_unpacklo_pd(p, p), column1),
+                                                          _mm_mul_pd(_mm_unpackhi_pd(p, p), column2)), offset));
+    }
+#else
+    const double m11 = transform.m11(), m12 = transform.m12();
+    const double m21 = transform.m21(), m22 = transform.m22();
+    const double dx = transform.dx(), dy = transform.dy();
+    for (std::size_t i = 0; i < count; ++i) {
+        const double x = points[i].x(), y = points[i].y();
+        points[i] = QPointF(m11 * x + m21 * y + dx, m12 * x + m22 * y + dy);
+    }
+#endif
+}
+
+void AffineKernel::bounds(const QPointF *points, std::size_t count, QPointF &min, QPointF &max)
+{
+#ifdef AFFINEKERNEL_SSE2
+    const double *data = reinterpret_cast<const double*>(points);
+    __m128d low = _mm_loadu_pd(data);
+    __m128d high = low;
+    for (std::size_t i = 1; i < count; ++i) {
+        const __m128d p = _mm_loadu_pd(data + 2 * i);
+        low = _mm_min_pd(low, p);
+        high = _mm_max_pd(high, p);
+    }
+    double out[2];
+    _mm_storeu_pd(out, low);
+    min = QPointF(out[0], out[1]);
+    _mm_storeu_pd(out, high);
+    max = QPointF(out[0], out[1]);
+#else
+    double x1 = points[0].x(), y1 = points[0].y(), x2 = x1, y2 = y1;
+    for (std::size_t i = 1; i < count; ++i) {
+        x1 = std::min(x1, points[i].x());
+        y1 = std::min(y1, points[i].y());
+        x2 = std::max(x2, points[i].x());
+        y2 = std::max(y2, points[i].y());
+    }
+    min = QPointF(x1, y1);
+    max = QPointF(x2, y2);
+#endif
+}
+
+AffineKernel::Parts AffineKernel::decompose(const QTransform &transform)
+{
+    Parts parts;
+    parts.scaleX = std::hypot(transform.m11(), transform.m12());
+    parts.scaleY = std::hypot(transform.m21(), transform.m22());
+    parts.angle = std::atan2(transform.m12(), transform.m11()) * 180.0 / M_PI;
+    return parts;
+}
+
+bool AffineKernel::isVectorised()
+{
+#ifdef AFFINEKERNEL_SSE2
+    return true;
+#else
+    return false;
+#endif
+}
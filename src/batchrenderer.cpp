@@ -0,0 +1,165 @@
+#include "batchrenderer.h"
+
+#ifdef ENABLE_CAIRO
+#include "shape.h"
+#include "styletable.h"
+
+namespace {
+
+// Runs that need overlap checks are cut at this length to bound the scan
+constexpr int MaxCheckedRun = 256;
+
+inline void setSource(cairo_t *cr, const QColor &color)
+{
+    cairo_set_source_rgba(cr, color.redF(), color.greenF(), color.blueF(), color.alphaF());
+}
+
+// Area the shape's Cairo drawing can touch: its outline as drawn, rotation
+// included. The pick tolerance in the index bounds would split runs needlessly.
+inline QRectF drawnBounds(const Shape *shape, const QPen &pen)
+{
+    const double margin = pen.style() != Qt::NoPen ? pen.widthF() / 2.0 : 0.0;
+    return shape->getOutline().boundingRect().adjusted(-margin, -margin, margin, margin);
+}
+
+} // namespace
+
+BatchRenderer::BatchRenderer(cairo_t *cr, bool batching)
+    : m_cr(cr)
+    , m_batching(batching)
+{
+}
+
+BatchRenderer::~BatchRenderer()
+{
+    flush();
+}
+
+void BatchRenderer::draw(Shape *shape)
+{
+    if (!shape->isVisible()) return;
+    ++m_stats.shapes;
+
+    const QPen &pen = shape->getPen();
+    const QBrush &brush = shape->getBrush();
+    const bool fill = brush.style() != Qt::NoBrush;
+    const bool stroke = pen.style() != Qt::NoPen;
+    if (!fill && !stroke) return;
+
+    // buildPath() appends the unrotated outline; draw() applies the rotation
+    if (!m_batching || shape->getRotation() != 0.0) {
+        flush();
+        drawSingle(shape);
+        return;
+    }
+
+    const quint32 style = shape->getStyle();
+    if (m_run != ShapeRun || m_style != style) flush();
+
+    QRectF bounds;
+    if (m_run == ShapeRun && m_checkOverlap) {
+        bounds = drawnBounds(shape, pen);
+        if (m_count >= MaxCheckedRun || overlapsRun(bounds)) flush();
+    }
+
+    if (m_run == NoRun) {
+        cairo_new_path(m_cr);
+        m_run = ShapeRun;
+        m_style = style;
+        m_fill = fill;
+        m_stroke = stroke;
+        // Filled members must not overlap: besides the fill/stroke order,
+        // closed curves of opposite orientation would cancel under the
+        // winding rule. Opaque strokes on their own merge freely.
+        m_checkOverlap = fill || pen.color().alpha() < 255;
+        if (m_checkOverlap && bounds.isNull()) bounds = drawnBounds(shape, pen);
+    }
+
+    if (!shape->buildPath(m_cr)) {
+        flush();
+        drawSingle(shape);
+        return;
+    }
+
+    ++m_count;
+    if (m_checkOverlap) {
+        m_runBounds = m_bounds.empty() ? bounds : m_runBounds.united(bounds);
+        m_bounds.push_back(bounds);
+    }
+}
+
+void BatchRenderer::fillRect(const QRectF &rect, const QColor &color)
+{
+    if (!m_batching) {
+        cairo_new_path(m_cr);
+        cairo_rectangle(m_cr, rect.x(), rect.y(), rect.width(), rect.height());
+        setSource(m_cr, color);
+        cairo_fill(m_cr);
+        ++m_stats.stateChanges;
+        return;
+    }
+
+    const QRgb rgba = color.rgba();
+    if (m_run != RectRun || m_color != rgba) flush();
+    if (m_run == NoRun) {
+        cairo_new_path(m_cr);
+        m_run = RectRun;
+        m_color = rgba;
+    }
+
+    cairo_rectangle(m_cr, rect.x(), rect.y(), rect.width(), rect.height());
+    ++m_count;
+}
+
+void BatchRenderer::flush()
+{
+    if (m_run == NoRun) return;
+
+    if (m_count > 0) {
+        if (m_run == RectRun) {
+            setSource(m_cr, QColor::fromRgba(m_color));
+            cairo_fill(m_cr);
+            ++m_stats.stateChanges;
+        } else {
+            const StyleTable &styles = StyleTable::instance();
+            if (m_fill) {
+                setSource(m_cr, styles.brush(m_style).color());
+                cairo_fill_preserve(m_cr);
+                ++m_stats.stateChanges;
+            }
+            if (m_stroke) {
+                const QPen &pen = styles.pen(m_style);
+                setSource(m_cr, pen.color());
+                cairo_set_line_width(m_cr, pen.widthF());
+                cairo_stroke_preserve(m_cr);
+                m_stats.stateChanges += 2;
+            }
+        }
+        ++m_stats.batches;
+    }
+
+    cairo_new_path(m_cr);
+    m_run = NoRun;
+    m_count = 0;
+    m_runBounds = QRectF();
+    m_bounds.clear();
+}
+
+void BatchRenderer::drawSingle(Shape *shape)
+{
+    shape->draw(m_cr);
+    ++m_stats.single;
+    // What the shape's own draw sets: a fill source, a stroke source and width
+    m_stats.stateChanges += (shape->getBrush().style() != Qt::NoBrush ? 1 : 0)
+                          + (shape->getPen().style() != Qt::NoPen ? 2 : 0);
+}
+
+bool BatchRenderer::overlapsRun(const QRectF &bounds) const
+{
+    if (!m_runBounds.intersects(bounds)) return false;
+    for (const QRectF &member : m_bounds) {
+        if (member.intersects(bounds)) return true;
+    }
+    return false;
+}
+#endif
@@ -1,12 +1,35 @@
 #include "bezier.h"
+#include "snapindex.h"
 #include <QPainter>
 #include <QPainterPath>
+#include <algorithm>
 #include <cmath>
 
 #ifdef ENABLE_CAIRO
 #include <cairo.h>
 #endif
 
+#ifdef ENABLE_CAIRO
+namespace {
+
+// Per-thread context with an identity matrix that paths are recorded on,
+// so building one never disturbs the path a caller is accumulating
+cairo_t* scratchContext()
+{
+    struct Scratch {
+        cairo_surface_t *surface = cairo_image_surface_create(CAIRO_FORMAT_A8, 1, 1);
+        cairo_t *cr = cairo_create(surface);
+        ~Scratch() {
+            cairo_destroy(cr);
+            cairo_surface_destroy(surface);
+        }
+    };
+    thread_local Scratch scratch;
+    return scratch.cr;
+}
+
+} // namespace
+#endif
 
 Bezier::Bezier()
     : Shape()
@@ -14,35 +37,148 @@ Bezier::Bezier()
 {
 }
 
+Bezier::~Bezier()
+{
+#ifdef ENABLE_CAIRO
+    if (m_cairoPath) cairo_path_destroy(m_cairoPath);
+#endif
+}
+
 // ====================
-// QPainter Drawing
+// Geometry Cache
 // ====================
-void Bezier::draw(QPainter &painter)
+const QPainterPath& Bezier::path() const
 {
-    if (!isVisible() || m_points.isEmpty()) return;
+    if (m_cached.load(std::memory_order_acquire) & PathCached) return m_path;
 
-    QPen pen = getPen();
-    QBrush brush = getBrush();
+    std::lock_guard<std::mutex> lock(m_cacheMutex);
+    if (m_cached.load(std::memory_order_relaxed) & PathCached) return m_path;
 
     QPainterPath path;
-    path.moveTo(m_points[0]);
-
-    for (int i = 1; i < m_points.size(); i += 3) {
-        if (i + 2 < m_points.size()) {
-            path.cubicTo(m_points[i], m_points[i + 1], m_points[i + 2]);
-        } else if (i + 1 < m_points.size()) {
-            path.quadTo(m_points[i], m_points[i + 1]);
-        } else {
-            path.lineTo(m_points[i]);
+    if (!m_points.isEmpty()) {
+        path.moveTo(m_points[0]);
+
+        for (int i = 1; i < m_points.size(); i += 3) {
+            if (i + 2 < m_points.size()) {
+                path.cubicTo(m_points[i], m_points[i + 1], m_points[i + 2]);
+            } else if (i + 1 < m_points.size()) {
+                path.quadTo(m_points[i], m_points[i + 1]);
+            } else {
+                path.lineTo(m_points[i]);
+            }
+        }
+
+        if (m_closed) {
+            path.closeSubpath();
+        }
+    }
+
+    // QPainterPath computes its bounds lazily inside const calls; do it
+    // now, while we hold the lock, so later readers never write
+    path.boundingRect();
+    path.controlPointRect();
+
+    m_path = path;
+    m_cached.fetch_or(PathCached, std::memory_order_release);
+    return m_path;
+}
+
+const QPolygonF& Bezier::flattened() const
+{
+    if (m_cached.load(std::memory_order_acquire) & PolygonCached) return m_flattened;
+
+    const QPainterPath &curve = path();
+
+    std::lock_guard<std::mutex> lock(m_cacheMutex);
+    if (m_cached.load(std::memory_order_relaxed) & PolygonCached) return m_flattened;
+
+    // Only the first subpath is ever built
+    const QList<QPolygonF> polygons = curve.toSubpathPolygons();
+    m_flattened = polygons.isEmpty() ? QPolygonF() : polygons.first();
+    m_cached.fetch_or(PolygonCached, std::memory_order_release);
+    return m_flattened;
+}
+
+#ifdef ENABLE_CAIRO
+const cairo_path_t* Bezier::cairoPath() const
+{
+    if (m_cached.load(std::memory_order_acquire) & CairoCached) return m_cairoPath;
+
+    std::lock_guard<std::mutex> lock(m_cacheMutex);
+    if (m_cached.load(std::memory_order_relaxed) & CairoCached) return m_cairoPath;
+
+    // Copies are in user space, so they replay correctly under any transform
+    cairo_t *cr = scratchContext();
+    cairo_new_path(cr);
+    if (!m_points.isEmpty()) {
+        cairo_move_to(cr, m_points[0].x(), m_points[0].y());
+
+        for (int i = 1; i < m_points.size(); i += 3) {
+            if (i + 2 < m_points.size()) {
+                cairo_curve_to(cr,
+                               m_points[i].x(), m_points[i].y(),
+                               m_points[i + 1].x(), m_points[i + 1].y(),
+                               m_points[i + 2].x(), m_points[i + 2].y());
+            } else if (i + 1 < m_points.size()) {
+                QPointF current = m_points[i - 1];
+                QPointF control = m_points[i];
+                QPointF end = m_points[i + 1];
+
+                QPointF cp1 = current + (control - current) * (2.0 / 3.0);
+                QPointF cp2 = end + (control - end) * (2.0 / 3.0);
+
+                cairo_curve_to(cr, cp1.x(), cp1.y(), cp2.x(), cp2.y(), end.x(), end.y());
+            } else {
+                cairo_line_to(cr, m_points[i].x(), m_points[i].y());
+            }
+        }
+
+        if (m_closed) {
+            cairo_close_path(cr);
         }
     }
 
-    if (m_closed) {
-        path.closeSubpath();
+    cairo_path_t *copy = cairo_copy_path(cr);
+    cairo_new_path(cr);
+    if (copy && copy->status != CAIRO_STATUS_SUCCESS) {
+        cairo_path_destroy(copy);
+        copy = nullptr;
     }
 
-    // ✅ Calculate rotation center
-    QRectF bounds = path.boundingRect();
+    m_cairoPath = copy;
+    m_cached.fetch_or(CairoCached, std::memory_order_release);
+    return m_cairoPath;
+}
+#endif
+
+void Bezier::invalidateGeometry()
+{
+    // Only reached from mutators, which never overlap with readers
+    m_cached.store(0, std::memory_order_relaxed);
+    m_path = QPainterPath();
+    m_flattened.clear();
+#ifdef ENABLE_CAIRO
+    if (m_cairoPath) {
+        cairo_path_destroy(m_cairoPath);
+        m_cairoPath = nullptr;
+    }
+#endif
+}
+
+// ====================
+// QPainter Drawing
+// ====================
+void Bezier::draw(QPainter &painter)
+{
+    if (!isVisible() || m_points.isEmpty()) return;
+
+    const QPen &pen = getPen();
+    const QBrush &brush = getBrush();
+
+    const QPainterPath &path = this->path();
+
+    // ✅ Calculate rotation center: the control-point box's, as in asDrawn()
+    QRectF bounds = getBoundingRect();
     qreal centerX = bounds.center().x();
     qreal centerY = bounds.center().y();
 
@@ -75,36 +211,17 @@ void Bezier::draw(cairo_t *cr)
 {
     if (!isVisible() || m_points.isEmpty() || !cr) return;
 
-    QPen pen = getPen();
-    QBrush brush = getBrush();
+    const QPen &pen = getPen();
+    const QBrush &brush = getBrush();
+
+    const cairo_path_t *cached = cairoPath();
+    if (!cached) return;
 
     cairo_save(cr);
+    rotateContext(cr);
 
-    cairo_move_to(cr, m_points[0].x(), m_points[0].y());
-
-    for (int i = 1; i < m_points.size(); i += 3) {
-        if (i + 2 < m_points.size()) {
-            cairo_curve_to(cr,
-                           m_points[i].x(), m_points[i].y(),
-                           m_points[i + 1].x(), m_points[i + 1].y(),
-                           m_points[i + 2].x(), m_points[i + 2].y());
-        } else if (i + 1 < m_points.size()) {
-            QPointF current = m_points[i - 1];
-            QPointF control = m_points[i];
-            QPointF end = m_points[i + 1];
-
-            QPointF cp1 = current + (control - current) * (2.0 / 3.0);
-            QPointF cp2 = end + (control - end) * (2.0 / 3.0);
-
-            cairo_curve_to(cr, cp1.x(), cp1.y(), cp2.x(), cp2.y(), end.x(), end.y());
-        } else {
-            cairo_line_to(cr, m_points[i].x(), m_points[i].y());
-        }
-    }
-
-    if (m_closed) {
-        cairo_close_path(cr);
-    }
+    cairo_new_path(cr);
+    cairo_append_path(cr, cached);
 
     if (brush.style() != Qt::NoBrush && m_closed) {
         QColor fillColor = brush.color();
@@ -116,11 +233,23 @@ void Bezier::draw(cairo_t *cr)
         QColor strokeColor = pen.color();
         cairo_set_source_rgba(cr, strokeColor.redF(), strokeColor.greenF(), strokeColor.blueF(), strokeColor.alphaF());
         cairo_set_line_width(cr, pen.widthF());
-        cairo_stroke(cr);
+        cairo_stroke_preserve(cr);
     }
 
+    cairo_new_path(cr);
     cairo_restore(cr);
 }
+
+bool Bezier::buildPath(cairo_t *cr) const
+{
+    // An open curve with a brush is stroked but not filled
+    if (m_points.isEmpty() || (!m_closed && getBrush().style() != Qt::NoBrush)) return false;
+
+    const cairo_path_t *cached = cairoPath();
+    if (!cached) return false;
+    cairo_append_path(cr, cached);
+    return true;
+}
 #endif
 
 // ====================
@@ -129,25 +258,34 @@ void Bezier::draw(cairo_t *cr)
 bool Bezier::contains(const QPointF &point) const
 {
     if (m_points.isEmpty()) return false;
+    if (!path().controlPointRect().contains(point)) return false;
 
-    QPainterPath path;
-    path.moveTo(m_points[0]);
-
-    for (int i = 1; i < m_points.size(); i += 3) {
-        if (i + 2 < m_points.size()) {
-            path.cubicTo(m_points[i], m_points[i + 1], m_points[i + 2]);
-        } else if (i + 1 < m_points.size()) {
-            path.quadTo(m_points[i], m_points[i + 1]);
-        } else {
-            path.lineTo(m_points[i]);
-        }
-    }
+    // Same odd-even rule as QPainterPath::contains, on the cached polyline
+    return flattened().containsPoint(point, Qt::OddEvenFill);
+}
 
-    if (m_closed) {
-        path.closeSubpath();
+QPolygonF Bezier::getOutline() const
+{
+    return asDrawn(flattened());
+}
+
+void Bezier::getSnapPoints(std::vector<SnapPoint> &points) const
+{
+    if (m_points.isEmpty()) return;
+    Shape::getSnapPoints(points);
+
+    // On-curve points: P0 and the last point of every (c1, c2, p) triple
+    QPolygonF anchors;
+    anchors.reserve(m_points.size() / 3 + 1);
+    for (int i = 0; i < m_points.size(); i += 3) {
+        anchors << m_points[i];
     }
+    anchors = asDrawn(anchors);
 
-    return path.contains(point);
+    for (int i = 0; i < anchors.size(); ++i) {
+        const bool end = !m_closed && (i == 0 || i == anchors.size() - 1);
+        points.push_back({ anchors[i], end ? SnapPoint::Endpoint : SnapPoint::Anchor });
+    }
 }
 
 // ====================
@@ -156,58 +294,121 @@ bool Bezier::contains(const QPointF &point) const
 Bezier* Bezier::clone() const
 {
     Bezier *clone = new Bezier();
-    clone->setPen(getPen());
-    clone->setBrush(getBrush());
+    clone->setStyle(getStyle());
     clone->setVisible(isVisible());
     clone->m_points = m_points;
     clone->m_closed = m_closed;
+    clone->updateBounds();
     return clone;
 }
 
 // ====================
-// Point Management
+// Transformations
 // ====================
-void Bezier::addPoint(const QPointF &point)
+void Bezier::move(const QPointF &offset)
 {
-    m_points.append(point);
+    for (QPointF &p : m_points) {
+        p += offset;
+    }
+    m_minPoint += offset;
+    m_maxPoint += offset;
+    invalidateGeometry();
+    Shape::move(offset);
+}
 
-    if (m_points.size() == 1) {
-        setPosition(point);
-        setSize(QSizeF(0, 0));
-    } else {
-        QPointF minPoint = m_points[0];
-        QPointF maxPoint = m_points[0];
+void Bezier::gatherPoints(std::vector<QPointF> &points) const
+{
+    points.insert(points.end(), m_points.cbegin(), m_points.cend());
+}
+
+void Bezier::scatterPoints(const QPointF *points, const AffineKernel::Parts &parts)
+{
+    Q_UNUSED(parts)
+    if (m_points.isEmpty()) return;
+
+    std::copy(points, points + m_points.size(), m_points.begin());
+    AffineKernel::bounds(m_points.constData(), size_t(m_points.size()), m_minPoint, m_maxPoint);
+    storeBounds();
+    invalidateGeometry();
+}
 
+void Bezier::scale(double factor)
+{
+    QPointF center = getBoundingRect().center();
+    for (QPointF &p : m_points) {
+        p = center + (p - center) * factor;
+    }
+    updateBounds();
+}
+
+void Bezier::updateBounds()
+{
+    if (!m_points.isEmpty()) {
+        m_minPoint = m_maxPoint = m_points[0];
         for (const QPointF &p : m_points) {
-            minPoint.setX(qMin(minPoint.x(), p.x()));
-            minPoint.setY(qMin(minPoint.y(), p.y()));
-            maxPoint.setX(qMax(maxPoint.x(), p.x()));
-            maxPoint.setY(qMax(maxPoint.y(), p.y()));
+            extendBounds(p);
         }
-
-        setPosition(minPoint);
-        setSize(QSizeF(maxPoint.x() - minPoint.x(), maxPoint.y() - minPoint.y()));
     }
+    storeBounds();
+    invalidateGeometry();
+    geometryChanged();
 }
 
-void Bezier::setPoint(int index, const QPointF &point)
+void Bezier::extendBounds(const QPointF &point)
 {
-    if (index >= 0 && index < m_points.size()) {
-        m_points[index] = point;
+    m_minPoint.setX(qMin(m_minPoint.x(), point.x()));
+    m_minPoint.setY(qMin(m_minPoint.y(), point.y()));
+    m_maxPoint.setX(qMax(m_maxPoint.x(), point.x()));
+    m_maxPoint.setY(qMax(m_maxPoint.y(), point.y()));
+}
 
-        QPointF minPoint = m_points[0];
-        QPointF maxPoint = m_points[0];
+void Bezier::storeBounds()
+{
+    if (m_points.isEmpty()) {
+        m_position = QPointF();
+        m_size = QSizeF();
+    } else {
+        m_position = m_minPoint;
+        m_size = QSizeF(m_maxPoint.x() - m_minPoint.x(), m_maxPoint.y() - m_minPoint.y());
+    }
+}
 
-        for (const QPointF &p : m_points) {
-            minPoint.setX(qMin(minPoint.x(), p.x()));
-            minPoint.setY(qMin(minPoint.y(), p.y()));
-            maxPoint.setX(qMax(maxPoint.x(), p.x()));
-            maxPoint.setY(qMax(maxPoint.y(), p.y()));
-        }
+// ====================
+// Point Management
+// ====================
+void Bezier::addPoint(const QPointF &point)
+{
+    // Appending can only grow the box
+    if (m_points.isEmpty()) {
+        m_minPoint = m_maxPoint = point;
+    } else {
+        extendBounds(point);
+    }
+    m_points.append(point);
 
-        setPosition(minPoint);
-        setSize(QSizeF(maxPoint.x() - minPoint.x(), maxPoint.y() - minPoint.y()));
+    storeBounds();
+    invalidateGeometry();
+    geometryChanged();
+}
+
+void Bezier::setPoint(int index, const QPointF &point)
+{
+    if (index < 0 || index >= m_points.size()) return;
+
+    // Only moving a point that defines an edge inwards needs a rescan
+    const QPointF old = m_points[index];
+    m_points[index] = point;
+    const bool onEdge = old.x() == m_minPoint.x() || old.x() == m_maxPoint.x()
+                     || old.y() == m_minPoint.y() || old.y() == m_maxPoint.y();
+    if (onEdge) {
+        updateBounds();
+        return;
     }
+
+    extendBounds(point);
+    storeBounds();
+    invalidateGeometry();
+    geometryChanged();
 }
 
 QPointF Bezier::getPoint(int index) const
@@ -218,15 +419,29 @@ QPointF Bezier::getPoint(int index) const
     return QPointF();
 }
 
+void Bezier::setPoints(const QVector<QPointF> &points)
+{
+    m_points = points;
+    updateBounds();
+}
+
 QList<QPointF> Bezier::getPoints() const { return m_points.toList(); }
 int Bezier::getPointCount() const { return m_points.size(); }
 
 void Bezier::clearPoints()
 {
     m_points.clear();
-    setPosition(QPointF());
-    setSize(QSizeF());
+    m_position = QPointF();
+    m_size = QSizeF();
+    invalidateGeometry();
+    geometryChanged();
+}
+
+void Bezier::setClosed(bool closed)
+{
+    if (closed == m_closed) return;
+    m_closed = closed;
+    invalidateGeometry();
 }
 
-void Bezier::setClosed(bool closed) { m_closed = closed; }
 bool Bezier::isClosed() const { return m_closed; }
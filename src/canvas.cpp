@@ -7,6 +7,7 @@
 #include "bezier.h"
 #include "svg_parser.h"
 #include "text.h"
+#include "threadpool.h"
 
 #include <QPainterPath>
 #include <QMouseEvent>
@@ -20,6 +21,22 @@
 #include <QSvgGenerator>
 #include <QDebug>
 #include <cmath>
+#include <vector>
+
+namespace {
+
+// Largest deviation of a fitted Pen stroke from the pointer path, in
+// screen pixels
+constexpr double PenTolerance = 2.0;
+
+// Members of a multi-selection that get their own outline; past this the
+// outlines would only hide the drawing, and the overall box is enough
+constexpr int MaxSelectionOutlines = 1000;
+
+// Reach of object snapping, in screen pixels
+constexpr double SnapRadius = 8.0;
+
+} // namespace
 
 Canvas::Canvas(QWidget *parent)
     : QWidget(parent)
@@ -31,10 +48,6 @@ Canvas::Canvas(QWidget *parent)
     , m_isSelecting(false)
     , m_isDrawing(false)
     , m_currentShape(nullptr)
-#ifdef ENABLE_CAIRO
-    , m_cairoSurface(nullptr)
-    , m_cairoContext(nullptr)
-#endif
     , m_showGrid(true)
     , m_gridSize(20)
     , m_snapToGrid(false)
@@ -50,24 +63,57 @@ Canvas::Canvas(QWidget *parent)
     QPalette pal = palette();
     pal.setColor(QPalette::Window, Qt::white);
     setPalette(pal);
-
-#ifdef ENABLE_CAIRO
-    createCairoSurface();
-#endif
 }
 
 Canvas::~Canvas()
 {
-#ifdef ENABLE_CAIRO
-    if (m_cairoContext) cairo_destroy(m_cairoContext);
-    if (m_cairoSurface) cairo_surface_destroy(m_cairoSurface);
-#endif
 }
 
 void Canvas::setDocument(Document *document)
 {
+    endGesture();
+    if (m_document) disconnect(m_document, nullptr, this, nullptr);
     m_document = document;
-    update();
+    m_selection.clear();
+    m_selectedShape = nullptr;
+
+    if (m_document) {
+        // Shapes added/removed outside the canvas (undo, import) only dirty
+        // the area of the change set; layer changes can affect everything.
+        connect(m_document, &Document::changed, this, [this](const ChangeSet &changes) {
+            if (!changes.removed.isEmpty() || !changes.modified.isEmpty()) {
+                // Removed shapes have left their layer; modified ones may
+                // have moved away from the selection box
+                QList<Shape*> kept;
+                for (Shape *shape : m_selection) {
+                    if (shape->getLayer()) kept.append(shape);
+                }
+                if (kept.size() != m_selection.size() || !changes.modified.isEmpty()) setSelection(kept);
+            }
+            updateWorldRect(changes.bounds);
+        });
+        connect(m_document, &Document::layerAdded, this, [this]() { updateAll(); });
+        connect(m_document, &Document::layerRemoved, this, [this](Layer *layer) {
+            // The layer is deleted with its shapes right after this
+            QList<Shape*> kept;
+            for (Shape *shape : m_selection) {
+                if (shape->getLayer() != layer) kept.append(shape);
+            }
+            if (kept.size() != m_selection.size()) setSelection(kept);
+            updateAll();
+        });
+        connect(m_document, &Document::documentReset, this, [this]() {
+            // The shapes are gone already: forget them without touching them
+            m_inGesture = false;
+            m_isDragging = false;
+            m_isRotating = false;
+            m_selection.clear();
+            m_selectionBounds = QRectF();
+            m_selectedShape = nullptr;
+            updateAll();
+        });
+    }
+    updateAll();
 }
 
 Document* Canvas::getDocument() const
@@ -125,7 +171,6 @@ void Canvas::zoomOut()
 
 void Canvas::paintEvent(QPaintEvent *event)
 {
-    Q_UNUSED(event)
     QPainter painter(this);
     painter.setRenderHint(QPainter::Antialiasing);
 
@@ -133,15 +178,17 @@ void Canvas::paintEvent(QPaintEvent *event)
     if (m_showGrid) drawGrid(painter);
 
 	#ifdef ENABLE_CAIRO
-    drawWithCairo(painter);
+    drawWithCairo(painter, event->region());
 	#else
     if (m_document) {
         painter.save();
         painter.translate(m_panOffset * m_zoom);
         painter.scale(m_zoom, m_zoom);
-        const QList<Shape*> shapes = m_document->getShapes();
+        // Qt already clips the painter to event->region(); only shapes that
+        // reach into its bounding rect need to be drawn at all.
+        const QList<Shape*> shapes = collectVisibleShapes(screenToWorldRect(event->rect()));
         for (Shape *shape : shapes) {
-            if (shape) shape->draw(painter);
+            shape->draw(painter);
         }
         painter.restore();
     }
@@ -157,6 +204,20 @@ void Canvas::paintEvent(QPaintEvent *event)
     }
 
     if (m_selectedShape) drawSelectionHandles(painter);
+    if (m_isSelecting) drawSelectionBand(painter);
+
+    if (m_hasSnapTarget) {
+        // Squares for box corners and edges, circles for points on the geometry
+        QPen pen(QColor(255, 120, 0), 2);
+        painter.setPen(pen);
+        painter.setBrush(Qt::NoBrush);
+        const QRectF marker = QRectF(snapMarkerRect()).adjusted(2, 2, -2, -2);
+        if (m_snapTarget.kind == SnapPoint::Corner || m_snapTarget.kind == SnapPoint::Edge) {
+            painter.drawRect(marker);
+        } else {
+            painter.drawEllipse(marker);
+        }
+    }
 
     if (m_currentTool == Tool_Bezier && !m_bezierPoints.isEmpty()) {
         painter.setPen(QPen(Qt::blue, 2));
@@ -184,7 +245,7 @@ void Canvas::mousePressEvent(QMouseEvent *event)
 
 	if (m_selectedShape) {
     	m_rotationStart = screenToWorld(event->pos());
-    	QPointF center = m_selectedShape->getBoundingRect().center();
+    	QPointF center = selectionCenter();
     	QPointF delta = m_rotationStart - center;
     	m_lastRotationAngle = std::atan2(delta.y(), delta.x()) * 180.0 / M_PI;
 	}
@@ -192,10 +253,11 @@ void Canvas::mousePressEvent(QMouseEvent *event)
 
 	if (event->modifiers() & Qt::AltModifier && m_selectedShape) {
     	m_isRotating = true;
+    	beginGesture();
     	m_rotationStart = screenToWorld(event->pos());
 
     	// Calculate initial angle from center to mouse
-    	QPointF center = m_selectedShape->getBoundingRect().center();
+    	QPointF center = selectionCenter();
     	QPointF delta = m_rotationStart - center;
     	m_lastRotationAngle = std::atan2(delta.y(), delta.x()) * 180.0 / M_PI;
 
@@ -219,30 +281,49 @@ void Canvas::mousePressEvent(QMouseEvent *event)
 
 void Canvas::mouseMoveEvent(QMouseEvent *event)
 {
-    QPointF worldPos = screenToWorld(event->pos());
-    if (m_snapToGrid) worldPos = snapToGrid(worldPos);
+    if (m_isSelecting) {
+        const QPointF current = screenToWorld(event->pos());
+        QRectF dirty;
+        if (m_lassoSelect) {
+            // The new segment and the closing edge back to the start
+            dirty = QPolygonF({ m_selectionStart, m_lasso.last(), current }).boundingRect();
+            m_lasso << current;
+        } else {
+            dirty = selectionBand();
+            m_selectionCurrent = current;
+            dirty = dirty.united(selectionBand());
+        }
+        // Overlay only: the tiles underneath stay valid
+        update(worldToScreenRect(dirty));
+        return;
+    }
+
+    QPointF worldPos = snap(screenToWorld(event->pos()));
 
 	if (m_isRotating && m_selectedShape) {
     	QPointF current = screenToWorld(event->pos());
 
     	// Calculate angle from center to current mouse position
-    	QPointF center = m_selectedShape->getBoundingRect().center();
+    	QPointF center = selectionCenter();
     	QPointF delta = current - center;
     	double currentAngle = std::atan2(delta.y(), delta.x()) * 180.0 / M_PI;
 
     	// Compute rotation delta and apply it
     	double deltaAngle = currentAngle - m_lastRotationAngle;
-    	m_selectedShape->rotate(deltaAngle);
+    	rotateSelection(deltaAngle);
 
     	// Update for next frame
     	m_lastRotationAngle = currentAngle;
-    	update();
     	return;
 	}
 
-	if (m_selectedShape && !m_isDrawing && !m_isDragging) {
+	// Turning around the selection with a button held (and no drag or
+	// drawing under way) rotates it too; plain hovering never edits.
+	// Past the threshold this becomes a rotate gesture, so the rest of the
+	// motion takes the branch above and release closes one history entry.
+	if (m_selectedShape && !m_isDrawing && !m_isDragging && event->buttons() != Qt::NoButton) {
     	QPointF current = screenToWorld(event->pos());
-    	QPointF center = m_selectedShape->getBoundingRect().center();
+    	QPointF center = selectionCenter();
 
     double currentAngle = std::atan2(current.y() - center.y(),
                                      current.x() - center.x()) * 180.0 / M_PI;
@@ -250,9 +331,10 @@ void Canvas::mouseMoveEvent(QMouseEvent *event)
     double deltaAngle = currentAngle - m_lastRotationAngle;
 
     if (std::abs(deltaAngle) > 2.0) { // ignore tiny movement
-        m_selectedShape->rotate(deltaAngle);
+        m_isRotating = true;
+        beginGesture();
+        rotateSelection(deltaAngle);
         m_lastRotationAngle = currentAngle;
-        update();
         return;
     	}
 	}
@@ -262,14 +344,14 @@ void Canvas::mouseMoveEvent(QMouseEvent *event)
 	// ✅ Move selected shape if dragging
 	if (m_isDragging && m_selectedShape) {
     	QPointF offset = worldPos - m_lastMousePos;
-    	m_selectedShape->move(offset);
+    	moveSelection(offset);
     	m_lastMousePos = worldPos;
-    	update();
     	return;
 	}
 
     if (m_isDrawing && m_currentShape) {
         m_drawCurrent = worldPos;
+        QRectF oldBounds = m_currentShape->getIndexBounds();
 
         if (m_currentTool == Tool_Rectangle || m_currentTool == Tool_Ellipse) {
             QSizeF size(qAbs(m_drawCurrent.x() - m_drawStart.x()),
@@ -286,28 +368,40 @@ void Canvas::mouseMoveEvent(QMouseEvent *event)
         }
 		else if (m_currentTool == Tool_Pen) {
     		if (auto bezier = dynamic_cast<Bezier*>(m_currentShape)) {
-        	bezier->addPoint(screenToWorld(event->pos()));
+        	if (m_strokeFitter.addSample(worldPos)) {
+        		bezier->setPoints(m_strokeFitter.points());
+        	}
     		}
 		}
-		update();
+		updateOverlay(oldBounds);
+		updateOverlay(m_currentShape->getIndexBounds());
     }
 }
 
 void Canvas::mouseReleaseEvent(QMouseEvent *event)
 {
+    if (m_isSelecting) {
+        finishRegionSelection();
+        return;
+    }
+
 	if (m_isRotating) {
     	m_isRotating = false;
+    	endGesture();
     	return;
 	}
 
 	if (m_isDragging) {
     	m_isDragging = false;
+    	endGesture();
     	return;
 	}
 
     Q_UNUSED(event)
     if (m_isDrawing && m_currentShape) {
         m_isDrawing = false;
+        // Adding it dirties the tiles through the document's change set
+        updateOverlay(m_currentShape->getIndexBounds());
         if (m_document) {
             m_document->addShape(m_currentShape);
             emit shapeCreated(m_currentShape);
@@ -315,7 +409,6 @@ void Canvas::mouseReleaseEvent(QMouseEvent *event)
             delete m_currentShape;
         }
         m_currentShape = nullptr;
-        update();
     }
 }
 
@@ -324,10 +417,12 @@ void Canvas::keyPressEvent(QKeyEvent *event)
     switch (event->key()) {
         case Qt::Key_Delete:
         case Qt::Key_Backspace:
-            if (m_selectedShape && m_document) {
-                m_document->removeShape(m_selectedShape);
-                m_selectedShape = nullptr;
-                update();
+            removeSelection();
+            break;
+
+        case Qt::Key_A:
+            if (event->modifiers() & Qt::ControlModifier) {
+                selectAll();
             }
             break;
 
@@ -371,8 +466,7 @@ void Canvas::wheelEvent(QWheelEvent *event)
         if (m_selectedShape) {
             double scaleFactor = event->angleDelta().y() > 0 ? 1.1 : 0.9;
             qDebug() << "Scaling shape: " << m_selectedShape;
-            m_selectedShape->scale(scaleFactor);
-            update();
+            scaleSelection(scaleFactor);
         } else {
             qDebug() << "No shape selected for scaling.";
         }
@@ -381,8 +475,7 @@ void Canvas::wheelEvent(QWheelEvent *event)
         if (m_selectedShape) {
             double angleDelta = event->angleDelta().y() > 0 ? 5.0 : -5.0;
             qDebug() << "Rotating shape: " << m_selectedShape;
-            m_selectedShape->rotate(angleDelta);
-            update();
+            rotateSelection(angleDelta);
         } else {
             qDebug() << "No shape selected for rotation.";
         }
@@ -414,46 +507,149 @@ void Canvas::drawGrid(QPainter &painter)
 }
 
 #ifdef ENABLE_CAIRO
-void Canvas::drawWithCairo(QPainter &painter)
+void Canvas::drawWithCairo(QPainter &painter, const QRegion &dirty)
 {
-    if (!m_document) return;
+    m_renderStats = RenderStats();
 
-    cairo_save(m_cairoContext);
-    cairo_set_source_rgb(m_cairoContext, 1.0, 1.0, 1.0);
-    cairo_paint(m_cairoContext);
+    Layer *layer = m_document ? m_document->getActiveLayer() : nullptr;
+    if (!layer || !layer->isVisible()) return;
+    if (layer != m_tileLayer) {
+        m_tileCache.clear();
+        m_tileLayer = layer;
+    }
 
-    cairo_translate(m_cairoContext, m_panOffset.x(), m_panOffset.y());
-    cairo_scale(m_cairoContext, m_zoom, m_zoom);
+    // Tiles live in unpanned device space (world * zoom); the pan offset only
+    // decides where they are blitted, so scrolling reuses every cached tile
+    // and rasterises just the newly exposed ones.
+    const QPoint origin = (m_panOffset * m_zoom).toPoint();
+    const QRect tiles = TileCache::tilesCovering(dirty.boundingRect().translated(-origin));
+    const int layerSize = layer->getShapes().size();
+
+    std::vector<TileJob> jobs;
+
+    for (int ty = tiles.top(); ty <= tiles.bottom(); ++ty) {
+        for (int tx = tiles.left(); tx <= tiles.right(); ++tx) {
+            const QRect target = TileCache::tileDeviceRect(tx, ty).translated(origin);
+            if (!dirty.intersects(target)) continue;
+
+            QImage *tile = m_tileCache.tile(m_zoom, tx, ty);
+            if (tile) {
+                ++m_renderStats.tilesReused;
+                painter.drawImage(target.topLeft(), *tile);
+                continue;
+            }
+
+            TileJob job{ tx, ty, layer->getShapesIn(TileCache::tileWorldRect(m_zoom, tx, ty)), QImage(), {}, {} };
+            m_renderStats.drawn += job.shapes.size();
+            m_renderStats.culled += layerSize - job.shapes.size();
+            jobs.push_back(std::move(job));
+        }
+    }
+    if (jobs.empty()) return;
+    m_renderStats.tilesRendered = static_cast<int>(jobs.size());
+
+    // Rasterise the missing tiles, each into its own surface and cairo_t.
+    // The GUI thread is parked in parallelFor meanwhile, so nothing can
+    // mutate the shapes: the per-tile lists are a read-only snapshot.
+    const double zoom = m_zoom;
+    const LodPolicy &lod = m_lodPolicy;
+    const bool batching = m_batchedRendering;
+    auto render = [&jobs, &lod, batching, zoom](int i) {
+        renderTile(jobs[i], lod, batching, zoom);
+    };
+    if (m_parallelRendering && jobs.size() > 1) {
+        ThreadPool::globalInstance().parallelFor(static_cast<int>(jobs.size()), render);
+    } else {
+        for (int i = 0; i < static_cast<int>(jobs.size()); ++i) render(i);
+    }
 
-    const QList<Shape*> shapes = m_document->getShapes();
-    for (Shape *shape : shapes) {
-        if (shape) shape->draw(m_cairoContext);
+    // Composite on the GUI thread
+    for (const TileJob &job : jobs) {
+        m_renderStats.simplified += job.lod.reduced + job.lod.skipped;
+        m_renderStats.batches += job.batch.batches;
+        m_renderStats.stateChanges += job.batch.stateChanges;
+        m_tileCache.insert(m_zoom, job.tx, job.ty, job.image);
+        painter.drawImage(TileCache::tileDeviceRect(job.tx, job.ty).translated(origin).topLeft(),
+                          job.image);
     }
+}
 
-    cairo_restore(m_cairoContext);
+void Canvas::renderTile(TileJob &job, const LodPolicy &lod, bool batching, double zoom)
+{
+    QImage image(TileCache::TileSize, TileCache::TileSize, QImage::Format_ARGB32_Premultiplied);
+    image.fill(Qt::white);
+
+    // Cairo draws straight into the QImage's pixels (same premultiplied layout)
+    cairo_surface_t *surface = cairo_image_surface_create_for_data(
+        image.bits(), CAIRO_FORMAT_ARGB32, image.width(), image.height(), image.bytesPerLine());
+    cairo_t *cr = cairo_create(surface);
+
+    cairo_translate(cr, -job.tx * TileCache::TileSize, -job.ty * TileCache::TileSize);
+    cairo_scale(cr, zoom, zoom);
+    {
+        BatchRenderer renderer(cr, batching);
+        job.lod = lod.draw(renderer, job.shapes, zoom);
+        renderer.flush();
+        job.batch = renderer.stats();
+    }
 
-    QImage image(cairo_image_surface_get_data(m_cairoSurface),
-                 cairo_image_surface_get_width(m_cairoSurface),
-                 cairo_image_surface_get_height(m_cairoSurface),
-                 QImage::Format_ARGB32_Premultiplied);
-    painter.drawImage(0, 0, image);
+    cairo_destroy(cr);
+    cairo_surface_destroy(surface);
+    job.image = image;
 }
 #endif
 
 void Canvas::drawSelectionHandles(QPainter &painter)
 {
-    if (!m_selectedShape) return;
-
-    QRectF bounds = m_selectedShape->getBoundingRect();
-    QPointF center = bounds.center();
+    if (m_selection.isEmpty()) return;
 
     painter.save();
-    painter.translate(center);
-    painter.rotate(m_selectedShape->getRotation());
-    painter.translate(-center);
+    painter.translate(m_panOffset * m_zoom);
+    painter.scale(m_zoom, m_zoom);
+
+    QPen pen(Qt::blue, 1, Qt::DashLine);
+    pen.setCosmetic(true);          // Stays 1px at any zoom
+    painter.setPen(pen);
+
+    // The most recently selected shapes get their own (rotated) outline
+    const int first = qMax(0, m_selection.size() - MaxSelectionOutlines);
+    for (int i = first; i < m_selection.size(); ++i) {
+        const Shape *shape = m_selection[i];
+        QRectF bounds = shape->getBoundingRect();
+        QPointF center = bounds.center();
+
+        painter.save();
+        painter.translate(center);
+        painter.rotate(shape->getRotation());
+        painter.translate(-center);
+        painter.drawRect(bounds);
+        painter.restore();
+    }
+
+    if (m_selection.size() > 1) {
+        pen.setStyle(Qt::SolidLine);
+        painter.setPen(pen);
+        painter.drawRect(m_selectionBounds);
+    }
+
+    painter.restore();
+}
 
-    painter.setPen(QPen(Qt::blue, 1, Qt::DashLine));
-    painter.drawRect(bounds);
+void Canvas::drawSelectionBand(QPainter &painter)
+{
+    painter.save();
+    painter.translate(m_panOffset * m_zoom);
+    painter.scale(m_zoom, m_zoom);
+
+    QPen pen(QColor(0, 120, 215), 1, Qt::DashLine);
+    pen.setCosmetic(true);
+    painter.setPen(pen);
+    painter.setBrush(QColor(0, 120, 215, 40));
+    if (m_lassoSelect) {
+        painter.drawPolygon(m_lasso);
+    } else {
+        painter.drawRect(selectionBand());
+    }
 
     painter.restore();
 }
@@ -468,14 +664,99 @@ QPointF Canvas::worldToScreen(const QPointF &worldPos) const
     return (worldPos + m_panOffset) * m_zoom;
 }
 
+QRect Canvas::worldToScreenRect(const QRectF &worldRect) const
+{
+    QRectF screenRect(worldToScreen(worldRect.topLeft()),
+                      worldToScreen(worldRect.bottomRight()));
+    // Pad for antialiasing and cosmetic (1px) outlines
+    return screenRect.normalized().adjusted(-2, -2, 2, 2).toAlignedRect();
+}
+
+QRectF Canvas::screenToWorldRect(const QRect &screenRect) const
+{
+    return QRectF(screenToWorld(screenRect.topLeft()),
+                  screenToWorld(screenRect.bottomRight() + QPoint(1, 1))).normalized();
+}
+
+void Canvas::updateWorldRect(const QRectF &worldRect)
+{
+#ifdef ENABLE_CAIRO
+    m_tileCache.invalidate(worldRect);
+#endif
+    updateOverlay(worldRect);
+}
+
+void Canvas::updateOverlay(const QRectF &worldRect)
+{
+    QRect dirty = worldToScreenRect(worldRect) & rect();
+    if (!dirty.isEmpty()) update(dirty);
+}
+
+void Canvas::updateShape(const QRectF &oldBounds, const Shape *shape)
+{
+    // Two rects rather than their union: Qt merges them into one region,
+    // and a long jump does not drag everything in between along.
+    updateWorldRect(oldBounds);
+    if (shape) updateWorldRect(shape->getIndexBounds());
+}
+
+void Canvas::updateAll()
+{
+#ifdef ENABLE_CAIRO
+    m_tileCache.clear();
+#endif
+    update();
+}
+
+QList<Shape*> Canvas::collectVisibleShapes(const QRectF &worldRect)
+{
+    m_renderStats = RenderStats();
+
+    Layer *layer = m_document ? m_document->getActiveLayer() : nullptr;
+    if (!layer || !layer->isVisible()) return QList<Shape*>();
+
+    // Index bounds already cover rotation and stroke, so anything the
+    // layer rejects cannot put a pixel inside the viewport. Zoomed out,
+    // the layer answers from its bounds columns rather than the R-tree.
+    QList<Shape*> shapes = layer->getShapesIn(worldRect);
+    m_renderStats.drawn = shapes.size();
+    m_renderStats.culled = layer->getShapes().size() - shapes.size();
+    return shapes;
+}
+
 void Canvas::handleSelectTool(QMouseEvent *event)
 {
 	if (event->button() == Qt::LeftButton) {
     	QPointF pos = screenToWorld(event->pos());
-    	selectShapeAt(pos);
+    	Layer *layer = m_document ? m_document->getActiveLayer() : nullptr;
+    	Shape *hit = (layer && layer->isVisible()) ? layer->getShapeAt(pos) : nullptr;
+
+    	// Dragging from empty canvas selects a region: a rubber band, or a
+    	// lasso with Ctrl held. Shift keeps the current selection.
+    	if (!hit) {
+        	m_isSelecting = true;
+        	m_lassoSelect = event->modifiers() & Qt::ControlModifier;
+        	m_addToSelection = event->modifiers() & Qt::ShiftModifier;
+        	m_selectionStart = m_selectionCurrent = pos;
+        	m_lasso = QPolygonF({ pos });
+        	if (!m_addToSelection) clearSelection();
+        	return;
+    	}
+
+    	// Shift+click adds a shape to the selection or takes it out
+    	if (event->modifiers() & Qt::ShiftModifier) {
+        	QList<Shape*> selection = m_selection;
+        	if (!selection.removeOne(hit)) selection.append(hit);
+        	selectShapes(selection);
+        	return;
+    	}
+
+    	// Pressing on a member of the selection drags all of it
+    	if (!hit->isSelected()) selectShapeAt(pos);
     	if (m_selectedShape) {
         	m_isDragging = true;
-        	m_lastMousePos = pos;
+        	m_lastMousePos = snap(pos);
+        	beginGesture();
     	}
 	}
 }
@@ -484,7 +765,7 @@ void Canvas::handleRectangleTool(QMouseEvent *event)
 {
     if (event->button() == Qt::LeftButton) {
         m_isDrawing = true;
-        m_drawStart = screenToWorld(event->pos());
+        m_drawStart = snap(screenToWorld(event->pos()));
 		m_currentShape = new Rectangle();
 		m_currentShape->setPosition(m_drawStart);
 		m_currentShape->setSize(QSizeF(0, 0));
@@ -498,7 +779,7 @@ void Canvas::handleEllipseTool(QMouseEvent *event)
 {
     if (event->button() == Qt::LeftButton) {
         m_isDrawing = true;
-        m_drawStart = screenToWorld(event->pos());
+        m_drawStart = snap(screenToWorld(event->pos()));
 		m_currentShape = new Ellipse();
 		m_currentShape->setPosition(m_drawStart);
 		m_currentShape->setSize(QSizeF(0, 0));
@@ -512,7 +793,7 @@ void Canvas::handleLineTool(QMouseEvent *event)
 {
     if (event->button() == Qt::LeftButton) {
         m_isDrawing = true;
-        m_drawStart = screenToWorld(event->pos());
+        m_drawStart = snap(screenToWorld(event->pos()));
 		auto *line = new Line();
 		line->setStartPoint(m_drawStart);
 		line->setEndPoint(m_drawStart);
@@ -525,7 +806,7 @@ void Canvas::handleLineTool(QMouseEvent *event)
 void Canvas::handleBezierTool(QMouseEvent *event)
 {
     if (event->button() == Qt::LeftButton) {
-        m_bezierPoints.append(screenToWorld(event->pos()));
+        m_bezierPoints.append(snap(screenToWorld(event->pos())));
     }
 }
 
@@ -533,7 +814,12 @@ void Canvas::handlePenTool(QMouseEvent *event)
 {
     if (event->button() == Qt::LeftButton) {
         m_isDrawing = true;
-        m_drawStart = screenToWorld(event->pos());
+        m_drawStart = snap(screenToWorld(event->pos()));
+
+        // Samples are fitted with cubics as they arrive, so the stroke
+        // keeps a few control points instead of one per mouse event
+        m_strokeFitter.setTolerance(PenTolerance / m_zoom);
+        m_strokeFitter.begin(m_drawStart);
 
         auto* bezier = new Bezier();  // Reuse Bezier for now
         bezier->addPoint(m_drawStart);
@@ -547,7 +833,7 @@ void Canvas::handleTextTool(QMouseEvent *event)
 {
     if (event->button() == Qt::LeftButton) {
         // 🔹 Get world position for where to place the text
-        QPointF position = screenToWorld(event->pos());
+        QPointF position = snap(screenToWorld(event->pos()));
 
         // 🔹 Show text input dialog
         bool ok;
@@ -578,25 +864,256 @@ void Canvas::selectShapeAt(const QPointF &point)
 {
     if (!m_document) return;
 
-    const QList<Shape*> shapes = m_document->getShapes();
-    for (int i = shapes.size() - 1; i >= 0; --i) {
-        Shape* shape = shapes[i];
-        if (shape->contains((point - m_panOffset) / m_zoom)) {
-            m_selectedShape = shape;
-            emit shapeSelected(m_selectedShape);
-            qDebug() << "Selected shape: " << m_selectedShape;
-            return;
-        }
+    // Only the active layer is drawn and editable; point is already in world space
+    Layer *layer = m_document->getActiveLayer();
+    Shape *shape = (layer && layer->isVisible()) ? layer->getShapeAt(point) : nullptr;
+    if (shape) {
+        setSelection(QList<Shape*>() << shape);
+        emit shapeSelected(m_selectedShape);
+        qDebug() << "Selected shape: " << m_selectedShape;
+        return;
     }
 
-    m_selectedShape = nullptr;
+    clearSelection();
     qDebug() << "No shape selected.";
 }
 
 
 void Canvas::clearSelection()
 {
-    m_selectedShape = nullptr;
+    setSelection(QList<Shape*>());
+}
+
+void Canvas::setSelection(const QList<Shape*> &shapes)
+{
+    for (Shape *shape : m_selection) shape->setSelected(false);
+
+    m_selection = shapes;
+    m_selectionBounds = QRectF();
+    for (Shape *shape : m_selection) {
+        shape->setSelected(true);
+        m_selectionBounds = m_selectionBounds.united(shape->getIndexBounds());
+    }
+    m_selectedShape = m_selection.isEmpty() ? nullptr : m_selection.last();
+    update();
+}
+
+void Canvas::selectShapes(const QList<Shape*> &shapes)
+{
+    setSelection(shapes);
+    if (m_selectedShape) emit shapeSelected(m_selectedShape);
+}
+
+void Canvas::selectAll()
+{
+    Layer *layer = m_document ? m_document->getActiveLayer() : nullptr;
+    if (!layer || !layer->isVisible()) return;
+    selectShapes(layer->getShapes());
+}
+
+void Canvas::removeSelection()
+{
+    if (m_selection.isEmpty() || !m_document) return;
+
+    const QList<Shape*> shapes = m_selection;
+    clearSelection();
+    m_document->removeShapes(shapes);
+}
+
+void Canvas::transformSelection(const QTransform &transform)
+{
+    Layer *layer = m_document ? m_document->getActiveLayer() : nullptr;
+    if (!layer || m_selection.isEmpty()) return;
+
+    // One pass over all selected geometry, then one repaint: the area the
+    // selection left and the area it covers now
+    QRectF oldBounds;
+    beginEdit(m_selection);
+    layer->transformShapes(m_selection, transform, &oldBounds, &m_selectionBounds);
+    endEdit();
+    updateWorldRect(oldBounds);
+    updateWorldRect(m_selectionBounds);
+}
+
+void Canvas::bringToFront()
+{
+    restackSelection(&Layer::bringToFront);
+}
+
+void Canvas::bringForward()
+{
+    restackSelection(&Layer::bringForward);
+}
+
+void Canvas::sendBackward()
+{
+    restackSelection(&Layer::sendBackward);
+}
+
+void Canvas::sendToBack()
+{
+    restackSelection(&Layer::sendToBack);
+}
+
+void Canvas::restackSelection(void (Layer::*restack)(const QList<Shape*> &))
+{
+    Layer *layer = m_document ? m_document->getActiveLayer() : nullptr;
+    if (!layer || m_selection.isEmpty()) return;
+
+    (layer->*restack)(m_selection);
+
+    // Nothing moved; only what overlaps the selection can look different
+    QRectF dirty;
+    for (const Shape *shape : m_selection) {
+        dirty = dirty.united(shape->getIndexBounds());
+    }
+    updateWorldRect(dirty);
+    emit canvasChanged();
+}
+
+void Canvas::moveSelection(const QPointF &offset)
+{
+    if (m_selection.size() > 1) {
+        transformSelection(QTransform::fromTranslate(offset.x(), offset.y()));
+        return;
+    }
+    if (!m_selectedShape) return;
+    QRectF oldBounds = m_selectedShape->getIndexBounds();
+    beginEdit({ m_selectedShape });
+    m_selectedShape->move(offset);
+    endEdit();
+    updateShape(oldBounds, m_selectedShape);
+}
+
+void Canvas::scaleSelection(double factor)
+{
+    if (m_selection.size() > 1) {
+        const QPointF center = selectionCenter();
+        QTransform transform;
+        transform.translate(center.x(), center.y());
+        transform.scale(factor, factor);
+        transform.translate(-center.x(), -center.y());
+        transformSelection(transform);
+        return;
+    }
+    if (!m_selectedShape) return;
+    QRectF oldBounds = m_selectedShape->getIndexBounds();
+    beginEdit({ m_selectedShape });
+    m_selectedShape->scale(factor);
+    endEdit();
+    updateShape(oldBounds, m_selectedShape);
+}
+
+void Canvas::rotateSelection(double degrees)
+{
+    if (m_selection.size() > 1) {
+        const QPointF center = selectionCenter();
+        QTransform transform;
+        transform.translate(center.x(), center.y());
+        transform.rotate(degrees);
+        transform.translate(-center.x(), -center.y());
+        transformSelection(transform);
+        return;
+    }
+    if (!m_selectedShape) return;
+    QRectF oldBounds = m_selectedShape->getIndexBounds();
+    beginEdit({ m_selectedShape });
+    m_selectedShape->rotate(degrees);
+    endEdit();
+    updateShape(oldBounds, m_selectedShape);
+}
+
+void Canvas::beginEdit(const QList<Shape*> &shapes)
+{
+    if (!m_document) return;
+    m_document->beginTransaction();
+    m_document->aboutToModify(shapes);
+}
+
+void Canvas::endEdit()
+{
+    if (m_document) m_document->commitTransaction();
+}
+
+void Canvas::beginGesture()
+{
+    if (m_document && !m_inGesture) {
+        m_document->beginTransaction();
+        m_inGesture = true;
+    }
+}
+
+void Canvas::endGesture()
+{
+    if (!m_inGesture) return;
+    m_inGesture = false;
+    if (m_document) m_document->commitTransaction();
+}
+
+QRectF Canvas::selectionBand() const
+{
+    if (m_lassoSelect) return m_lasso.boundingRect();
+    return QRectF(m_selectionStart, m_selectionCurrent).normalized();
+}
+
+void Canvas::finishRegionSelection()
+{
+    m_isSelecting = false;
+    update(worldToScreenRect(selectionBand()));
+
+    Layer *layer = m_document ? m_document->getActiveLayer() : nullptr;
+    if (!layer || !layer->isVisible()) return;
+
+    QList<Shape*> found = m_lassoSelect ? layer->getShapesEnclosedBy(m_lasso)
+                                        : layer->getShapesEnclosedBy(selectionBand());
+    m_lasso.clear();
+    if (found.isEmpty()) return;
+
+    if (m_addToSelection) {
+        QList<Shape*> selection = m_selection;
+        for (Shape *shape : found) {
+            if (!shape->isSelected()) selection.append(shape);
+        }
+        found = selection;
+    }
+    selectShapes(found);
+}
+
+QPointF Canvas::selectionCenter() const
+{
+    if (m_selection.size() > 1) return m_selectionBounds.center();
+    return m_selectedShape ? m_selectedShape->getBoundingRect().center() : QPointF();
+}
+
+QPointF Canvas::snap(const QPointF &point)
+{
+    if (m_snapToObjects && m_document) {
+        Layer *layer = m_document->getActiveLayer();
+        SnapPoint target;
+        // A dragged selection must not snap to itself
+        const bool found = layer && layer->isVisible()
+            && layer->getSnapIndex().nearest(point, SnapRadius / m_zoom, target,
+                   [this](const Shape *shape) { return m_isDragging && shape->isSelected(); });
+        setSnapTarget(found, target);
+        if (found) return target.point;
+    }
+    return m_snapToGrid ? snapToGrid(point) : point;
+}
+
+void Canvas::setSnapTarget(bool found, const SnapPoint &target)
+{
+    if (found == m_hasSnapTarget && (!found || target.point == m_snapTarget.point)) return;
+
+    if (m_hasSnapTarget) update(snapMarkerRect());
+    m_hasSnapTarget = found;
+    m_snapTarget = target;
+    if (m_hasSnapTarget) update(snapMarkerRect());
+}
+
+QRect Canvas::snapMarkerRect() const
+{
+    const QPointF center = worldToScreen(m_snapTarget.point);
+    return QRectF(center.x() - 6, center.y() - 6, 12, 12).toAlignedRect();
 }
 
 QPointF Canvas::snapToGrid(const QPointF &point) const
@@ -609,30 +1126,78 @@ QPointF Canvas::snapToGrid(const QPointF &point) const
 void Canvas::resizeEvent(QResizeEvent *event)
 {
     QWidget::resizeEvent(event);
-#ifdef ENABLE_CAIRO
-    createCairoSurface();
-#endif
     update();
 }
 
 #ifdef ENABLE_CAIRO
-cairo_surface_t* Canvas::createCairoSurface()
+void Canvas::setTileCacheLimit(qint64 bytes)
+{
+    m_tileCache.setMaxBytes(bytes);
+}
+
+qint64 Canvas::getTileCacheLimit() const
+{
+    return m_tileCache.maxBytes();
+}
+
+void Canvas::setParallelRendering(bool enabled)
+{
+    m_parallelRendering = enabled;
+}
+
+bool Canvas::isParallelRendering() const
+{
+    return m_parallelRendering;
+}
+
+void Canvas::setLodPolicy(const LodPolicy &policy)
+{
+    if (policy == m_lodPolicy) return;
+    m_lodPolicy = policy;
+    m_tileCache.clear();
+    update();
+}
+
+const LodPolicy& Canvas::getLodPolicy() const
 {
-    if (m_cairoSurface) cairo_surface_destroy(m_cairoSurface);
-    if (m_cairoContext) cairo_destroy(m_cairoContext);
+    return m_lodPolicy;
+}
 
-    m_cairoSurface = cairo_image_surface_create(CAIRO_FORMAT_ARGB32, width(), height());
-    m_cairoContext = cairo_create(m_cairoSurface);
-    return m_cairoSurface;
+void Canvas::setBatchedRendering(bool enabled)
+{
+    if (enabled == m_batchedRendering) return;
+    m_batchedRendering = enabled;
+    m_tileCache.clear();
+    update();
+}
+
+bool Canvas::isBatchedRendering() const
+{
+    return m_batchedRendering;
 }
 #endif
 
+bool Canvas::loadDocument(const QString &filename)
+{
+    if (!m_document) return false;
+    if (!m_document->load(filename)) return false;
+    updateAll();
+    emit canvasChanged();
+    return true;
+}
+
+bool Canvas::saveDocument(const QString &filename)
+{
+    if (!m_document) return false;
+    return m_document->save(filename);
+}
+
 void Canvas::loadSVG(const QString &filename)
 {
     if (!m_document) return;
     SVGParser parser;
     parser.importFromFile(filename, m_document);
-    update();
+    updateAll();
     emit canvasChanged();
 }
 
@@ -641,7 +1206,7 @@ void Canvas::importSVG(const QString &filename)
     if (!m_document) return;
     SVGParser parser;
     parser.importFromFile(filename, m_document);
-    update();
+    updateAll();
     emit canvasChanged();
 }
 
@@ -657,9 +1222,7 @@ void Canvas::cutSelection()
 {
     if (!m_selectedShape || !m_document) return;
     copySelection();
-    m_document->removeShape(m_selectedShape);
-    m_selectedShape = nullptr;
-    update();
+    removeSelection();
 }
 
 void Canvas::copySelection()
@@ -688,14 +1251,30 @@ void Canvas::toggleSnapToGrid()
     m_snapToGrid = !m_snapToGrid;
 }
 
+void Canvas::setSnapToObjects(bool enabled)
+{
+    if (m_snapToObjects == enabled) return;
+    m_snapToObjects = enabled;
+
+    // The candidate indexes are only worth their memory while in use
+    if (!enabled) {
+        setSnapTarget(false, SnapPoint());
+        if (m_document) {
+            for (Layer *layer : m_document->getLayers()) layer->releaseSnapIndex();
+        }
+    }
+}
+
 void Canvas::setFillColor(const QColor &color)
 {
     m_fillBrush = QBrush(color); // ✅ Save for new shapes
 
     if (m_selectedShape) {
+        beginEdit({ m_selectedShape });
         m_selectedShape->setBrush(m_fillBrush);
+        endEdit();
+        updateWorldRect(m_selectedShape->getIndexBounds());
     }
-    update();
 }
 
 void Canvas::setStrokeColor(const QColor &color)
@@ -705,17 +1284,22 @@ void Canvas::setStrokeColor(const QColor &color)
     if (m_selectedShape) {
         QPen pen = m_selectedShape->getPen();
         pen.setColor(color);
+        beginEdit({ m_selectedShape });
         m_selectedShape->setPen(pen);
+        endEdit();
+        updateWorldRect(m_selectedShape->getIndexBounds());
     }
-    update();
 }
 
 void Canvas::setStrokeWidth(int width)
 {
     if (m_selectedShape) {
+        QRectF oldBounds = m_selectedShape->getIndexBounds();
         QPen pen = m_selectedShape->getPen();
         pen.setWidth(width);
+        beginEdit({ m_selectedShape });
         m_selectedShape->setPen(pen);
+        endEdit();
+        updateShape(oldBounds, m_selectedShape);
     }
-    update();
 }
\ No newline at end of file
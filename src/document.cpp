@@ -1,34 +1,467 @@
 #include "document.h"
 #include "layer.h"
+#include "rectangle.h"
+#include "ellipse.h"
+#include "line.h"
+#include "bezier.h"
+#include "text.h"
+#include "nativeformat.h"
+#include "shapepool.h"
+#include "threadpool.h"
+#include <QDebug>
+#include <QSet>
+#include <algorithm>
 
 Layer::Layer(const QString &name)
-    : QObject(), m_name(name), m_visible(true), m_locked(false) {}
+    : QObject(), m_name(name), m_visible(true), m_locked(false), m_nextZOrder(ZBase), m_bottomZOrder(ZBase) {}
 
 Layer::~Layer() {
     clear();
 }
 
 void Layer::addShape(Shape *shape) {
-    if (shape) {
+    if (shape && shape->m_layer != this) {
+        if (m_sortedRows == m_shapes.size()) ++m_sortedRows;
         m_shapes.append(shape);
+        shape->m_layer = this;
+        shape->m_zOrder = m_nextZOrder += ZGap;     // Appended shapes go on top
+        shape->m_row = m_columns.size();
+        m_columns.append(shape);
+        m_index.insert(shape, shape->getIndexBounds());
+        if (m_snapBuilt) m_snap.insert(shape);
     }
 }
 
+void Layer::addShapes(const QList<Shape*> &shapes) {
+    std::vector<std::pair<Shape*, QRectF>> items;
+    items.reserve(shapes.size());
+    m_columns.reserve(m_columns.size() + shapes.size());
+    for (Shape *shape : shapes) {
+        if (shape && shape->m_layer != this) {
+            if (m_sortedRows == m_shapes.size()) ++m_sortedRows;
+            m_shapes.append(shape);
+            shape->m_layer = this;
+            shape->m_zOrder = m_nextZOrder += ZGap;
+            shape->m_row = m_columns.size();
+            m_columns.append(shape);
+            items.emplace_back(shape, shape->getIndexBounds());
+            if (m_snapBuilt) m_snap.insert(shape);
+        }
+    }
+    m_index.insert(items);
+}
+
 void Layer::removeShape(Shape *shape) {
-    if (shape) {
-        m_shapes.removeOne(shape);
+    if (shape && shape->m_layer == this) {
+        const int row = shape->m_row;
+        m_shapes[row] = nullptr;
+        m_columns.clearRow(row);
+        ++m_tombstones;
+        m_index.remove(shape);
+        m_snap.remove(shape);
+        shape->m_layer = nullptr;
+        shape->m_row = -1;
+    }
+}
+
+void Layer::removeShapes(const QList<Shape*> &shapes) {
+    // shapes may be getShapes() itself, which the tombstones write into
+    std::vector<Shape*> removed;
+    removed.reserve(shapes.size());
+    for (Shape *shape : shapes) {
+        if (shape && shape->m_layer == this) {
+            shape->m_layer = nullptr;   // Also drops duplicates
+            removed.push_back(shape);
+        }
+    }
+    if (removed.empty()) return;
+
+    for (Shape *shape : removed) {
+        m_shapes[shape->m_row] = nullptr;
+        m_columns.clearRow(shape->m_row);
+        m_snap.remove(shape);
+        shape->m_row = -1;
+    }
+    m_tombstones += int(removed.size());
+
+    if (double(removed.size()) >= RepackShare * (shapeCount() + int(removed.size()))) {
+        repackIndex();
+    } else {
+        for (Shape *shape : removed) m_index.remove(shape);
     }
 }
 
 void Layer::clear() {
+    m_index.clear();
+    m_columns.clear();
+    m_snap.clear();
+    for (Shape *shape : m_shapes) {
+        if (!shape) continue;
+        shape->m_layer = nullptr;
+        shape->m_row = -1;
+    }
     qDeleteAll(m_shapes);
     m_shapes.clear();
+    m_tombstones = 0;
+    m_sortedRows = 0;
 }
 
-QList<Shape*> Layer::getShapes() const {
+const QList<Shape*>& Layer::getShapes() const {
+    compact();
     return m_shapes;
 }
 
+const ShapeColumns& Layer::getColumns() const {
+    compact();
+    return m_columns;
+}
+
+void Layer::compact() const {
+    if (m_tombstones == 0 && m_sortedRows == m_shapes.size()) return;
+
+    // Live rows in draw order: the sorted prefix as it is, the rows that
+    // restacking appended sorted on their own and merged in
+    std::vector<int> order;
+    order.reserve(size_t(m_shapes.size() - m_tombstones));
+    for (int row = 0; row < m_sortedRows; ++row) {
+        if (m_shapes.at(row)) order.push_back(row);
+    }
+    const size_t middle = order.size();
+    for (int row = m_sortedRows; row < m_shapes.size(); ++row) {
+        if (m_shapes.at(row)) order.push_back(row);
+    }
+    auto byZOrder = [this](int a, int b) {
+        return m_shapes.at(a)->m_zOrder < m_shapes.at(b)->m_zOrder;
+    };
+    std::sort(order.begin() + middle, order.end(), byZOrder);
+    std::inplace_merge(order.begin(), order.begin() + middle, order.end(), byZOrder);
+
+    QList<Shape*> shapes;
+    shapes.reserve(int(order.size()));
+    for (int row : order) {
+        Shape *shape = m_shapes.at(row);
+        shape->m_row = shapes.size();
+        shapes.append(shape);
+    }
+    m_columns.reorder(order);
+    m_shapes.swap(shapes);
+    m_tombstones = 0;
+    m_sortedRows = m_shapes.size();
+}
+
+Shape* Layer::getShapeAt(const QPointF &point) const {
+    QList<Shape*> candidates = m_index.query(point);
+    sortByZOrder(candidates);
+
+    for (auto it = candidates.rbegin(); it != candidates.rend(); ++it) {
+        if ((*it)->isVisible() && (*it)->contains(point)) {
+            return *it;
+        }
+    }
+    return nullptr;
+}
+
+QList<Shape*> Layer::getShapesIn(const QRectF &rect) const {
+    // A rect over much of the layer matches most shapes anyway: scanning
+    // the columns in draw order then beats walking the tree and sorting.
+    // A flat extent has no area to compare against; the tree handles it.
+    const QRectF extent = m_index.extent();
+    const QRectF overlap = extent.intersected(rect.normalized());
+    if (extent.width() > 0.0 && extent.height() > 0.0
+        && overlap.width() * overlap.height() >= extent.width() * extent.height() * ScanCoverage) {
+        compact();      // The scan returns row order
+        return m_columns.query(rect);
+    }
+
+    QList<Shape*> shapes = m_index.query(rect);
+    sortByZOrder(shapes);
+    return shapes;
+}
+
+const SnapIndex& Layer::getSnapIndex() {
+    if (!m_snapBuilt) {
+        for (const Shape *shape : m_shapes) {
+            if (shape) m_snap.insert(shape);
+        }
+        m_snapBuilt = true;
+    }
+    return m_snap;
+}
+
+void Layer::releaseSnapIndex() {
+    m_snap.clear();
+    m_snapBuilt = false;
+}
+
+QList<Shape*> Layer::getShapesEnclosedBy(const QRectF &rect) const {
+    const QRectF region = rect.normalized();
+    return filterEnclosed(region, [&region](const QPolygonF &outline) {
+        for (const QPointF &point : outline) {
+            if (point.x() < region.left() || point.x() > region.right()
+                || point.y() < region.top() || point.y() > region.bottom()) {
+                return false;
+            }
+        }
+        return true;
+    });
+}
+
+QList<Shape*> Layer::getShapesEnclosedBy(const QPolygonF &lasso) const {
+    if (lasso.size() < 3) return QList<Shape*>();
+    return filterEnclosed(lasso.boundingRect(), [&lasso](const QPolygonF &outline) {
+        for (const QPointF &point : outline) {
+            if (!lasso.containsPoint(point, Qt::OddEvenFill)) return false;
+        }
+        return true;
+    });
+}
+
+QList<Shape*> Layer::filterEnclosed(const QRectF &bounds,
+                                    const std::function<bool(const QPolygonF&)> &encloses) const {
+    // Broad phase: anything enclosed has its index bounds touching the
+    // region's bounding rect
+    const QList<Shape*> candidates = getShapesIn(bounds);
+
+    // Narrow phase on the exact outlines, in chunks. Outlines are only
+    // read here, and the Bezier caches they come from are safe to fill
+    // from several threads.
+    std::vector<char> enclosed(size_t(candidates.size()), 0);
+    auto test = [&](int chunk) {
+        const int end = qMin(candidates.size(), (chunk + 1) * EnclosedChunk);
+        for (int i = chunk * EnclosedChunk; i < end; ++i) {
+            const Shape *shape = candidates[i];
+            if (!shape->isVisible()) continue;
+            const QPolygonF outline = shape->getOutline();
+            enclosed[size_t(i)] = !outline.isEmpty() && encloses(outline);
+        }
+    };
+    const int chunks = (candidates.size() + EnclosedChunk - 1) / EnclosedChunk;
+    if (chunks > 1) {
+        ThreadPool::globalInstance().parallelFor(chunks, test);
+    } else if (chunks == 1) {
+        test(0);
+    }
+
+    QList<Shape*> shapes;
+    for (int i = 0; i < candidates.size(); ++i) {
+        if (enclosed[size_t(i)]) shapes.append(candidates[i]);
+    }
+    return shapes;
+}
+
+void Layer::transformShapes(const QList<Shape*> &shapes, const QTransform &transform,
+                            QRectF *oldBounds, QRectF *newBounds) {
+    std::vector<Shape*> owned;
+    owned.reserve(shapes.size());
+    QRectF before;
+    for (Shape *shape : shapes) {
+        if (shape && shape->m_layer == this) {
+            owned.push_back(shape);
+            before = before.united(rowBounds(shape->m_row));
+        }
+    }
+    if (oldBounds) *oldBounds = before;
+    if (newBounds) *newBounds = QRectF();
+    if (owned.empty()) return;
+
+    // Gather every defining point into one array, map it in a single
+    // kernel pass, and hand each shape its slice back
+    std::vector<QPointF> points;
+    std::vector<size_t> offsets;
+    points.reserve(owned.size() * 2);
+    offsets.reserve(owned.size() + 1);
+    for (const Shape *shape : owned) {
+        offsets.push_back(points.size());
+        shape->gatherPoints(points);
+    }
+    offsets.push_back(points.size());
+
+    AffineKernel::map(transform, points.data(), points.size());
+
+    const AffineKernel::Parts parts = AffineKernel::decompose(transform);
+    QRectF after;
+    for (size_t i = 0; i < owned.size(); ++i) {
+        Shape *shape = owned[i];
+        shape->scatterPoints(points.data() + offsets[i], parts);
+        m_columns.update(shape->m_row);
+        if (m_snapBuilt) m_snap.update(shape);
+        after = after.united(rowBounds(shape->m_row));
+    }
+
+    if (double(owned.size()) >= RepackShare * shapeCount()) {
+        repackIndex();
+    } else {
+        for (Shape *shape : owned) {
+            m_index.update(shape, rowBounds(shape->m_row));
+        }
+    }
+
+    if (newBounds) *newBounds = after;
+}
+
+// ====================
+// Z-order
+// ====================
+void Layer::bringToFront(const QList<Shape*> &shapes) {
+    for (Shape *shape : ownedByZOrder(shapes)) {
+        moveRowToEnd(shape, m_nextZOrder += ZGap);
+    }
+}
+
+void Layer::sendToBack(const QList<Shape*> &shapes) {
+    const QList<Shape*> owned = ownedByZOrder(shapes);
+    for (auto it = owned.rbegin(); it != owned.rend(); ++it) {
+        moveRowToEnd(*it, m_bottomZOrder -= ZGap);
+    }
+}
+
+void Layer::bringForward(const QList<Shape*> &shapes) {
+    restackStep(shapes, true);
+}
+
+void Layer::sendBackward(const QList<Shape*> &shapes) {
+    restackStep(shapes, false);
+}
+
+void Layer::restackStep(const QList<Shape*> &shapes, bool up) {
+    const QList<Shape*> moving = ownedByZOrder(shapes);
+    if (moving.isEmpty()) return;
+    compact();      // Neighbouring labels are read off the rows below
+
+    // Each shape's target is the nearest shape past it whose bounds it
+    // overlaps, from an R-tree query; shapes with the same target form a
+    // group that keeps its relative order
+    QSet<const Shape*> movingSet;
+    for (const Shape *shape : moving) movingSet.insert(shape);
+    QList<Shape*> targets;
+    QHash<Shape*, QList<Shape*>> groups;
+    for (Shape *shape : moving) {
+        Shape *target = nullptr;
+        for (Shape *candidate : m_index.query(rowBounds(shape->m_row))) {
+            if (movingSet.contains(candidate)) continue;
+            const bool past = up ? candidate->m_zOrder > shape->m_zOrder
+                                 : candidate->m_zOrder < shape->m_zOrder;
+            const bool nearer = !target || (up ? candidate->m_zOrder < target->m_zOrder
+                                               : candidate->m_zOrder > target->m_zOrder);
+            if (past && nearer) target = candidate;
+        }
+        if (!target) continue;
+
+        QList<Shape*> &group = groups[target];
+        if (group.isEmpty()) targets.append(target);
+        group.append(shape);
+    }
+    if (targets.isEmpty()) return;
+
+    // A group takes evenly spaced labels between its target and the
+    // target's neighbour on the far side. Should a gap be too narrow, the
+    // whole layer is relabelled with wider spacing and the labels redone.
+    std::vector<std::pair<Shape*, quint64>> labels;
+    for (;;) {
+        labels.clear();
+        bool fits = true;
+        for (Shape *target : targets) {
+            const QList<Shape*> &group = groups[target];
+            const int row = target->m_row;
+            quint64 low, high;
+            if (up) {
+                low = target->m_zOrder;
+                high = row + 1 < m_shapes.size() ? m_shapes.at(row + 1)->m_zOrder : m_nextZOrder + ZGap;
+            } else {
+                low = row > 0 ? m_shapes.at(row - 1)->m_zOrder : m_bottomZOrder - ZGap;
+                high = target->m_zOrder;
+            }
+            const quint64 step = (high - low) / quint64(group.size() + 1);
+            if (step == 0) {
+                fits = false;
+                break;
+            }
+            for (int i = 0; i < group.size(); ++i) {
+                labels.emplace_back(group[i], low + step * quint64(i + 1));
+            }
+        }
+        if (fits) break;
+
+        quint64 gap = ZGap;
+        while (gap <= quint64(moving.size())) gap <<= 1;
+        relabel(gap);
+    }
+
+    for (const auto &label : labels) {
+        moveRowToEnd(label.first, label.second);
+        m_nextZOrder = std::max(m_nextZOrder, label.second);
+        m_bottomZOrder = std::min(m_bottomZOrder, label.second);
+    }
+}
+
+QList<Shape*> Layer::ownedByZOrder(const QList<Shape*> &shapes) const {
+    QList<Shape*> owned;
+    owned.reserve(shapes.size());
+    for (Shape *shape : shapes) {
+        if (shape && shape->m_layer == this) owned.append(shape);
+    }
+    sortByZOrder(owned);
+    owned.erase(std::unique(owned.begin(), owned.end()), owned.end());
+    return owned;
+}
+
+void Layer::moveRowToEnd(Shape *shape, quint64 zOrder) {
+    // Tombstone the old row; compact() merges the new one into place
+    const int row = shape->m_row;
+    m_shapes[row] = nullptr;
+    m_columns.clearRow(row);
+    ++m_tombstones;
+
+    shape->m_zOrder = zOrder;
+    shape->m_row = m_shapes.size();
+    m_shapes.append(shape);
+    m_columns.append(shape);
+}
+
+void Layer::relabel(quint64 gap) {
+    compact();
+    for (int row = 0; row < m_shapes.size(); ++row) {
+        m_shapes[row]->m_zOrder = ZBase + gap * quint64(row + 1);
+    }
+    m_bottomZOrder = ZBase;
+    m_nextZOrder = ZBase + gap * quint64(m_shapes.size());
+}
+
+void Layer::repackIndex() {
+    std::vector<std::pair<Shape*, QRectF>> items;
+    items.reserve(shapeCount());
+    for (int row = 0; row < m_shapes.size(); ++row) {
+        if (m_shapes[row]) items.emplace_back(m_shapes[row], rowBounds(row));
+    }
+    m_index.clear();
+    m_index.insert(items);
+}
+
+QRectF Layer::rowBounds(int row) const {
+    return QRectF(QPointF(m_columns.minX()[row], m_columns.minY()[row]),
+                  QPointF(m_columns.maxX()[row], m_columns.maxY()[row]));
+}
+
+void Layer::shapeGeometryChanged(Shape *shape) {
+    if (shape && shape->m_layer == this) {
+        m_index.update(shape, shape->getIndexBounds());
+        m_columns.update(shape->m_row);
+        if (m_snapBuilt) m_snap.update(shape);
+    }
+}
+
+void Layer::shapeStateChanged(Shape *shape) {
+    if (shape && shape->m_layer == this) {
+        m_columns.updateState(shape->m_row);
+    }
+}
+
+void Layer::sortByZOrder(QList<Shape*> &shapes) const {
+    std::sort(shapes.begin(), shapes.end(), [](const Shape *a, const Shape *b) {
+        return a->m_zOrder < b->m_zOrder;
+    });
+}
+
 QString Layer::getName() const {
     return m_name;
 }
@@ -57,10 +490,33 @@ void Layer::setLocked(bool locked) {
 // Document Implementation
 // =============================
 
+namespace {
+
+// What a shape held by the undo history costs, roughly
+size_t shapeBytes(const Shape *shape) {
+    switch (shape->getType()) {
+    case Shape::Rectangle:
+        return sizeof(Rectangle);
+    case Shape::Ellipse:
+        return sizeof(Ellipse);
+    case Shape::Line:
+        return sizeof(Line);
+    case Shape::Bezier:
+        return sizeof(Bezier)
+             + size_t(static_cast<const Bezier*>(shape)->getPoints().size()) * sizeof(QPointF);
+    case Shape::Text:
+        return sizeof(Text) + size_t(static_cast<const Text*>(shape)->getText().size()) * sizeof(QChar);
+    }
+    return sizeof(Shape);
+}
+
+} // namespace
+
 Document::Document()
     : QObject(), m_size(800, 600), m_backgroundColor(Qt::white) {
     m_activeLayer = new Layer("Default Layer");
     m_layers.append(m_activeLayer);
+    m_clock.start();
 }
 
 Document::~Document() {
@@ -77,6 +533,7 @@ void Document::addLayer(Layer *layer) {
 void Document::removeLayer(Layer *layer) {
     if (layer && m_layers.contains(layer)) {
         m_layers.removeOne(layer);
+        forgetLayer(layer);
         if (m_activeLayer == layer) {
             m_activeLayer = m_layers.isEmpty() ? nullptr : m_layers.last();
         }
@@ -87,11 +544,19 @@ void Document::removeLayer(Layer *layer) {
 }
 
 void Document::clear() {
+    // Shapes only the history holds first, while the layers can still
+    // tell which those are
+    clearHistory();
+    discard(m_pendingStep, false);
+    m_pendingStep = UndoStep();
+    m_pendingChanges = ChangeSet();
+    m_pendingModified.clear();
+    m_transactionDepth = 0;
     qDeleteAll(m_layers);
     m_layers.clear();
     m_activeLayer = nullptr;
-    m_undoStack.clear();
-    m_redoStack.clear();
+    ShapePool::trim();      // Return the slabs the shapes lived in
+    emit documentReset();
 }
 
 QList<Layer*> Document::getLayers() const {
@@ -111,36 +576,272 @@ void Document::setActiveLayer(Layer *layer) {
 void Document::addShape(Shape *shape) {
     if (shape && m_activeLayer) {
         m_activeLayer->addShape(shape);
-        m_undoStack.append({Command::AddShape, shape, m_activeLayer});
-        m_redoStack.clear();
-        emit shapeAdded(shape);
-        emit documentChanged();
+
+        ChangeSet changes;
+        changes.added.append(shape->getId());
+        changes.bounds = shape->getIndexBounds();
+        if (!inTransaction()) emit shapeAdded(shape);
+        UndoStep step;
+        step.commands.append({Command::AddShape, shape, m_activeLayer, nullptr});
+        record(std::move(step), changes);
     }
 }
 
+void Document::addShapes(const QList<Shape*> &shapes) {
+    if (!m_activeLayer) return;
+
+    QList<Shape*> added;
+    added.reserve(shapes.size());
+    for (Shape *shape : shapes) {
+        if (shape && shape->getLayer() != m_activeLayer) added.append(shape);
+    }
+    if (added.isEmpty()) return;
+    m_activeLayer->addShapes(added);
+
+    UndoStep step;
+    step.commands.reserve(added.size());
+    ChangeSet changes;
+    changes.added.reserve(added.size());
+    for (Shape *shape : added) {
+        step.commands.append({Command::AddShape, shape, m_activeLayer, nullptr});
+        changes.added.append(shape->getId());
+        changes.bounds = changes.bounds.united(shape->getIndexBounds());
+    }
+    record(std::move(step), changes);
+}
+
 void Document::removeShape(Shape *shape) {
-    if (shape) {
-        for (auto layer : m_layers) {
-            if (layer->getShapes().contains(shape)) {
-                layer->removeShape(shape);
-                m_undoStack.append({Command::RemoveShape, shape, layer});
-                m_redoStack.clear();
-                emit shapeRemoved(shape);
-                emit documentChanged();
-                break;
+    Layer *layer = shape ? shape->getLayer() : nullptr;
+    if (layer && m_layers.contains(layer)) {
+        layer->removeShape(shape);
+
+        ChangeSet changes;
+        changes.removed.append(shape->getId());
+        changes.bounds = shape->getIndexBounds();
+        if (!inTransaction()) emit shapeRemoved(shape);
+        UndoStep step;
+        step.commands.append({Command::RemoveShape, shape, layer, nullptr});
+        record(std::move(step), changes);
+    }
+}
+
+void Document::removeShapes(const QList<Shape*> &shapes) {
+    // Per layer, so each one compacts its rows once
+    UndoStep step;
+    ChangeSet changes;
+    for (Layer *layer : m_layers) {
+        QList<Shape*> removed;
+        for (Shape *shape : shapes) {
+            if (shape && shape->getLayer() == layer) removed.append(shape);
+        }
+        if (removed.isEmpty()) continue;
+
+        layer->removeShapes(removed);
+        for (Shape *shape : removed) {
+            step.commands.append({Command::RemoveShape, shape, layer, nullptr});
+            changes.removed.append(shape->getId());
+            changes.bounds = changes.bounds.united(shape->getIndexBounds());
+        }
+    }
+    if (!step.commands.isEmpty()) record(std::move(step), changes);
+}
+
+void Document::aboutToModify(const QList<Shape*> &shapes) {
+    // Outside a transaction changed() would go out before the edit
+    Q_ASSERT_X(inTransaction(), "Document::aboutToModify", "called outside a transaction");
+    if (!inTransaction()) return;
+
+    UndoStep step;
+    ChangeSet changes;
+    for (Shape *shape : shapes) {
+        Layer *layer = shape ? shape->getLayer() : nullptr;
+        if (!layer || !m_layers.contains(layer)) continue;
+        if (m_pendingModified.contains(shape)) continue;   // The first snapshot stands
+        m_pendingModified.insert(shape);
+        step.commands.append({Command::ModifyShape, shape, layer,
+                              std::make_shared<Shape::State>(shape->saveState())});
+        changes.modified.append(shape->getId());
+        changes.bounds = changes.bounds.united(shape->getIndexBounds());
+    }
+    if (!step.commands.isEmpty()) record(std::move(step), changes);
+}
+
+void Document::beginTransaction() {
+    ++m_transactionDepth;
+}
+
+void Document::commitTransaction() {
+    if (m_transactionDepth == 0) {
+        qDebug() << "Document::commitTransaction() without beginTransaction()";
+        return;
+    }
+    if (--m_transactionDepth > 0) return;
+
+    UndoStep step = std::move(m_pendingStep);
+    const ChangeSet changes = m_pendingChanges;
+    m_pendingStep = UndoStep();
+    m_pendingChanges = ChangeSet();
+    m_pendingModified.clear();
+
+    // The edits are done: keep only what they changed
+    compactDeltas(step);
+    if (step.commands.isEmpty()) return;
+
+    step.time = m_clock.elapsed();
+    push(std::move(step));
+    emit changed(changes);
+    emit documentChanged();
+}
+
+void Document::record(UndoStep step, const ChangeSet &changes) {
+    if (inTransaction()) {
+        m_pendingStep.commands.append(step.commands);
+        m_pendingChanges.added.append(changes.added);
+        m_pendingChanges.removed.append(changes.removed);
+        m_pendingChanges.modified.append(changes.modified);
+        m_pendingChanges.bounds = m_pendingChanges.bounds.united(changes.bounds);
+        return;
+    }
+
+    step.time = m_clock.elapsed();
+    push(std::move(step));
+    emit changed(changes);
+    emit documentChanged();
+}
+
+void Document::push(UndoStep step) {
+    if (coalesce(step)) return;
+
+    // A new edit ends the redo branch, and with it the shapes it held
+    for (const UndoStep &undone : m_redoStack) {
+        m_historyBytes -= undone.bytes;
+        discard(undone, true);
+    }
+    m_redoStack.clear();
+
+    step.bytes = stepBytes(step, false);
+    m_historyBytes += step.bytes;
+    m_undoStack.append(std::move(step));
+    trimHistory();
+}
+
+bool Document::coalesce(const UndoStep &step) {
+    // Only the same shapes modified again, soon after, with nothing undone
+    if (m_undoStack.isEmpty() || !m_redoStack.isEmpty()) return false;
+    UndoStep &top = m_undoStack.last();
+    if (step.time - top.time > CoalesceMs || top.commands.size() != step.commands.size()) return false;
+    for (int i = 0; i < step.commands.size(); ++i) {
+        const Command &older = top.commands[i];
+        const Command &newer = step.commands[i];
+        if (older.type != Command::ModifyShape || newer.type != Command::ModifyShape
+            || older.shape != newer.shape) {
+            return false;
+        }
+    }
+
+    // The older values are the ones to go back to; fields only the newer
+    // edit touched had not changed before it, so its values serve as well
+    for (int i = 0; i < step.commands.size(); ++i) {
+        top.commands[i].delta->merge(*step.commands[i].delta);
+    }
+    top.time = step.time;
+    m_historyBytes -= top.bytes;
+    top.bytes = stepBytes(top, false);
+    m_historyBytes += top.bytes;
+    return true;
+}
+
+void Document::compactDeltas(UndoStep &step) {
+    auto unchanged = [](const Command &command) {
+        return command.type == Command::ModifyShape
+            && !command.delta->dropUnchanged(command.shape->saveState());
+    };
+    step.commands.erase(std::remove_if(step.commands.begin(), step.commands.end(), unchanged),
+                        step.commands.end());
+}
+
+size_t Document::stepBytes(const UndoStep &step, bool redo) {
+    const Command::Type owning = redo ? Command::AddShape : Command::RemoveShape;
+    size_t bytes = sizeof(UndoStep) + size_t(step.commands.size()) * sizeof(Command);
+    for (const Command &command : step.commands) {
+        if (command.delta) {
+            bytes += command.delta->memoryUsage();
+        } else if (command.type == owning) {
+            bytes += shapeBytes(command.shape);
+        }
+    }
+    return bytes;
+}
+
+void Document::discard(const UndoStep &step, bool redo) {
+    // Owned shapes are out of every layer; anything else is the document's
+    const Command::Type owning = redo ? Command::AddShape : Command::RemoveShape;
+    QSet<const Shape*> freed;
+    for (const Command &command : step.commands) {
+        if (command.type != owning || freed.contains(command.shape)) continue;
+        if (!command.shape->getLayer()) {
+            freed.insert(command.shape);
+            delete command.shape;
+        }
+    }
+}
+
+void Document::forgetLayer(Layer *layer) {
+    // Deleting the layer deletes the shapes in it, and its commands could
+    // never be replayed; the shapes only the history holds are still alive
+    auto prune = [layer](UndoStep &step, bool redo) {
+        const Command::Type owning = redo ? Command::AddShape : Command::RemoveShape;
+        QSet<const Shape*> freed;
+        QList<Command> kept;
+        for (const Command &command : step.commands) {
+            if (command.layer != layer) {
+                kept.append(command);
+            } else if (command.type == owning && !freed.contains(command.shape)
+                       && !command.shape->getLayer()) {
+                freed.insert(command.shape);
+                delete command.shape;
             }
         }
+        step.commands.swap(kept);
+        step.bytes = stepBytes(step, redo);
+    };
+    auto pruneStack = [&prune](QList<UndoStep> &stack, bool redo) {
+        for (UndoStep &step : stack) prune(step, redo);
+        stack.erase(std::remove_if(stack.begin(), stack.end(),
+                                   [](const UndoStep &step) { return step.commands.isEmpty(); }),
+                    stack.end());
+    };
+    pruneStack(m_undoStack, false);
+    pruneStack(m_redoStack, true);
+    prune(m_pendingStep, false);
+
+    m_pendingModified.clear();
+    for (const Command &command : m_pendingStep.commands) {
+        if (command.type == Command::ModifyShape) m_pendingModified.insert(command.shape);
+    }
+    m_historyBytes = 0;
+    for (const UndoStep &step : m_undoStack) m_historyBytes += step.bytes;
+    for (const UndoStep &step : m_redoStack) m_historyBytes += step.bytes;
+}
+
+void Document::trimHistory() {
+    // Oldest first: the bottom of the undo stack, then the far end of the
+    // redo stack. The newest step stays even if it alone is over budget.
+    while (m_historyBytes > m_historyBudget) {
+        const bool redo = m_undoStack.size() <= 1;
+        if (redo && m_redoStack.isEmpty()) break;
+
+        const UndoStep step = redo ? m_redoStack.takeFirst() : m_undoStack.takeFirst();
+        m_historyBytes -= step.bytes;
+        discard(step, redo);
     }
 }
 
 Shape* Document::getShapeAt(const QPointF &point) const {
     for (auto it = m_layers.rbegin(); it != m_layers.rend(); ++it) {
         if ((*it)->isVisible()) {
-            const QList<Shape*> shapes = (*it)->getShapes();
-            for (auto shapeIt = shapes.rbegin(); shapeIt != shapes.rend(); ++shapeIt) {
-                if (*shapeIt && (*shapeIt)->isVisible() && (*shapeIt)->contains(point)) {
-                    return *shapeIt;
-                }
+            if (Shape *shape = (*it)->getShapeAt(point)) {
+                return shape;
             }
         }
     }
@@ -184,18 +885,24 @@ QColor Document::getBackgroundColor() const {
 }
 
 bool Document::save(const QString &filename) {
-    // Placeholder for file saving logic
-    return false;
+    return NativeFormat::save(this, filename);
 }
 
 bool Document::load(const QString &filename) {
-    // Placeholder for file loading logic
-    return false;
+    return NativeFormat::load(this, filename);
 }
 
 void Document::clearHistory() {
+    for (const UndoStep &step : m_undoStack) discard(step, false);
+    for (const UndoStep &step : m_redoStack) discard(step, true);
     m_undoStack.clear();
     m_redoStack.clear();
+    m_historyBytes = 0;
+}
+
+void Document::setHistoryBudget(size_t bytes) {
+    m_historyBudget = bytes;
+    trimHistory();
 }
 
 bool Document::canUndo() const {
@@ -208,32 +915,71 @@ bool Document::canRedo() const {
 
 void Document::undo() {
     if (!m_undoStack.isEmpty()) {
-        Command cmd = m_undoStack.takeLast();
-        if (cmd.type == Command::AddShape) {
-            cmd.layer->removeShape(cmd.shape);
-            m_redoStack.append(cmd);
-            emit shapeRemoved(cmd.shape);
-        } else if (cmd.type == Command::RemoveShape) {
-            cmd.layer->addShape(cmd.shape);
-            m_redoStack.append(cmd);
-            emit shapeAdded(cmd.shape);
-        }
+        UndoStep step = m_undoStack.takeLast();
+        m_historyBytes -= step.bytes;
+        ChangeSet changes;
+        replay(step, true, changes);
+        step.bytes = stepBytes(step, true);     // Its shapes changed hands
+        m_historyBytes += step.bytes;
+        m_redoStack.append(std::move(step));
+        emit changed(changes);
         emit documentChanged();
     }
 }
 
 void Document::redo() {
     if (!m_redoStack.isEmpty()) {
-        Command cmd = m_redoStack.takeLast();
-        if (cmd.type == Command::AddShape) {
-            cmd.layer->addShape(cmd.shape);
-            m_undoStack.append(cmd);
-            emit shapeAdded(cmd.shape);
-        } else if (cmd.type == Command::RemoveShape) {
-            cmd.layer->removeShape(cmd.shape);
-            m_undoStack.append(cmd);
-            emit shapeRemoved(cmd.shape);
-        }
+        UndoStep step = m_redoStack.takeLast();
+        m_historyBytes -= step.bytes;
+        ChangeSet changes;
+        replay(step, false, changes);
+        step.bytes = stepBytes(step, false);
+        m_historyBytes += step.bytes;
+        m_undoStack.append(std::move(step));
+        emit changed(changes);
         emit documentChanged();
     }
-}
\ No newline at end of file
+}
+
+void Document::replay(const UndoStep &step, bool backwards, ChangeSet &changes) {
+    // Runs of commands of one kind on one layer go to the layer as a
+    // single bulk call: undoing a 100k-shape import is one compaction
+    const QList<Command> &commands = step.commands;
+    const int count = commands.size();
+    int i = 0;
+    while (i < count) {
+        const Command &first = commands[backwards ? count - 1 - i : i];
+        const bool present = m_layers.contains(first.layer);
+        QList<Shape*> run;
+        int j = i;
+        for (; j < count; ++j) {
+            const Command &command = commands[backwards ? count - 1 - j : j];
+            if (command.type != first.type || command.layer != first.layer) break;
+            if (command.type != Command::ModifyShape) {
+                run.append(command.shape);
+            } else if (present && command.shape->getLayer() == command.layer) {
+                // A few fields each: exchanged one shape at a time
+                const QRectF before = command.shape->getIndexBounds();
+                *command.delta = command.shape->exchangeState(*command.delta);
+                changes.modified.append(command.shape->getId());
+                changes.bounds = changes.bounds.united(before).united(command.shape->getIndexBounds());
+            }
+        }
+        i = j;
+        if (first.type == Command::ModifyShape || !present) continue;
+
+        // Shapes a run puts back go on top in their original order
+        if (backwards) std::reverse(run.begin(), run.end());
+
+        const bool adding = (first.type == Command::AddShape) != backwards;
+        if (adding) {
+            first.layer->addShapes(run);
+        } else {
+            first.layer->removeShapes(run);
+        }
+        for (Shape *shape : run) {
+            (adding ? changes.added : changes.removed).append(shape->getId());
+            changes.bounds = changes.bounds.united(shape->getIndexBounds());
+        }
+    }
+}
@@ -61,59 +61,68 @@ void Ellipse::draw(cairo_t *cr)
 {
     if (!isVisible() || !cr) return;
 
-    QPointF pos = getPosition();
-    QSizeF size = getSize();
-    QPen pen = getPen();
-    QBrush brush = getBrush();
+    const QPen &pen = getPen();
+    const QBrush &brush = getBrush();
 
-    double centerX = pos.x() + size.width() / 2.0;
-    double centerY = pos.y() + size.height() / 2.0;
-    double radiusX = size.width() / 2.0;
-    double radiusY = size.height() / 2.0;
-
-    double startAngleRad = m_startAngle * M_PI / 180.0;
-    double endAngleRad   = m_endAngle   * M_PI / 180.0;
+    cairo_save(cr);
+    rotateContext(cr);
 
-    // Fill
+    // Fill (a pie slice for partial arcs)
     if (brush.style() != Qt::NoBrush) {
-        cairo_save(cr);
-        cairo_translate(cr, centerX, centerY);
-        cairo_scale(cr, radiusX, radiusY);
-
-        if (std::fabs(m_endAngle - m_startAngle) >= 360.0) {
-            cairo_arc(cr, 0, 0, 1, 0, 2 * M_PI);
-        }
-        else {
-            cairo_arc(cr, 0, 0, 1, startAngleRad, endAngleRad);
-            cairo_line_to(cr, 0, 0);
-            cairo_close_path(cr);
-        }
-
+        cairo_new_path(cr);
+        addOutline(cr, true);
         QColor fillColor = brush.color();
         cairo_set_source_rgba(cr, fillColor.redF(), fillColor.greenF(), fillColor.blueF(), fillColor.alphaF());
-        cairo_fill_preserve(cr);
-        cairo_restore(cr);
+        cairo_fill(cr);
     }
 
-    // Stroke
+    // Stroke, in world space so the width is even all round
     if (pen.style() != Qt::NoPen) {
-        cairo_save(cr);
-        cairo_translate(cr, centerX, centerY);
-        cairo_scale(cr, radiusX, radiusY);
-
-        if (std::fabs(m_endAngle - m_startAngle) >= 360.0) {
-            cairo_arc(cr, 0, 0, 1, 0, 2 * M_PI);
-        }
-        else {
-            cairo_arc(cr, 0, 0, 1, startAngleRad, endAngleRad);
-        }
-
+        cairo_new_path(cr);
+        addOutline(cr, false);
         QColor strokeColor = pen.color();
         cairo_set_source_rgba(cr, strokeColor.redF(), strokeColor.greenF(), strokeColor.blueF(), strokeColor.alphaF());
-        cairo_set_line_width(cr, pen.widthF() / ((radiusX + radiusY) / 2.0));
+        cairo_set_line_width(cr, pen.widthF());
         cairo_stroke(cr);
-        cairo_restore(cr);
     }
+
+    cairo_restore(cr);
+}
+
+bool Ellipse::buildPath(cairo_t *cr) const
+{
+    // Partial arcs fill a pie but stroke only the arc
+    if (std::fabs(m_endAngle - m_startAngle) < 360.0) return false;
+
+    addOutline(cr, true);
+    return true;
+}
+
+void Ellipse::addOutline(cairo_t *cr, bool pie) const
+{
+    const double radiusX = m_size.width() / 2.0;
+    const double radiusY = m_size.height() / 2.0;
+    if (radiusX <= 0.0 || radiusY <= 0.0) return;
+
+    // The path keeps its device coordinates across the restore, so only
+    // the unit circle is drawn under the scaled matrix
+    cairo_save(cr);
+    cairo_translate(cr, m_position.x() + radiusX, m_position.y() + radiusY);
+    cairo_scale(cr, radiusX, radiusY);
+    cairo_new_sub_path(cr);
+
+    if (std::fabs(m_endAngle - m_startAngle) >= 360.0) {
+        cairo_arc(cr, 0, 0, 1, 0, 2 * M_PI);
+        cairo_close_path(cr);
+    } else {
+        cairo_arc(cr, 0, 0, 1, m_startAngle * M_PI / 180.0, m_endAngle * M_PI / 180.0);
+        if (pie) {
+            cairo_line_to(cr, 0, 0);
+            cairo_close_path(cr);
+        }
+    }
+
+    cairo_restore(cr);
 }
 #endif
 
@@ -137,14 +146,31 @@ bool Ellipse::contains(const QPointF &point) const
     return normalizedDistance <= 1.0;
 }
 
+QPolygonF Ellipse::getOutline() const
+{
+    // The whole ellipse even for arcs and pies, which lie inside it
+    const int segments = 32;
+    const QRectF bounds = getBoundingRect();
+    const QPointF center = bounds.center();
+    const double radiusX = bounds.width() / 2.0;
+    const double radiusY = bounds.height() / 2.0;
+
+    QPolygonF points;
+    points.reserve(segments);
+    for (int i = 0; i < segments; ++i) {
+        const double angle = 2.0 * M_PI * i / segments;
+        points << QPointF(center.x() + radiusX * std::cos(angle), center.y() + radiusY * std::sin(angle));
+    }
+    return asDrawn(points);
+}
+
 // =========================
 // Clone
 // =========================
 Ellipse* Ellipse::clone() const
 {
     Ellipse *clone = new Ellipse(getPosition(), getSize());
-    clone->setPen(getPen());
-    clone->setBrush(getBrush());
+    clone->setStyle(getStyle());
     clone->setVisible(isVisible());
     clone->setStartAngle(m_startAngle);
     clone->setEndAngle(m_endAngle);
@@ -1,4 +1,5 @@
 #include "line.h"
+#include "snapindex.h"
 #include <QLineF>
 #include <QPainter>
 #include <cmath>
@@ -52,12 +53,13 @@ void Line::draw(cairo_t *cr)
 {
     if (!isVisible() || !cr) return;
 
-    QPen pen = getPen();
+    const QPen &pen = getPen();
     if (pen.style() != Qt::NoPen) {
         cairo_save(cr);
+        rotateContext(cr);
 
-        cairo_move_to(cr, m_startPoint.x(), m_startPoint.y());
-        cairo_line_to(cr, m_endPoint.x(), m_endPoint.y());
+        cairo_new_path(cr);
+        buildPath(cr);
 
         QColor strokeColor = pen.color();
         cairo_set_source_rgba(cr, strokeColor.redF(), strokeColor.greenF(), strokeColor.blueF(), strokeColor.alphaF());
@@ -67,11 +69,31 @@ void Line::draw(cairo_t *cr)
         cairo_restore(cr);
     }
 }
+
+bool Line::buildPath(cairo_t *cr) const
+{
+    cairo_move_to(cr, m_startPoint.x(), m_startPoint.y());
+    cairo_line_to(cr, m_endPoint.x(), m_endPoint.y());
+    return true;
+}
 #endif
 
 // ====================
 // Hit Testing
 // ====================
+QPolygonF Line::getOutline() const
+{
+    return asDrawn(QPolygonF({ m_startPoint, m_endPoint }));
+}
+
+void Line::getSnapPoints(std::vector<SnapPoint> &points) const
+{
+    const QPolygonF ends = asDrawn(QPolygonF({ m_startPoint, m_endPoint }));
+    points.push_back({ ends[0], SnapPoint::Endpoint });
+    points.push_back({ ends[1], SnapPoint::Endpoint });
+    points.push_back({ (ends[0] + ends[1]) / 2.0, SnapPoint::Midpoint });
+}
+
 bool Line::contains(const QPointF &point) const
 {
     const double tolerance = 5.0;
@@ -99,36 +121,72 @@ bool Line::contains(const QPointF &point) const
 Line* Line::clone() const
 {
     Line *clone = new Line(m_startPoint, m_endPoint);
-    clone->setPen(getPen());
-    clone->setBrush(getBrush());
+    clone->setStyle(getStyle());
     clone->setVisible(isVisible());
     clone->setLineWidth(m_lineWidth);
     return clone;
 }
 
 // ====================
-// Setters & Getters
+// Transformations
 // ====================
-void Line::setStartPoint(const QPointF &point)
+void Line::move(const QPointF &offset)
 {
-    m_startPoint = point;
+    m_startPoint += offset;
+    m_endPoint += offset;
+    Shape::move(offset);
+}
+
+void Line::scale(double factor)
+{
+    QPointF center = (m_startPoint + m_endPoint) / 2.0;
+    m_startPoint = center + (m_startPoint - center) * factor;
+    m_endPoint = center + (m_endPoint - center) * factor;
+    updateBounds();
+}
 
+void Line::updateBounds()
+{
+    storeBounds();
+    geometryChanged();
+}
+
+void Line::storeBounds()
+{
     QPointF minPoint(qMin(m_startPoint.x(), m_endPoint.x()), qMin(m_startPoint.y(), m_endPoint.y()));
     QPointF maxPoint(qMax(m_startPoint.x(), m_endPoint.x()), qMax(m_startPoint.y(), m_endPoint.y()));
 
-    setPosition(minPoint);
-    setSize(QSizeF(maxPoint.x() - minPoint.x(), maxPoint.y() - minPoint.y()));
+    m_position = minPoint;
+    m_size = QSizeF(maxPoint.x() - minPoint.x(), maxPoint.y() - minPoint.y());
 }
 
-void Line::setEndPoint(const QPointF &point)
+void Line::gatherPoints(std::vector<QPointF> &points) const
 {
-    m_endPoint = point;
+    points.push_back(m_startPoint);
+    points.push_back(m_endPoint);
+}
 
-    QPointF minPoint(qMin(m_startPoint.x(), m_endPoint.x()), qMin(m_startPoint.y(), m_endPoint.y()));
-    QPointF maxPoint(qMax(m_startPoint.x(), m_endPoint.x()), qMax(m_startPoint.y(), m_endPoint.y()));
+void Line::scatterPoints(const QPointF *points, const AffineKernel::Parts &parts)
+{
+    Q_UNUSED(parts)
+    m_startPoint = points[0];
+    m_endPoint = points[1];
+    storeBounds();
+}
 
-    setPosition(minPoint);
-    setSize(QSizeF(maxPoint.x() - minPoint.x(), maxPoint.y() - minPoint.y()));
+// ====================
+// Setters & Getters
+// ====================
+void Line::setStartPoint(const QPointF &point)
+{
+    m_startPoint = point;
+    updateBounds();
+}
+
+void Line::setEndPoint(const QPointF &point)
+{
+    m_endPoint = point;
+    updateBounds();
 }
 
 QPointF Line::getStartPoint() const { return m_startPoint; }
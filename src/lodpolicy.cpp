@@ -0,0 +1,107 @@
+#include "lodpolicy.h"
+#include "shape.h"
+#include "bezier.h"
+#include "batchrenderer.h"
+#include <QColor>
+
+namespace {
+
+// Colour a reduced shape is drawn in: its fill if it has one, else its
+// outline; invalid when it would draw nothing
+QColor reducedColor(const Shape *shape)
+{
+    const QBrush &brush = shape->getBrush();
+    if (brush.style() != Qt::NoBrush) return brush.color();
+    const QPen &pen = shape->getPen();
+    if (pen.style() != Qt::NoPen) return pen.color();
+    return QColor();
+}
+
+bool hasArea(const Shape *shape)
+{
+    if (shape->getBrush().style() == Qt::NoBrush) return false;
+    switch (shape->getType()) {
+    case Shape::Rectangle:
+    case Shape::Ellipse:
+        return true;
+    case Shape::Bezier:
+        return static_cast<const Bezier*>(shape)->isClosed();
+    default:
+        return false;
+    }
+}
+
+} // namespace
+
+LodPolicy::Level LodPolicy::classify(const Shape *shape, double zoom) const
+{
+    // Text has no Cairo drawing of its own; leave it to Shape::draw
+    if (!enabled || shape->getType() == Shape::Text) return Full;
+
+    const QRectF bounds = shape->getIndexBounds();
+    const double extent = qMax(bounds.width(), bounds.height()) * zoom;
+
+    if (extent < skipBelow) return Skip;
+    if (extent < pointBelow) return Point;
+    if (extent < outlineBelow && hasArea(shape)) return Box;
+    return Full;
+}
+
+double LodPolicy::flatteningTolerance(double zoom) const
+{
+    if (!enabled || zoom >= 1.0) return tolerance;
+    return qMin(tolerance / zoom, maxTolerance);
+}
+
+bool LodPolicy::operator==(const LodPolicy &other) const
+{
+    return enabled == other.enabled
+        && skipBelow == other.skipBelow
+        && pointBelow == other.pointBelow
+        && outlineBelow == other.outlineBelow
+        && tolerance == other.tolerance
+        && maxTolerance == other.maxTolerance;
+}
+
+#ifdef ENABLE_CAIRO
+LodPolicy::Counts LodPolicy::draw(BatchRenderer &renderer, const QList<Shape*> &shapes, double zoom) const
+{
+    Counts counts;
+    const double pixel = 1.0 / zoom;
+
+    renderer.flush();
+    cairo_set_tolerance(renderer.context(), flatteningTolerance(zoom));
+
+    for (Shape *shape : shapes) {
+        if (!shape->isVisible()) continue;
+
+        const Level level = classify(shape, zoom);
+        if (level == Full) {
+            renderer.draw(shape);
+            ++counts.full;
+            continue;
+        }
+        if (level == Skip) {
+            ++counts.skipped;
+            continue;
+        }
+
+        const QColor color = reducedColor(shape);
+        if (!color.isValid()) {
+            ++counts.skipped;
+            continue;
+        }
+
+        const QRectF bounds = shape->getIndexBounds();
+        if (level == Point) {
+            const QPointF center = bounds.center();
+            renderer.fillRect(QRectF(center.x() - pixel * 0.5, center.y() - pixel * 0.5, pixel, pixel), color);
+        } else {
+            renderer.fillRect(bounds, color);
+        }
+        ++counts.reduced;
+    }
+
+    return counts;
+}
+#endif
@@ -1,10 +1,12 @@
 #include "mainwindow.h"
 #include "ui_mainwindow.h"
+#include "nativeformat.h"
 #include <QInputDialog>
 #include <QApplication>
 #include <QStyleFactory>
 #include <QMessageBox>
 #include <QFileDialog>
+#include <QFileInfo>
 #include <QColorDialog>
 #include <QSpinBox>
 #include <QPushButton>
@@ -100,14 +102,6 @@ void MainWindow::setupUI()
     darkPalette.setColor(QPalette::Highlight, QColor(74, 144, 226));
     darkPalette.setColor(QPalette::HighlightedText, Qt::black);
     qApp->setPalette(darkPalette);
-
-#ifdef ENABLE_CAIRO
-    if (m_canvas) {
-        m_canvas->createCairoSurface();
-    } else {
-        qDebug() << "Failed to initialize canvas";
-    }
-#endif
 }
 
 void MainWindow::setupStatusBar()
@@ -132,6 +126,10 @@ void MainWindow::setupActions()
     connect(ui->actionCut, &QAction::triggered, this, &MainWindow::cut);
     connect(ui->actionCopy, &QAction::triggered, this, &MainWindow::copy);
     connect(ui->actionPaste, &QAction::triggered, this, &MainWindow::paste);
+    connect(ui->actionBring_to_Front, &QAction::triggered, this, &MainWindow::bringToFront);
+    connect(ui->actionBring_Forward, &QAction::triggered, this, &MainWindow::bringForward);
+    connect(ui->actionSend_Backward, &QAction::triggered, this, &MainWindow::sendBackward);
+    connect(ui->actionSend_to_Back, &QAction::triggered, this, &MainWindow::sendToBack);
     connect(ui->actionDelete, &QAction::triggered, this, [this]() {
         if (m_canvas) {
             QKeyEvent delEvent(QEvent::KeyPress, Qt::Key_Delete, Qt::NoModifier);
@@ -145,6 +143,7 @@ void MainWindow::setupActions()
     connect(ui->actionFit_to_View, &QAction::triggered, this, &MainWindow::fitToView);
     connect(ui->actionShow_Grid, &QAction::triggered, this, &MainWindow::showGrid);
     connect(ui->actionSnap_to_Grid, &QAction::triggered, this, &MainWindow::snapToGrid);
+    connect(ui->actionSnap_to_Objects, &QAction::toggled, this, &MainWindow::snapToObjects);
 
     // Tools
     connect(ui->actionSelect, &QAction::triggered, this, &MainWindow::selectTool);
@@ -195,6 +194,7 @@ void MainWindow::setupMenusAndToolbars()
     viewMenu->addSeparator();
     viewMenu->addAction(ui->actionShow_Grid);
     viewMenu->addAction(ui->actionSnap_to_Grid);
+    viewMenu->addAction(ui->actionSnap_to_Objects);
     viewMenu->addSeparator();
     viewMenu->addAction(ui->actionShow_Rulers);
     viewMenu->addAction(ui->actionShow_Guides);
@@ -279,18 +279,35 @@ void MainWindow::newDocument()
 
 void MainWindow::openDocument()
 {
-    QString filename = QFileDialog::getOpenFileName(this, "Open Document", "", "SVG Files (*.svg);;All Files (*)");
+    QString filename = QFileDialog::getOpenFileName(this, "Open Document", "",
+        "Vector Documents (*.vgd);;SVG Files (*.svg);;All Files (*)");
     if (!filename.isEmpty() && m_canvas) {
-        m_canvas->loadSVG(filename);
+        if (QFileInfo(filename).suffix().compare("svg", Qt::CaseInsensitive) == 0) {
+            m_canvas->loadSVG(filename);
+        } else if (!m_canvas->loadDocument(filename)) {
+            statusBar()->showMessage("Could not open: " + filename, 2000);
+            return;
+        }
+        updateLayersList();
         statusBar()->showMessage("Opened: " + filename, 2000);
     }
 }
 
 void MainWindow::saveDocument()
 {
-    QString filename = QFileDialog::getSaveFileName(this, "Save Document", "", "SVG Files (*.svg);;All Files (*)");
+    QString filename = QFileDialog::getSaveFileName(this, "Save Document", "",
+        "Vector Documents (*.vgd);;SVG Files (*.svg);;All Files (*)");
     if (!filename.isEmpty() && m_canvas) {
-        m_canvas->saveSVG(filename);
+        const QString suffix = QFileInfo(filename).suffix();
+        if (suffix.compare("svg", Qt::CaseInsensitive) == 0) {
+            m_canvas->saveSVG(filename);
+        } else {
+            if (suffix.isEmpty()) filename += QString(".") + NativeFormat::Suffix;
+            if (!m_canvas->saveDocument(filename)) {
+                statusBar()->showMessage("Could not save: " + filename, 2000);
+                return;
+            }
+        }
         statusBar()->showMessage("Saved: " + filename, 2000);
     }
 }
@@ -355,6 +372,38 @@ void MainWindow::paste()
     }
 }
 
+void MainWindow::bringToFront()
+{
+    if (m_canvas) {
+        m_canvas->bringToFront();
+        statusBar()->showMessage("Bring to front", 1000);
+    }
+}
+
+void MainWindow::bringForward()
+{
+    if (m_canvas) {
+        m_canvas->bringForward();
+        statusBar()->showMessage("Bring forward", 1000);
+    }
+}
+
+void MainWindow::sendBackward()
+{
+    if (m_canvas) {
+        m_canvas->sendBackward();
+        statusBar()->showMessage("Send backward", 1000);
+    }
+}
+
+void MainWindow::sendToBack()
+{
+    if (m_canvas) {
+        m_canvas->sendToBack();
+        statusBar()->showMessage("Send to back", 1000);
+    }
+}
+
 void MainWindow::selectTool()
 {
     if (m_canvas) {
@@ -470,6 +519,14 @@ void MainWindow::snapToGrid()
     }
 }
 
+void MainWindow::snapToObjects(bool enabled)
+{
+    if (m_canvas) {
+        m_canvas->setSnapToObjects(enabled);
+        statusBar()->showMessage(enabled ? "Snap to objects on" : "Snap to objects off", 1000);
+    }
+}
+
 void MainWindow::addLayer()
 {
     QString layerName = QString("Layer %1").arg(m_document->getLayers().size() + 1);
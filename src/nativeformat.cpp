@@ -0,0 +1,561 @@
+#include "nativeformat.h"
+#include "document.h"
+#include "rectangle.h"
+#include "ellipse.h"
+#include "line.h"
+#include "bezier.h"
+#include "text.h"
+#include "styletable.h"
+#include <QFile>
+#include <QDebug>
+#include <cstring>
+#include <functional>
+#include <memory>
+#include <string_view>
+#include <tuple>
+#include <unordered_map>
+#include <vector>
+
+// ========================
+// File layout
+// ========================
+namespace {
+
+constexpr char Magic[4] = { 'V', 'G', 'D', 'F' };
+constexpr quint32 ByteOrderMark = 0x01020304;
+constexpr quint32 Version = 1;
+
+struct FileHeader {
+    char magic[4];
+    quint32 byteOrder;
+    quint32 version;
+    quint32 headerSize;
+    double width;
+    double height;
+    quint64 background;         // QRgba64
+    qint32 activeLayer;         // -1: none
+    quint32 layerCount;
+    quint32 styleCount;
+    quint32 reserved;
+    quint64 shapeCount;
+    quint64 pointCount;
+    quint64 stringBytes;
+    quint64 styleOffset;
+    quint64 layerOffset;
+    quint64 shapeOffset;
+    quint64 pointOffset;
+    quint64 stringOffset;
+};
+
+// No implicit padding: the raw bytes double as the deduplication key
+struct StyleRecord {
+    quint64 penColor;           // QRgba64
+    quint64 brushColor;         // QRgba64
+    double penWidth;
+    double miterLimit;
+    quint16 penStyle;
+    quint16 capStyle;
+    quint16 joinStyle;
+    quint8 cosmetic;
+    quint8 brushStyle;
+};
+
+struct LayerRecord {
+    quint64 shapeCount;         // Records that follow for this layer
+    quint32 nameOffset;
+    quint32 nameLength;
+    quint8 visible;
+    quint8 locked;
+    quint8 reserved[6];
+};
+
+// Every shape record starts with this, followed by its type's payload
+struct ShapeRecord {
+    quint8 type;                // Shape::Type
+    quint8 flags;
+    quint16 reserved;
+    quint32 style;
+    double rotation;
+};
+
+enum ShapeFlags : quint8 {
+    VisibleFlag = 0x01,
+    ClosedFlag = 0x02           // Bezier
+};
+
+struct RectanglePayload { double x, y, width, height, cornerRadius; };
+struct EllipsePayload { double x, y, width, height, startAngle, endAngle; };
+struct LinePayload { double x1, y1, x2, y2, lineWidth; };
+struct BezierPayload { quint64 firstPoint, pointCount; };
+struct TextPayload { double x, y, width, height; quint32 textOffset, textLength; };
+struct PointRecord { double x, y; };
+
+static_assert(sizeof(FileHeader) == 120, "FileHeader layout");
+static_assert(sizeof(StyleRecord) == 40, "StyleRecord layout");
+static_assert(sizeof(LayerRecord) == 24, "LayerRecord layout");
+static_assert(sizeof(ShapeRecord) == 16, "ShapeRecord layout");
+
+size_t payloadSize(int type)
+{
+    switch (type) {
+    case Shape::Rectangle: return sizeof(RectanglePayload);
+    case Shape::Ellipse:   return sizeof(EllipsePayload);
+    case Shape::Line:      return sizeof(LinePayload);
+    case Shape::Bezier:    return sizeof(BezierPayload);
+    case Shape::Text:      return sizeof(TextPayload);
+    }
+    return 0;
+}
+
+template <typename T>
+T readRecord(const uchar *data)
+{
+    T record;
+    std::memcpy(&record, data, sizeof(T));
+    return record;
+}
+
+// ========================
+// Styles
+// ========================
+// Only what the editor creates is kept: solid or patterned colours and
+// the stroke parameters. Gradient/texture brushes and custom dash
+// patterns fall back to solid.
+StyleRecord makeStyle(const QPen &pen, const QBrush &brush)
+{
+    StyleRecord record;
+    std::memset(&record, 0, sizeof record);
+
+    record.penColor = pen.color().rgba64();
+    record.brushColor = brush.color().rgba64();
+    record.penWidth = pen.widthF();
+    record.miterLimit = pen.miterLimit();
+    record.penStyle = quint16(pen.style() == Qt::CustomDashLine ? Qt::SolidLine : pen.style());
+    record.capStyle = quint16(pen.capStyle());
+    record.joinStyle = quint16(pen.joinStyle());
+    record.cosmetic = pen.isCosmetic() ? 1 : 0;
+    record.brushStyle = quint8(brush.style() >= Qt::LinearGradientPattern ? Qt::SolidPattern : brush.style());
+    return record;
+}
+
+QPen penFromStyle(const StyleRecord &record)
+{
+    QPen pen(QColor(QRgba64::fromRgba64(record.penColor)));
+    pen.setWidthF(record.penWidth);
+    pen.setMiterLimit(record.miterLimit);
+    pen.setStyle(Qt::PenStyle(record.penStyle));
+    pen.setCapStyle(Qt::PenCapStyle(record.capStyle));
+    pen.setJoinStyle(Qt::PenJoinStyle(record.joinStyle));
+    pen.setCosmetic(record.cosmetic != 0);
+    return pen;
+}
+
+QBrush brushFromStyle(const StyleRecord &record)
+{
+    return QBrush(QColor(QRgba64::fromRgba64(record.brushColor)), Qt::BrushStyle(record.brushStyle));
+}
+
+struct StyleHash {
+    size_t operator()(const StyleRecord &record) const {
+        return std::hash<std::string_view>()(
+            std::string_view(reinterpret_cast<const char*>(&record), sizeof record));
+    }
+};
+
+struct StyleEqual {
+    bool operator()(const StyleRecord &a, const StyleRecord &b) const {
+        return std::memcmp(&a, &b, sizeof a) == 0;
+    }
+};
+
+// ========================
+// Output
+// ========================
+// Sections stream through one fixed buffer into an unbuffered file
+class RecordWriter
+{
+public:
+    explicit RecordWriter(QFile *file)
+        : m_file(file), m_buffer(new char[BufferSize]), m_used(0), m_error(false) {}
+
+    template <typename T>
+    void write(const T &record) { write(&record, sizeof(T)); }
+
+    void write(const void *data, size_t size)
+    {
+        const char *bytes = static_cast<const char*>(data);
+        while (size > 0) {
+            if (m_used == BufferSize) flush();
+            const size_t count = qMin(size, BufferSize - m_used);
+            std::memcpy(m_buffer.get() + m_used, bytes, count);
+            m_used += count;
+            bytes += count;
+            size -= count;
+        }
+    }
+
+    bool flush()
+    {
+        if (m_used > 0 && !m_error) {
+            m_error = m_file->write(m_buffer.get(), qint64(m_used)) != qint64(m_used);
+        }
+        m_used = 0;
+        return !m_error;
+    }
+
+private:
+    static constexpr size_t BufferSize = 64 * 1024;
+
+    QFile *m_file;
+    std::unique_ptr<char[]> m_buffer;
+    size_t m_used;
+    bool m_error;
+};
+
+} // namespace
+
+// ========================
+// Save
+// ========================
+bool NativeFormat::save(const Document *document, const QString &filename)
+{
+    if (!document) return false;
+
+    const QList<Layer*> layers = document->getLayers();
+
+    // First pass: style table, layer table, string pool and section sizes
+    std::vector<StyleRecord> styles;
+    std::unordered_map<StyleRecord, quint32, StyleHash, StyleEqual> styleIndex;
+    std::unordered_map<quint32, quint32> recordForStyle;   // StyleTable index -> record
+    std::vector<quint32> shapeStyles;
+    std::vector<LayerRecord> layerRecords;
+    std::vector<std::pair<quint32, quint32>> textRanges;
+    QByteArray strings;
+    quint64 shapeCount = 0;
+    quint64 shapeBytes = 0;
+    quint64 pointCount = 0;
+
+    auto addString = [&strings](const QString &text) {
+        const QByteArray utf8 = text.toUtf8();
+        std::pair<quint32, quint32> range(quint32(strings.size()), quint32(utf8.size()));
+        strings.append(utf8);
+        return range;
+    };
+
+    for (Layer *layer : layers) {
+        const QList<Shape*> shapes = layer->getShapes();
+
+        LayerRecord record;
+        std::memset(&record, 0, sizeof record);
+        std::tie(record.nameOffset, record.nameLength) = addString(layer->getName());
+        record.shapeCount = quint64(shapes.size());
+        record.visible = layer->isVisible() ? 1 : 0;
+        record.locked = layer->isLocked() ? 1 : 0;
+        layerRecords.push_back(record);
+
+        for (Shape *shape : shapes) {
+            // Shapes sharing a StyleTable entry share the record without
+            // it being rebuilt; the record map catches pairs that only
+            // became equal through the fallbacks above
+            auto known = recordForStyle.find(shape->getStyle());
+            if (known == recordForStyle.end()) {
+                const StyleRecord style = makeStyle(shape->getPen(), shape->getBrush());
+                auto it = styleIndex.find(style);
+                if (it == styleIndex.end()) {
+                    it = styleIndex.emplace(style, quint32(styles.size())).first;
+                    styles.push_back(style);
+                }
+                known = recordForStyle.emplace(shape->getStyle(), it->second).first;
+            }
+            shapeStyles.push_back(known->second);
+
+            shapeBytes += sizeof(ShapeRecord) + payloadSize(shape->getType());
+            if (shape->getType() == Shape::Bezier) {
+                pointCount += quint64(static_cast<const Bezier*>(shape)->getPointCount());
+            } else if (shape->getType() == Shape::Text) {
+                textRanges.push_back(addString(static_cast<const Text*>(shape)->getText()));
+            }
+            ++shapeCount;
+        }
+    }
+
+    FileHeader header;
+    std::memset(&header, 0, sizeof header);
+    std::memcpy(header.magic, Magic, sizeof Magic);
+    header.byteOrder = ByteOrderMark;
+    header.version = Version;
+    header.headerSize = sizeof(FileHeader);
+    header.width = document->getSize().width();
+    header.height = document->getSize().height();
+    header.background = document->getBackgroundColor().rgba64();
+    header.activeLayer = qint32(layers.indexOf(document->getActiveLayer()));
+    header.layerCount = quint32(layers.size());
+    header.styleCount = quint32(styles.size());
+    header.shapeCount = shapeCount;
+    header.pointCount = pointCount;
+    header.stringBytes = quint64(strings.size());
+    header.styleOffset = sizeof(FileHeader);
+    header.layerOffset = header.styleOffset + styles.size() * sizeof(StyleRecord);
+    header.shapeOffset = header.layerOffset + layerRecords.size() * sizeof(LayerRecord);
+    header.pointOffset = header.shapeOffset + shapeBytes;
+    header.stringOffset = header.pointOffset + pointCount * sizeof(PointRecord);
+
+    QFile file(filename);
+    if (!file.open(QIODevice::WriteOnly | QIODevice::Truncate | QIODevice::Unbuffered)) {
+        qDebug() << "Failed to create document file:" << filename;
+        return false;
+    }
+
+    RecordWriter out(&file);
+    out.write(header);
+    out.write(styles.data(), styles.size() * sizeof(StyleRecord));
+    out.write(layerRecords.data(), layerRecords.size() * sizeof(LayerRecord));
+
+    // Second pass: shape records, in the same order as above
+    size_t shapeIndex = 0;
+    size_t textIndex = 0;
+    quint64 firstPoint = 0;
+    for (Layer *layer : layers) {
+        for (Shape *shape : layer->getShapes()) {
+            ShapeRecord record;
+            std::memset(&record, 0, sizeof record);
+            record.type = quint8(shape->getType());
+            record.style = shapeStyles[shapeIndex++];
+            record.rotation = shape->getRotation();
+            if (shape->isVisible()) record.flags |= VisibleFlag;
+
+            const QPointF pos = shape->getPosition();
+            const QSizeF size = shape->getSize();
+
+            switch (shape->getType()) {
+            case Shape::Rectangle: {
+                const Rectangle *rect = static_cast<const Rectangle*>(shape);
+                out.write(record);
+                out.write(RectanglePayload{ pos.x(), pos.y(), size.width(), size.height(),
+                                            rect->getCornerRadius() });
+                break;
+            }
+            case Shape::Ellipse: {
+                const Ellipse *ellipse = static_cast<const Ellipse*>(shape);
+                out.write(record);
+                out.write(EllipsePayload{ pos.x(), pos.y(), size.width(), size.height(),
+                                          ellipse->getStartAngle(), ellipse->getEndAngle() });
+                break;
+            }
+            case Shape::Line: {
+                const Line *line = static_cast<const Line*>(shape);
+                const QPointF start = line->getStartPoint();
+                const QPointF end = line->getEndPoint();
+                out.write(record);
+                out.write(LinePayload{ start.x(), start.y(), end.x(), end.y(), line->getLineWidth() });
+                break;
+            }
+            case Shape::Bezier: {
+                const Bezier *bezier = static_cast<const Bezier*>(shape);
+                if (bezier->isClosed()) record.flags |= ClosedFlag;
+                const quint64 count = quint64(bezier->getPointCount());
+                out.write(record);
+                out.write(BezierPayload{ firstPoint, count });
+                firstPoint += count;
+                break;
+            }
+            case Shape::Text: {
+                const std::pair<quint32, quint32> range = textRanges[textIndex++];
+                out.write(record);
+                out.write(TextPayload{ pos.x(), pos.y(), size.width(), size.height(),
+                                       range.first, range.second });
+                break;
+            }
+            }
+        }
+    }
+
+    // Third pass: the Bezier point pool
+    for (Layer *layer : layers) {
+        for (Shape *shape : layer->getShapes()) {
+            if (shape->getType() != Shape::Bezier) continue;
+            const Bezier *bezier = static_cast<const Bezier*>(shape);
+            for (int i = 0; i < bezier->getPointCount(); ++i) {
+                const QPointF point = bezier->getPoint(i);
+                out.write(PointRecord{ point.x(), point.y() });
+            }
+        }
+    }
+
+    out.write(strings.constData(), size_t(strings.size()));
+
+    if (!out.flush()) {
+        qDebug() << "Failed to write document file:" << filename;
+        return false;
+    }
+    return true;
+}
+
+// ========================
+// Load
+// ========================
+bool NativeFormat::load(Document *document, const QString &filename)
+{
+    if (!document) return false;
+
+    QFile file(filename);
+    if (!file.open(QIODevice::ReadOnly)) {
+        qDebug() << "Failed to open document file:" << filename;
+        return false;
+    }
+
+    const quint64 fileSize = quint64(file.size());
+    const uchar *data = fileSize >= sizeof(FileHeader) ? file.map(0, file.size()) : nullptr;
+    if (!data) {
+        qDebug() << "Not a vector document:" << filename;
+        return false;
+    }
+
+    const FileHeader header = readRecord<FileHeader>(data);
+    if (std::memcmp(header.magic, Magic, sizeof Magic) != 0 || header.byteOrder != ByteOrderMark
+        || header.version != Version || header.headerSize != sizeof(FileHeader)) {
+        qDebug() << "Unsupported document format:" << filename;
+        return false;
+    }
+
+    // Every section must lie inside the mapping before anything is read
+    auto fits = [fileSize](quint64 offset, quint64 count, quint64 recordSize) {
+        return offset <= fileSize && count <= (fileSize - offset) / recordSize;
+    };
+    if (!fits(header.styleOffset, header.styleCount, sizeof(StyleRecord))
+        || !fits(header.layerOffset, header.layerCount, sizeof(LayerRecord))
+        || !fits(header.shapeOffset, 0, 1)
+        || !fits(header.pointOffset, header.pointCount, sizeof(PointRecord))
+        || !fits(header.stringOffset, header.stringBytes, 1)) {
+        qDebug() << "Corrupt document file:" << filename;
+        return false;
+    }
+
+    // Interned once per record; shapes then just take the index
+    std::vector<StyleRef> styles;
+    styles.reserve(header.styleCount);
+    for (quint32 i = 0; i < header.styleCount; ++i) {
+        const StyleRecord record = readRecord<StyleRecord>(data + header.styleOffset + i * sizeof(StyleRecord));
+        styles.push_back(StyleTable::instance().intern(penFromStyle(record), brushFromStyle(record)));
+    }
+
+    auto readString = [&](quint32 offset, quint32 length, QString &text) {
+        if (quint64(offset) + length > header.stringBytes) return false;
+        text = QString::fromUtf8(reinterpret_cast<const char*>(data + header.stringOffset + offset),
+                                 int(length));
+        return true;
+    };
+
+    // Build everything off to the side; the document is only touched once
+    // the file has been read completely.
+    QList<Layer*> layers;
+    QList<Shape*> shapes;
+    quint64 cursor = header.shapeOffset;
+    quint64 shapesRead = 0;
+
+    auto fail = [&]() {
+        qDebug() << "Corrupt document file:" << filename;
+        qDeleteAll(shapes);
+        qDeleteAll(layers);
+        return false;
+    };
+
+    for (quint32 l = 0; l < header.layerCount; ++l) {
+        const LayerRecord layerRecord = readRecord<LayerRecord>(data + header.layerOffset + l * sizeof(LayerRecord));
+        QString name;
+        if (!readString(layerRecord.nameOffset, layerRecord.nameLength, name)) return fail();
+
+        Layer *layer = new Layer(name);
+        layer->setVisible(layerRecord.visible != 0);
+        layer->setLocked(layerRecord.locked != 0);
+        layers.append(layer);
+
+        for (quint64 s = 0; s < layerRecord.shapeCount; ++s) {
+            if (!fits(cursor, 1, sizeof(ShapeRecord))) return fail();
+            const ShapeRecord record = readRecord<ShapeRecord>(data + cursor);
+            const size_t payload = payloadSize(record.type);
+            if (payload == 0 || record.style >= header.styleCount
+                || !fits(cursor + sizeof(ShapeRecord), 1, payload)) {
+                return fail();
+            }
+            const uchar *body = data + cursor + sizeof(ShapeRecord);
+            cursor += sizeof(ShapeRecord) + payload;
+
+            Shape *shape = nullptr;
+            switch (record.type) {
+            case Shape::Rectangle: {
+                const RectanglePayload p = readRecord<RectanglePayload>(body);
+                Rectangle *rect = new Rectangle(QPointF(p.x, p.y), QSizeF(p.width, p.height));
+                rect->setCornerRadius(p.cornerRadius);
+                shape = rect;
+                break;
+            }
+            case Shape::Ellipse: {
+                const EllipsePayload p = readRecord<EllipsePayload>(body);
+                Ellipse *ellipse = new Ellipse(QPointF(p.x, p.y), QSizeF(p.width, p.height));
+                ellipse->setStartAngle(p.startAngle);
+                ellipse->setEndAngle(p.endAngle);
+                shape = ellipse;
+                break;
+            }
+            case Shape::Line: {
+                const LinePayload p = readRecord<LinePayload>(body);
+                Line *line = new Line(QPointF(p.x1, p.y1), QPointF(p.x2, p.y2));
+                line->setLineWidth(p.lineWidth);
+                shape = line;
+                break;
+            }
+            case Shape::Bezier: {
+                const BezierPayload p = readRecord<BezierPayload>(body);
+                if (p.firstPoint > header.pointCount || p.pointCount > header.pointCount - p.firstPoint) {
+                    return fail();
+                }
+                Bezier *bezier = new Bezier();
+                const uchar *points = data + header.pointOffset + p.firstPoint * sizeof(PointRecord);
+                for (quint64 i = 0; i < p.pointCount; ++i) {
+                    const PointRecord point = readRecord<PointRecord>(points + i * sizeof(PointRecord));
+                    bezier->addPoint(QPointF(point.x, point.y));
+                }
+                bezier->setClosed((record.flags & ClosedFlag) != 0);
+                shape = bezier;
+                break;
+            }
+            case Shape::Text: {
+                const TextPayload p = readRecord<TextPayload>(body);
+                QString text;
+                if (!readString(p.textOffset, p.textLength, text)) return fail();
+                Text *item = new Text();
+                item->setText(text);
+                item->setPosition(QPointF(p.x, p.y));
+                item->setSize(QSizeF(p.width, p.height));
+                shape = item;
+                break;
+            }
+            }
+
+            shape->setStyle(styles[record.style]);
+            if (record.rotation != 0.0) shape->rotate(record.rotation);
+            shape->setVisible((record.flags & VisibleFlag) != 0);
+            shapes.append(shape);
+        }
+
+        shapesRead += layerRecord.shapeCount;
+        layer->addShapes(shapes);
+        shapes.clear();
+    }
+
+    if (shapesRead != header.shapeCount || cursor != header.pointOffset) return fail();
+
+    document->clear();
+    for (Layer *layer : layers) {
+        document->addLayer(layer);
+    }
+    if (header.activeLayer >= 0 && header.activeLayer < layers.size()) {
+        document->setActiveLayer(layers[header.activeLayer]);
+    } else if (!layers.isEmpty()) {
+        document->setActiveLayer(layers.first());
+    }
+    document->setSize(QSizeF(header.width, header.height));
+    document->setBackgroundColor(QColor(QRgba64::fromRgba64(header.background)));
+    return true;
+}
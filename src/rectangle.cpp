@@ -55,61 +55,51 @@ void Rectangle::draw(cairo_t *cr)
 {
     if (!isVisible() || !cr) return;
 
-    QPointF pos = getPosition();
-    QSizeF size = getSize();
-    QPen pen = getPen();
-    QBrush brush = getBrush();
+    const QPen &pen = getPen();
+    const QBrush &brush = getBrush();
+    if (brush.style() == Qt::NoBrush && pen.style() == Qt::NoPen) return;
+
+    cairo_save(cr);
+    rotateContext(cr);
+    cairo_new_path(cr);
+    buildPath(cr);
 
     // Fill
     if (brush.style() != Qt::NoBrush) {
-        cairo_save(cr);
-
-        if (m_cornerRadius > 0.0) {
-            double x = pos.x(), y = pos.y();
-            double w = size.width(), h = size.height();
-            double r = m_cornerRadius;
-
-            cairo_new_sub_path(cr);
-            cairo_arc(cr, x + r, y + r, r, M_PI, 3 * M_PI / 2);
-            cairo_arc(cr, x + w - r, y + r, r, 3 * M_PI / 2, 0);
-            cairo_arc(cr, x + w - r, y + h - r, r, 0, M_PI / 2);
-            cairo_arc(cr, x + r, y + h - r, r, M_PI / 2, M_PI);
-            cairo_close_path(cr);
-        } else {
-            cairo_rectangle(cr, pos.x(), pos.y(), size.width(), size.height());
-        }
-
         QColor fillColor = brush.color();
         cairo_set_source_rgba(cr, fillColor.redF(), fillColor.greenF(), fillColor.blueF(), fillColor.alphaF());
         cairo_fill_preserve(cr);
-        cairo_restore(cr);
     }
 
     // Stroke
     if (pen.style() != Qt::NoPen) {
-        cairo_save(cr);
-
-        if (m_cornerRadius > 0.0) {
-            double x = pos.x(), y = pos.y();
-            double w = size.width(), h = size.height();
-            double r = m_cornerRadius;
-
-            cairo_new_sub_path(cr);
-            cairo_arc(cr, x + r, y + r, r, M_PI, 3 * M_PI / 2);
-            cairo_arc(cr, x + w - r, y + r, r, 3 * M_PI / 2, 0);
-            cairo_arc(cr, x + w - r, y + h - r, r, 0, M_PI / 2);
-            cairo_arc(cr, x + r, y + h - r, r, M_PI / 2, M_PI);
-            cairo_close_path(cr);
-        } else {
-            cairo_rectangle(cr, pos.x(), pos.y(), size.width(), size.height());
-        }
-
         QColor strokeColor = pen.color();
         cairo_set_source_rgba(cr, strokeColor.redF(), strokeColor.greenF(), strokeColor.blueF(), strokeColor.alphaF());
         cairo_set_line_width(cr, pen.widthF());
-        cairo_stroke(cr);
-        cairo_restore(cr);
+        cairo_stroke_preserve(cr);
+    }
+
+    cairo_new_path(cr);
+    cairo_restore(cr);
+}
+
+bool Rectangle::buildPath(cairo_t *cr) const
+{
+    const double x = m_position.x(), y = m_position.y();
+    const double w = m_size.width(), h = m_size.height();
+
+    if (m_cornerRadius > 0.0) {
+        const double r = m_cornerRadius;
+        cairo_new_sub_path(cr);
+        cairo_arc(cr, x + r, y + r, r, M_PI, 3 * M_PI / 2);
+        cairo_arc(cr, x + w - r, y + r, r, 3 * M_PI / 2, 0);
+        cairo_arc(cr, x + w - r, y + h - r, r, 0, M_PI / 2);
+        cairo_arc(cr, x + r, y + h - r, r, M_PI / 2, M_PI);
+        cairo_close_path(cr);
+    } else {
+        cairo_rectangle(cr, x, y, w, h);
     }
+    return true;
 }
 #endif
 
@@ -129,8 +119,7 @@ bool Rectangle::contains(const QPointF &point) const
 Rectangle* Rectangle::clone() const
 {
     Rectangle *clone = new Rectangle(getPosition(), getSize());
-    clone->setPen(getPen());
-    clone->setBrush(getBrush());
+    clone->setStyle(getStyle());
     clone->setVisible(isVisible());
     clone->setCornerRadius(m_cornerRadius);
     return clone;
@@ -1,23 +1,71 @@
 #include "shape.h"
+#include "document.h"
+#include "shapepool.h"
+#include "styletable.h"
+#include "snapindex.h"
+#include <atomic>
 #include <cmath>
 
+// Line::contains() accepts clicks this far from the stroke
+static const double kHitTolerance = 5.0;
+
+static quint64 nextShapeId()
+{
+    static std::atomic<quint64> next{0};
+    return ++next;
+}
+
 Shape::Shape()
     : m_position(0, 0)
     , m_size(100, 100)
-    , m_pen(Qt::black, 1)
-    , m_brush(Qt::white)
+    , m_style()
     , m_visible(true)
     , m_selected(false)
     , m_rotation(0.0)
+    , m_id(nextShapeId())
+    , m_layer(nullptr)
+    , m_zOrder(0)
+    , m_row(-1)
+{
+}
+
+Shape::Shape(const Shape &other)
+    : m_position(other.m_position)
+    , m_size(other.m_size)
+    , m_style(other.m_style)
+    , m_visible(other.m_visible)
+    , m_selected(false)
+    , m_rotation(other.m_rotation)
+    , m_id(nextShapeId())
+    , m_layer(nullptr)
+    , m_zOrder(0)
+    , m_row(-1)
 {
 }
 
+Shape::~Shape()
+{
+    // Never leave a dangling pointer behind in the layer's spatial index
+    if (m_layer) m_layer->removeShape(this);
+}
+
+void* Shape::operator new(size_t size)
+{
+    return ShapePool::allocate(size);
+}
+
+void Shape::operator delete(void *block, size_t size)
+{
+    ShapePool::deallocate(block, size);
+}
+
 // ========================
 // Property Setters/Getters
 // ========================
 void Shape::setPosition(const QPointF &pos)
 {
     m_position = pos;
+    geometryChanged();
 }
 
 QPointF Shape::getPosition() const
@@ -28,6 +76,7 @@ QPointF Shape::getPosition() const
 void Shape::setSize(const QSizeF &size)
 {
     m_size = size;
+    geometryChanged();
 }
 
 QSizeF Shape::getSize() const
@@ -37,27 +86,42 @@ QSizeF Shape::getSize() const
 
 void Shape::setPen(const QPen &pen)
 {
-    m_pen = pen;
+    StyleTable &styles = StyleTable::instance();
+    setStyle(styles.intern(pen, styles.brush(m_style)));
 }
 
-QPen Shape::getPen() const
+const QPen& Shape::getPen() const
 {
-    return m_pen;
+    return StyleTable::instance().pen(m_style);
 }
 
 void Shape::setBrush(const QBrush &brush)
 {
-    m_brush = brush;
+    StyleTable &styles = StyleTable::instance();
+    setStyle(styles.intern(styles.pen(m_style), brush));
 }
 
-QBrush Shape::getBrush() const
+const QBrush& Shape::getBrush() const
 {
-    return m_brush;
+    return StyleTable::instance().brush(m_style);
+}
+
+void Shape::setStyle(quint32 style)
+{
+    if (style == m_style) return;
+    const bool widthChanged = getPen().widthF() != StyleTable::instance().pen(style).widthF();
+    m_style = StyleRef(style);
+    if (widthChanged) {
+        geometryChanged();  // Stroke width is part of the index bounds
+    } else {
+        stateChanged();
+    }
 }
 
 void Shape::setVisible(bool visible)
 {
     m_visible = visible;
+    stateChanged();
 }
 
 bool Shape::isVisible() const
@@ -68,6 +132,7 @@ bool Shape::isVisible() const
 void Shape::setSelected(bool selected)
 {
     m_selected = selected;
+    stateChanged();
 }
 
 bool Shape::isSelected() const
@@ -78,6 +143,7 @@ bool Shape::isSelected() const
 void Shape::move(const QPointF &offset)
 {
     m_position += offset;
+    geometryChanged();
 }
 
 
@@ -93,12 +159,103 @@ void Shape::scale(double factor)
     m_size *= factor;
 
     // Compute the new top-left so the center stays the same
-    QPointF newTopLeft(center.x() - m_size.width() / 2.0,
-                       center.y() - m_size.height() / 2.0);
+    m_position = QPointF(center.x() - m_size.width() / 2.0,
+                         center.y() - m_size.height() / 2.0);
+
+    geometryChanged();
+}
+
+
+void Shape::gatherPoints(std::vector<QPointF> &points) const
+{
+    points.push_back(QRectF(m_position, m_size).center());
+}
+
+void Shape::scatterPoints(const QPointF *points, const AffineKernel::Parts &parts)
+{
+    m_size = QSizeF(m_size.width() * parts.scaleX, m_size.height() * parts.scaleY);
+    m_position = points[0] - QPointF(m_size.width() / 2.0, m_size.height() / 2.0);
 
-    setPosition(newTopLeft);
+    if (parts.angle != 0.0) {
+        m_rotation = std::fmod(m_rotation + parts.angle, 360.0);
+        if (m_rotation < 0.0) m_rotation += 360.0;
+    }
 }
 
+// ====================
+// Undo history
+// ====================
+Shape::State Shape::saveState() const
+{
+    State state;
+    state.fields = State::Position | State::Size | State::Rotation | State::Style;
+    state.position = m_position;
+    state.size = m_size;
+    state.rotation = m_rotation;
+    state.style = m_style;
+    // Other shapes' only point is the box centre, which position and size cover
+    if (getType() == Line || getType() == Bezier) {
+        state.fields |= State::Points;
+        gatherPoints(state.points);
+    }
+    return state;
+}
+
+Shape::State Shape::exchangeState(const State &state)
+{
+    State previous;
+    previous.fields = state.fields;
+    previous.position = m_position;
+    previous.size = m_size;
+    previous.rotation = m_rotation;
+    previous.style = m_style;
+
+    // Points first: scattering them recomputes the box, which the saved
+    // position and size then overwrite with the same values
+    if (state.fields & State::Points) {
+        gatherPoints(previous.points);
+        if (previous.points.size() == state.points.size()) {
+            scatterPoints(state.points.data(), AffineKernel::Parts{ 1.0, 1.0, 0.0 });
+        }
+    }
+    if (state.fields & State::Position) m_position = state.position;
+    if (state.fields & State::Size) m_size = state.size;
+    if (state.fields & State::Rotation) m_rotation = state.rotation;
+    if (state.fields & State::Style) m_style = state.style;
+    geometryChanged();
+    return previous;
+}
+
+bool Shape::State::dropUnchanged(const State &other)
+{
+    auto drop = [this, &other](Field field, bool equal) {
+        if ((fields & field) && (other.fields & field) && equal) fields &= quint8(~field);
+    };
+    drop(Position, position == other.position);
+    drop(Size, size == other.size);
+    drop(Rotation, rotation == other.rotation);
+    drop(Style, style == other.style);
+    drop(Points, points == other.points);
+    if (!(fields & Style)) style = StyleRef();
+    if (!(fields & Points)) points = std::vector<QPointF>();
+    return fields != 0;
+}
+
+void Shape::State::merge(const State &other)
+{
+    const quint8 missing = other.fields & quint8(~fields);
+    if (missing & Position) position = other.position;
+    if (missing & Size) size = other.size;
+    if (missing & Rotation) rotation = other.rotation;
+    if (missing & Style) style = other.style;
+    if (missing & Points) points = other.points;
+    fields |= missing;
+}
+
+size_t Shape::State::memoryUsage() const
+{
+    return sizeof(State) + points.capacity() * sizeof(QPointF);
+}
 
 void Shape::rotate(double angle)
 {
@@ -107,7 +264,17 @@ void Shape::rotate(double angle)
         m_rotation -= 360.0;
     else if (m_rotation < 0.0)
         m_rotation += 360.0;
+
+    geometryChanged();
+}
+
+#ifdef ENABLE_CAIRO
+bool Shape::buildPath(cairo_t *cr) const
+{
+    Q_UNUSED(cr)
+    return false;
 }
+#endif
 
 // ========================
 // Utility
@@ -116,3 +283,76 @@ QRectF Shape::getBoundingRect() const
 {
     return QRectF(m_position, m_size);
 }
+
+QRectF Shape::getIndexBounds() const
+{
+    QRectF bounds = getBoundingRect().normalized();
+
+    // Rotation is applied about the centre when drawing; the circumscribed
+    // square covers every angle, so further rotation leaves the index
+    // entry untouched.
+    if (m_rotation != 0.0) {
+        QPointF center = bounds.center();
+        double radius = std::hypot(bounds.width(), bounds.height()) / 2.0;
+        bounds = QRectF(center.x() - radius, center.y() - radius, radius * 2.0, radius * 2.0);
+    }
+
+    double margin = qMax(getPen().widthF() / 2.0, kHitTolerance);
+    return bounds.adjusted(-margin, -margin, margin, margin);
+}
+
+QPolygonF Shape::getOutline() const
+{
+    const QRectF bounds = getBoundingRect();
+    return asDrawn(QPolygonF({ bounds.topLeft(), bounds.topRight(),
+                               bounds.bottomRight(), bounds.bottomLeft() }));
+}
+
+void Shape::getSnapPoints(std::vector<SnapPoint> &points) const
+{
+    const QRectF bounds = getBoundingRect();
+    const QPointF center = bounds.center();
+    const QPolygonF box = asDrawn(QPolygonF({
+        bounds.topLeft(), bounds.topRight(), bounds.bottomRight(), bounds.bottomLeft(),
+        QPointF(center.x(), bounds.top()), QPointF(bounds.right(), center.y()),
+        QPointF(center.x(), bounds.bottom()), QPointF(bounds.left(), center.y()),
+        center }));
+
+    for (int i = 0; i < box.size(); ++i) {
+        points.push_back({ box[i], i < 4 ? SnapPoint::Corner : i < 8 ? SnapPoint::Edge : SnapPoint::Center });
+    }
+}
+
+QPolygonF Shape::asDrawn(const QPolygonF &points) const
+{
+    if (m_rotation == 0.0) return points;
+
+    const QPointF center = getBoundingRect().center();
+    QTransform transform;
+    transform.translate(center.x(), center.y());
+    transform.rotate(m_rotation);
+    transform.translate(-center.x(), -center.y());
+    return transform.map(points);
+}
+
+void Shape::geometryChanged()
+{
+    if (m_layer) m_layer->shapeGeometryChanged(this);
+}
+
+void Shape::stateChanged()
+{
+    if (m_layer) m_layer->shapeStateChanged(this);
+}
+
+#ifdef ENABLE_CAIRO
+void Shape::rotateContext(cairo_t *cr) const
+{
+    if (m_rotation == 0.0) return;
+
+    const QPointF center = getBoundingRect().center();
+    cairo_translate(cr, center.x(), center.y());
+    cairo_rotate(cr, m_rotation * M_PI / 180.0);
+    cairo_translate(cr, -center.x(), -center.y());
+}
+#endif
@@ -0,0 +1,166 @@
+#include "shapecolumns.h"
+#include "shape.h"
+#include <limits>
+
+namespace {
+
+// Drops the flagged entries of column, keeping the order of the others
+template <typename T>
+void compact(std::vector<T> &column, const std::vector<char> &doomed)
+{
+    size_t kept = 0;
+    for (size_t row = 0; row < column.size(); ++row) {
+        if (!doomed[row]) column[kept++] = column[row];
+    }
+    column.resize(kept);
+}
+
+// Rebuilds column from the listed entries, in the listed order
+template <typename T>
+void gather(std::vector<T> &column, const std::vector<int> &rows)
+{
+    std::vector<T> gathered;
+    gathered.reserve(rows.size());
+    for (int row : rows) gathered.push_back(column[size_t(row)]);
+    column.swap(gathered);
+}
+
+} // namespace
+
+void ShapeColumns::append(Shape *shape)
+{
+    m_shapes.push_back(shape);
+    m_minX.push_back(0.0);
+    m_minY.push_back(0.0);
+    m_maxX.push_back(0.0);
+    m_maxY.push_back(0.0);
+    m_style.push_back(0);
+    m_flags.push_back(0);
+    store(size() - 1);
+}
+
+void ShapeColumns::remove(int row)
+{
+    m_shapes.erase(m_shapes.begin() + row);
+    m_minX.erase(m_minX.begin() + row);
+    m_minY.erase(m_minY.begin() + row);
+    m_maxX.erase(m_maxX.begin() + row);
+    m_maxY.erase(m_maxY.begin() + row);
+    m_style.erase(m_style.begin() + row);
+    m_flags.erase(m_flags.begin() + row);
+}
+
+void ShapeColumns::removeRows(const std::vector<char> &doomed)
+{
+    compact(m_shapes, doomed);
+    compact(m_minX, doomed);
+    compact(m_minY, doomed);
+    compact(m_maxX, doomed);
+    compact(m_maxY, doomed);
+    compact(m_style, doomed);
+    compact(m_flags, doomed);
+}
+
+void ShapeColumns::reorder(const std::vector<int> &rows)
+{
+    gather(m_shapes, rows);
+    gather(m_minX, rows);
+    gather(m_minY, rows);
+    gather(m_maxX, rows);
+    gather(m_maxY, rows);
+    gather(m_style, rows);
+    gather(m_flags, rows);
+}
+
+void ShapeColumns::clearRow(int row)
+{
+    // Inverted bounds fail every overlap test in query()
+    const double infinity = std::numeric_limits<double>::infinity();
+    m_shapes[size_t(row)] = nullptr;
+    m_minX[row] = infinity;
+    m_minY[row] = infinity;
+    m_maxX[row] = -infinity;
+    m_maxY[row] = -infinity;
+    m_flags[row] = 0;
+}
+
+void ShapeColumns::update(int row)
+{
+    store(row);
+}
+
+void ShapeColumns::updateState(int row)
+{
+    const Shape *shape = m_shapes[row];
+    m_style[row] = shape->getStyle();
+    m_flags[row] = quint8((shape->isVisible() ? Visible : 0) | (shape->isSelected() ? Selected : 0));
+}
+
+void ShapeColumns::clear()
+{
+    m_shapes.clear();
+    m_minX.clear();
+    m_minY.clear();
+    m_maxX.clear();
+    m_maxY.clear();
+    m_style.clear();
+    m_flags.clear();
+}
+
+void ShapeColumns::reserve(int count)
+{
+    const size_t n = static_cast<size_t>(count);
+    m_shapes.reserve(n);
+    m_minX.reserve(n);
+    m_minY.reserve(n);
+    m_maxX.reserve(n);
+    m_maxY.reserve(n);
+    m_style.reserve(n);
+    m_flags.reserve(n);
+}
+
+void ShapeColumns::store(int row)
+{
+    const Shape *shape = m_shapes[row];
+    const QRectF bounds = shape->getIndexBounds();
+
+    m_minX[row] = bounds.left();
+    m_minY[row] = bounds.top();
+    m_maxX[row] = bounds.right();
+    m_maxY[row] = bounds.bottom();
+    updateState(row);
+}
+
+QList<Shape*> ShapeColumns::query(const QRectF &rect, quint8 requiredFlags) const
+{
+    const QRectF r = rect.normalized();
+    const double left = r.left();
+    const double top = r.top();
+    const double right = r.right();
+    const double bottom = r.bottom();
+
+    const double *minX = m_minX.data();
+    const double *minY = m_minY.data();
+    const double *maxX = m_maxX.data();
+    const double *maxY = m_maxY.data();
+    const quint8 *flags = m_flags.data();
+
+    // Branch-light scan: the overlap test is evaluated for every row and
+    // only hits touch the Shape* column
+    QList<Shape*> result;
+    const int count = size();
+    for (int i = 0; i < count; ++i) {
+        const bool hit = (minX[i] <= right) & (left <= maxX[i]) & (minY[i] <= bottom) & (top <= maxY[i])
+                       & ((flags[i] & requiredFlags) == requiredFlags);
+        if (hit) result.append(m_shapes[size_t(i)]);
+    }
+    return result;
+}
+
+size_t ShapeColumns::memoryUsage() const
+{
+    return m_shapes.capacity() * sizeof(Shape*)
+         + (m_minX.capacity() + m_minY.capacity() + m_maxX.capacity() + m_maxY.capacity()) * sizeof(double)
+         + m_style.capacity() * sizeof(quint32)
+         + m_flags.capacity() * sizeof(quint8);
+}
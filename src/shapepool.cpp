@@ -0,0 +1,275 @@
+#include "shapepool.h"
+
+#include <cstdint>
+#include <cstdlib>
+#include <mutex>
+#include <new>
+#include <vector>
+
+namespace {
+
+constexpr std::size_t Granularity = 16;
+constexpr std::size_t ClassCount = 16;              // Blocks up to 256 bytes
+constexpr std::size_t MaxBlock = Granularity * ClassCount;
+constexpr std::size_t SlabSize = 64 * 1024;         // Also the slab alignment
+constexpr std::size_t HeaderSize = 64;
+constexpr std::size_t Batch = 64;                   // Blocks moved per lock
+constexpr std::size_t CacheLimit = 4 * Batch;       // Per thread and class
+
+struct FreeBlock {
+    FreeBlock *next;
+};
+
+// Start of every slab; found from any block by masking its address
+struct Slab {
+    std::size_t sizeClass;
+    std::size_t outside;        // Blocks not on the shared free list
+};
+static_assert(sizeof(Slab) <= HeaderSize, "Slab header");
+
+inline Slab* slabOf(void *block)
+{
+    return reinterpret_cast<Slab*>(reinterpret_cast<std::uintptr_t>(block) & ~std::uintptr_t(SlabSize - 1));
+}
+
+inline std::size_t classOf(std::size_t size)
+{
+    return size == 0 ? 0 : (size - 1) / Granularity;
+}
+
+inline std::size_t blockSize(std::size_t sizeClass)
+{
+    return (sizeClass + 1) * Granularity;
+}
+
+void* allocateSlab()
+{
+#ifdef _WIN32
+    void *memory = _aligned_malloc(SlabSize, SlabSize);
+#else
+    void *memory = std::aligned_alloc(SlabSize, SlabSize);
+#endif
+    if (!memory) throw std::bad_alloc();
+    return memory;
+}
+
+void freeSlab(void *memory)
+{
+#ifdef _WIN32
+    _aligned_free(memory);
+#else
+    std::free(memory);
+#endif
+}
+
+// ========================
+// Shared lists
+// ========================
+struct SizeClass {
+    FreeBlock *free = nullptr;
+    std::vector<Slab*> slabs;
+};
+
+struct SharedPool {
+    std::mutex mutex;
+    SizeClass classes[ClassCount];
+    std::size_t reserved = 0;
+
+    // Caller holds the mutex
+    void grow(std::size_t sizeClass)
+    {
+        Slab *slab = new (allocateSlab()) Slab{ sizeClass, 0 };
+        reserved += SlabSize;
+
+        SizeClass &list = classes[sizeClass];
+        list.slabs.push_back(slab);
+
+        // Pushed back to front so the slab is handed out in address order
+        const std::size_t size = blockSize(sizeClass);
+        const std::size_t count = (SlabSize - HeaderSize) / size;
+        char *first = reinterpret_cast<char*>(slab) + HeaderSize;
+        for (std::size_t i = count; i-- > 0;) {
+            FreeBlock *block = reinterpret_cast<FreeBlock*>(first + i * size);
+            block->next = list.free;
+            list.free = block;
+        }
+    }
+
+    // Caller holds the mutex; returns a chain of up to count blocks
+    FreeBlock* take(std::size_t sizeClass, std::size_t count, std::size_t &taken)
+    {
+        SizeClass &list = classes[sizeClass];
+        if (!list.free) grow(sizeClass);
+
+        FreeBlock *head = list.free;
+        FreeBlock *tail = head;
+        taken = 1;
+        ++slabOf(tail)->outside;
+        while (taken < count && tail->next) {
+            tail = tail->next;
+            ++slabOf(tail)->outside;
+            ++taken;
+        }
+        list.free = tail->next;
+        tail->next = nullptr;
+        return head;
+    }
+
+    // Caller holds the mutex
+    void give(std::size_t sizeClass, FreeBlock *block)
+    {
+        --slabOf(block)->outside;
+        block->next = classes[sizeClass].free;
+        classes[sizeClass].free = block;
+    }
+};
+
+// Never destroyed: shapes may still be deleted during static destruction
+SharedPool& shared()
+{
+    static SharedPool *pool = new SharedPool;
+    return *pool;
+}
+
+// ========================
+// Per-thread caches
+// ========================
+struct ThreadCache {
+    FreeBlock *free[ClassCount] = {};
+    std::size_t count[ClassCount] = {};
+
+    ~ThreadCache();
+
+    void flush(std::size_t sizeClass, std::size_t keep)
+    {
+        SharedPool &pool = shared();
+        std::lock_guard<std::mutex> lock(pool.mutex);
+        while (count[sizeClass] > keep) {
+            FreeBlock *block = free[sizeClass];
+            free[sizeClass] = block->next;
+            --count[sizeClass];
+            pool.give(sizeClass, block);
+        }
+    }
+
+    void flushAll()
+    {
+        for (std::size_t c = 0; c < ClassCount; ++c) {
+            if (count[c] > 0) flush(c, 0);
+        }
+    }
+};
+
+// Trivially destructible, so still readable after the cache itself is gone
+thread_local bool t_cacheDestroyed = false;
+
+ThreadCache::~ThreadCache()
+{
+    flushAll();
+    t_cacheDestroyed = true;
+}
+
+ThreadCache* threadCache()
+{
+    if (t_cacheDestroyed) return nullptr;
+    thread_local ThreadCache cache;
+    return &cache;
+}
+
+} // namespace
+
+void* ShapePool::allocate(std::size_t size)
+{
+    if (size > MaxBlock) return ::operator new(size);
+
+    const std::size_t sizeClass = classOf(size);
+    ThreadCache *cache = threadCache();
+    SharedPool &pool = shared();
+
+    if (!cache) {
+        std::lock_guard<std::mutex> lock(pool.mutex);
+        std::size_t taken = 0;
+        return pool.take(sizeClass, 1, taken);
+    }
+
+    if (!cache->free[sizeClass]) {
+        std::lock_guard<std::mutex> lock(pool.mutex);
+        cache->free[sizeClass] = pool.take(sizeClass, Batch, cache->count[sizeClass]);
+    }
+
+    FreeBlock *block = cache->free[sizeClass];
+    cache->free[sizeClass] = block->next;
+    --cache->count[sizeClass];
+    return block;
+}
+
+void ShapePool::deallocate(void *block, std::size_t size)
+{
+    if (!block) return;
+    if (size > MaxBlock) {
+        ::operator delete(block);
+        return;
+    }
+
+    const std::size_t sizeClass = classOf(size);
+    FreeBlock *freed = static_cast<FreeBlock*>(block);
+    ThreadCache *cache = threadCache();
+
+    if (!cache) {
+        SharedPool &pool = shared();
+        std::lock_guard<std::mutex> lock(pool.mutex);
+        pool.give(sizeClass, freed);
+        return;
+    }
+
+    freed->next = cache->free[sizeClass];
+    cache->free[sizeClass] = freed;
+    if (++cache->count[sizeClass] > CacheLimit) {
+        cache->flush(sizeClass, CacheLimit - Batch);
+    }
+}
+
+void ShapePool::trim()
+{
+    // What this thread just freed is sitting in its cache
+    if (ThreadCache *cache = threadCache()) cache->flushAll();
+
+    SharedPool &pool = shared();
+    std::lock_guard<std::mutex> lock(pool.mutex);
+
+    for (SizeClass &list : pool.classes) {
+        bool anyEmpty = false;
+        for (Slab *slab : list.slabs) {
+            if (slab->outside == 0) anyEmpty = true;
+        }
+        if (!anyEmpty) continue;
+
+        // Unlink the blocks of empty slabs, then release the slabs
+        FreeBlock **link = &list.free;
+        while (*link) {
+            if (slabOf(*link)->outside == 0) {
+                *link = (*link)->next;
+            } else {
+                link = &(*link)->next;
+            }
+        }
+
+        std::vector<Slab*> kept;
+        for (Slab *slab : list.slabs) {
+            if (slab->outside == 0) {
+                freeSlab(slab);
+                pool.reserved -= SlabSize;
+            } else {
+                kept.push_back(slab);
+            }
+        }
+        list.slabs.swap(kept);
+    }
+}
+
+std::size_t ShapePool::reservedBytes()
+{
+    SharedPool &pool = shared();
+    std::lock_guard<std::mutex> lock(pool.mutex);
+    return pool.reserved;
+}
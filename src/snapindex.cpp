@@ -0,0 +1,118 @@
+#include "snapindex.h"
+#include "shape.h"
+#include <algorithm>
+#include <cmath>
+#include <limits>
+
+SnapIndex::SnapIndex(double cellSize)
+    : m_cellSize(cellSize)
+{
+}
+
+int SnapIndex::cellOf(double coordinate) const
+{
+    const double cell = std::floor(coordinate / m_cellSize);
+    // Far-away points share the outermost cells instead of overflowing
+    const double limit = double(std::numeric_limits<int>::max() / 2);
+    return int(std::max(-limit, std::min(limit, cell)));
+}
+
+SnapIndex::Key SnapIndex::key(int cx, int cy)
+{
+    return (Key(quint32(cx)) << 32) | Key(quint32(cy));
+}
+
+// ====================
+// Maintenance
+// ====================
+void SnapIndex::insert(const Shape *shape)
+{
+    if (!shape || m_shapeCells.contains(shape)) return;
+
+    m_scratch.clear();
+    shape->getSnapPoints(m_scratch);
+
+    std::vector<Key> &keys = m_shapeCells[shape];
+    for (const SnapPoint &snap : m_scratch) {
+        if (!std::isfinite(snap.point.x()) || !std::isfinite(snap.point.y())) continue;
+        const Key cell = key(cellOf(snap.point.x()), cellOf(snap.point.y()));
+        m_cells[cell].push_back({ snap.point, shape, snap.kind });
+        if (std::find(keys.begin(), keys.end(), cell) == keys.end()) keys.push_back(cell);
+        ++m_count;
+    }
+}
+
+void SnapIndex::remove(const Shape *shape)
+{
+    auto it = m_shapeCells.find(shape);
+    if (it == m_shapeCells.end()) return;
+
+    for (Key cell : it.value()) {
+        auto cellIt = m_cells.find(cell);
+        if (cellIt == m_cells.end()) continue;
+
+        std::vector<Entry> &entries = cellIt.value();
+        const size_t before = entries.size();
+        entries.erase(std::remove_if(entries.begin(), entries.end(),
+                                     [shape](const Entry &entry) { return entry.shape == shape; }),
+                      entries.end());
+        m_count -= int(before - entries.size());
+        if (entries.empty()) m_cells.erase(cellIt);
+    }
+    m_shapeCells.erase(it);
+}
+
+void SnapIndex::update(const Shape *shape)
+{
+    remove(shape);
+    insert(shape);
+}
+
+void SnapIndex::clear()
+{
+    m_cells.clear();
+    m_shapeCells.clear();
+    m_count = 0;
+}
+
+bool SnapIndex::contains(const Shape *shape) const
+{
+    return m_shapeCells.contains(shape);
+}
+
+// ====================
+// Queries
+// ====================
+bool SnapIndex::nearest(const QPointF &point, double radius, SnapPoint &result,
+                        const std::function<bool(const Shape*)> &skip) const
+{
+    if (m_cells.isEmpty() || !(radius > 0.0)) return false;
+
+    const int x1 = cellOf(point.x() - radius), x2 = cellOf(point.x() + radius);
+    const int y1 = cellOf(point.y() - radius), y2 = cellOf(point.y() + radius);
+
+    double best = radius * radius;
+    const Entry *found = nullptr;
+    for (int cx = x1; cx <= x2; ++cx) {
+        for (int cy = y1; cy <= y2; ++cy) {
+            auto it = m_cells.constFind(key(cx, cy));
+            if (it == m_cells.constEnd()) continue;
+
+            for (const Entry &entry : it.value()) {
+                const double dx = entry.point.x() - point.x();
+                const double dy = entry.point.y() - point.y();
+                const double distance = dx * dx + dy * dy;
+                if (distance > best) continue;
+                if (distance == best && found && entry.kind >= found->kind) continue;
+                if (skip && skip(entry.shape)) continue;
+                best = distance;
+                found = &entry;
+            }
+        }
+    }
+
+    if (!found) return false;
+    result.point = found->point;
+    result.kind = found->kind;
+    return true;
+}
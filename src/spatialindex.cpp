@@ -0,0 +1,568 @@
+#include "spatialindex.h"
+#include "shape.h"
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+
+// ========================
+// Box helpers
+// ========================
+// Boxes are closed intervals, so flat boxes (horizontal or vertical lines)
+// still overlap and contain points on their edge.
+namespace {
+
+template <typename Box>
+inline bool overlaps(const Box &a, const Box &b)
+{
+    return a.x1 <= b.x2 && b.x1 <= a.x2 && a.y1 <= b.y2 && b.y1 <= a.y2;
+}
+
+template <typename Box>
+inline bool containsPoint(const Box &b, const QPointF &p)
+{
+    return b.x1 <= p.x() && p.x() <= b.x2 && b.y1 <= p.y() && p.y() <= b.y2;
+}
+
+template <typename Box>
+inline bool encloses(const Box &outer, const Box &inner)
+{
+    return outer.x1 <= inner.x1 && inner.x2 <= outer.x2
+        && outer.y1 <= inner.y1 && inner.y2 <= outer.y2;
+}
+
+template <typename Box>
+inline Box unite(const Box &a, const Box &b)
+{
+    return Box{ qMin(a.x1, b.x1), qMin(a.y1, b.y1), qMax(a.x2, b.x2), qMax(a.y2, b.y2) };
+}
+
+template <typename Box>
+inline double area(const Box &b)
+{
+    return (b.x2 - b.x1) * (b.y2 - b.y1);
+}
+
+template <typename Box>
+inline double enlargement(const Box &b, const Box &add)
+{
+    return area(unite(b, add)) - area(b);
+}
+
+} // namespace
+
+SpatialIndex::SpatialIndex()
+    : m_root(new Node)
+{
+}
+
+SpatialIndex::~SpatialIndex()
+{
+    destroy(m_root);
+}
+
+// ========================
+// Maintenance
+// ========================
+void SpatialIndex::insert(Shape *shape, const QRectF &bounds)
+{
+    if (!shape) return;
+
+    if (m_bounds.contains(shape)) {
+        update(shape, bounds);
+        return;
+    }
+
+    QRectF normalized = bounds.normalized();
+    m_bounds.insert(shape, normalized);
+
+    Entry entry;
+    entry.bounds = toBox(normalized);
+    entry.shape = shape;
+    insertEntry(entry);
+}
+
+void SpatialIndex::insert(const std::vector<std::pair<Shape*, QRectF>> &items)
+{
+    if (!m_bounds.isEmpty()) {
+        for (const auto &item : items) {
+            insert(item.first, item.second);
+        }
+        return;
+    }
+
+    std::vector<Entry> level;
+    level.reserve(items.size());
+    m_bounds.reserve(static_cast<int>(items.size()));
+    for (const auto &item : items) {
+        if (!item.first || m_bounds.contains(item.first)) continue;
+
+        QRectF normalized = item.second.normalized();
+        m_bounds.insert(item.first, normalized);
+
+        Entry entry;
+        entry.bounds = toBox(normalized);
+        entry.shape = item.first;
+        level.push_back(entry);
+    }
+
+    bool leaf = true;
+    while (static_cast<int>(level.size()) > MaxEntries) {
+        level = packLevel(level, leaf);
+        leaf = false;
+    }
+
+    destroy(m_root);
+    m_root = new Node;
+    m_root->leaf = leaf;
+    m_root->entries = std::move(level);
+    if (!leaf) {
+        for (Entry &e : m_root->entries) {
+            e.child->parent = m_root;
+        }
+    }
+}
+
+void SpatialIndex::remove(Shape *shape)
+{
+    auto it = m_bounds.find(shape);
+    if (it == m_bounds.end()) return;
+
+    Node *leaf = findLeaf(m_root, shape, toBox(it.value()));
+    m_bounds.erase(it);
+    if (!leaf) return;
+
+    for (auto e = leaf->entries.begin(); e != leaf->entries.end(); ++e) {
+        if (e->shape == shape) {
+            leaf->entries.erase(e);
+            break;
+        }
+    }
+    condenseTree(leaf);
+}
+
+void SpatialIndex::update(Shape *shape, const QRectF &bounds)
+{
+    auto it = m_bounds.find(shape);
+    if (it == m_bounds.end()) {
+        insert(shape, bounds);
+        return;
+    }
+
+    QRectF normalized = bounds.normalized();
+    if (it.value() == normalized) return;
+
+    // Fast path: the shape stays inside its leaf's box, so no ancestor
+    // needs to grow and the tree shape is untouched.
+    Box box = toBox(normalized);
+    Node *leaf = findLeaf(m_root, shape, toBox(it.value()));
+    if (leaf && encloses(nodeBounds(leaf), box)) {
+        for (Entry &e : leaf->entries) {
+            if (e.shape == shape) {
+                e.bounds = box;
+                break;
+            }
+        }
+        it.value() = normalized;
+        return;
+    }
+
+    remove(shape);
+    insert(shape, normalized);
+}
+
+void SpatialIndex::clear()
+{
+    destroy(m_root);
+    m_root = new Node;
+    m_bounds.clear();
+}
+
+bool SpatialIndex::contains(Shape *shape) const
+{
+    return m_bounds.contains(shape);
+}
+
+QRectF SpatialIndex::bounds(Shape *shape) const
+{
+    return m_bounds.value(shape);
+}
+
+QRectF SpatialIndex::extent() const
+{
+    if (m_root->entries.empty()) return QRectF();
+    const Box box = nodeBounds(m_root);
+    return QRectF(QPointF(box.x1, box.y1), QPointF(box.x2, box.y2));
+}
+
+int SpatialIndex::size() const
+{
+    return m_bounds.size();
+}
+
+// ========================
+// Queries
+// ========================
+QList<Shape*> SpatialIndex::query(const QPointF &point) const
+{
+    QList<Shape*> result;
+    std::vector<const Node*> stack;
+    stack.push_back(m_root);
+
+    while (!stack.empty()) {
+        const Node *node = stack.back();
+        stack.pop_back();
+
+        for (const Entry &e : node->entries) {
+            if (!containsPoint(e.bounds, point)) continue;
+            if (node->leaf) {
+                result.append(e.shape);
+            } else {
+                stack.push_back(e.child);
+            }
+        }
+    }
+    return result;
+}
+
+QList<Shape*> SpatialIndex::query(const QRectF &rect) const
+{
+    QList<Shape*> result;
+    Box r = toBox(rect.normalized());
+    std::vector<const Node*> stack;
+    stack.push_back(m_root);
+
+    while (!stack.empty()) {
+        const Node *node = stack.back();
+        stack.pop_back();
+
+        for (const Entry &e : node->entries) {
+            if (!overlaps(e.bounds, r)) continue;
+            if (node->leaf) {
+                result.append(e.shape);
+            } else {
+                stack.push_back(e.child);
+            }
+        }
+    }
+    return result;
+}
+
+// ========================
+// Tree internals
+// ========================
+SpatialIndex::Box SpatialIndex::toBox(const QRectF &rect)
+{
+    return Box{ rect.left(), rect.top(), rect.right(), rect.bottom() };
+}
+
+SpatialIndex::Box SpatialIndex::nodeBounds(const Node *node)
+{
+    if (node->entries.empty()) return Box{ 0.0, 0.0, 0.0, 0.0 };
+
+    Box bounds = node->entries.front().bounds;
+    for (const Entry &e : node->entries) {
+        bounds = unite(bounds, e.bounds);
+    }
+    return bounds;
+}
+
+SpatialIndex::Node* SpatialIndex::chooseLeaf(const Box &bounds) const
+{
+    Node *node = m_root;
+    while (!node->leaf) {
+        const Entry *best = nullptr;
+        double bestEnlargement = std::numeric_limits<double>::max();
+        double bestArea = std::numeric_limits<double>::max();
+
+        for (const Entry &e : node->entries) {
+            double grow = enlargement(e.bounds, bounds);
+            double a = area(e.bounds);
+            if (grow < bestEnlargement || (grow == bestEnlargement && a < bestArea)) {
+                best = &e;
+                bestEnlargement = grow;
+                bestArea = a;
+            }
+        }
+        node = best->child;
+    }
+    return node;
+}
+
+SpatialIndex::Node* SpatialIndex::findLeaf(Node *node, Shape *shape, const Box &bounds) const
+{
+    if (node->leaf) {
+        for (const Entry &e : node->entries) {
+            if (e.shape == shape) return node;
+        }
+        return nullptr;
+    }
+
+    for (const Entry &e : node->entries) {
+        if (encloses(e.bounds, bounds)) {
+            if (Node *found = findLeaf(e.child, shape, bounds)) return found;
+        }
+    }
+    return nullptr;
+}
+
+void SpatialIndex::insertEntry(const Entry &entry)
+{
+    Node *leaf = chooseLeaf(entry.bounds);
+    leaf->entries.push_back(entry);
+
+    Node *split = nullptr;
+    if (static_cast<int>(leaf->entries.size()) > MaxEntries) {
+        split = splitNode(leaf);
+    }
+    adjustTree(leaf, split);
+}
+
+// One level of sort-tile-recursive packing: sort by x, cut into vertical
+// slices, sort each slice by y and cut it into nodes of (nearly) equal
+// size. Returns the entries for the level above.
+std::vector<SpatialIndex::Entry> SpatialIndex::packLevel(std::vector<Entry> &entries, bool leaf)
+{
+    const size_t count = entries.size();
+    const size_t nodeCount = (count + MaxEntries - 1) / MaxEntries;
+    const size_t sliceCount = static_cast<size_t>(std::ceil(std::sqrt(double(nodeCount))));
+
+    std::sort(entries.begin(), entries.end(), [](const Entry &a, const Entry &b) {
+        return a.bounds.x1 + a.bounds.x2 < b.bounds.x1 + b.bounds.x2;
+    });
+
+    std::vector<Entry> parents;
+    parents.reserve(nodeCount + sliceCount);
+    for (size_t slice = 0; slice < sliceCount; ++slice) {
+        const size_t begin = count * slice / sliceCount;
+        const size_t end = count * (slice + 1) / sliceCount;
+        std::sort(entries.begin() + begin, entries.begin() + end, [](const Entry &a, const Entry &b) {
+            return a.bounds.y1 + a.bounds.y2 < b.bounds.y1 + b.bounds.y2;
+        });
+
+        const size_t groups = (end - begin + MaxEntries - 1) / MaxEntries;
+        for (size_t group = 0; group < groups; ++group) {
+            const size_t first = begin + (end - begin) * group / groups;
+            const size_t last = begin + (end - begin) * (group + 1) / groups;
+
+            Node *node = new Node;
+            node->leaf = leaf;
+            node->entries.assign(entries.begin() + first, entries.begin() + last);
+            if (!leaf) {
+                for (Entry &e : node->entries) {
+                    e.child->parent = node;
+                }
+            }
+
+            Entry parent;
+            parent.bounds = nodeBounds(node);
+            parent.child = node;
+            parents.push_back(parent);
+        }
+    }
+    return parents;
+}
+
+void SpatialIndex::adjustTree(Node *node, Node *split)
+{
+    while (node != m_root) {
+        Node *parent = node->parent;
+
+        for (Entry &e : parent->entries) {
+            if (e.child == node) {
+                e.bounds = nodeBounds(node);
+                break;
+            }
+        }
+
+        Node *parentSplit = nullptr;
+        if (split) {
+            Entry e;
+            e.bounds = nodeBounds(split);
+            e.child = split;
+            split->parent = parent;
+            parent->entries.push_back(e);
+
+            if (static_cast<int>(parent->entries.size()) > MaxEntries) {
+                parentSplit = splitNode(parent);
+            }
+        }
+
+        node = parent;
+        split = parentSplit;
+    }
+
+    // Root overflowed: grow the tree by one level
+    if (split) {
+        Node *newRoot = new Node;
+        newRoot->leaf = false;
+
+        Entry left;
+        left.bounds = nodeBounds(m_root);
+        left.child = m_root;
+        Entry right;
+        right.bounds = nodeBounds(split);
+        right.child = split;
+
+        newRoot->entries.push_back(left);
+        newRoot->entries.push_back(right);
+        m_root->parent = newRoot;
+        split->parent = newRoot;
+        m_root = newRoot;
+    }
+}
+
+SpatialIndex::Node* SpatialIndex::splitNode(Node *node)
+{
+    std::vector<Entry> entries;
+    entries.swap(node->entries);
+    const int count = static_cast<int>(entries.size());
+
+    // Pick the two seeds that would waste the most area together
+    int seedA = 0, seedB = 1;
+    double worst = -std::numeric_limits<double>::max();
+    for (int i = 0; i < count; ++i) {
+        for (int j = i + 1; j < count; ++j) {
+            double d = area(unite(entries[i].bounds, entries[j].bounds))
+                     - area(entries[i].bounds) - area(entries[j].bounds);
+            if (d > worst) {
+                worst = d;
+                seedA = i;
+                seedB = j;
+            }
+        }
+    }
+
+    Node *sibling = new Node;
+    sibling->leaf = node->leaf;
+    sibling->parent = node->parent;
+
+    std::vector<bool> assigned(count, false);
+    node->entries.push_back(entries[seedA]);
+    sibling->entries.push_back(entries[seedB]);
+    assigned[seedA] = assigned[seedB] = true;
+    Box boxA = entries[seedA].bounds;
+    Box boxB = entries[seedB].bounds;
+    int remaining = count - 2;
+
+    while (remaining > 0) {
+        // Make sure both halves can still reach the minimum fill
+        if (static_cast<int>(node->entries.size()) + remaining == MinEntries
+            || static_cast<int>(sibling->entries.size()) + remaining == MinEntries) {
+            Node *target = static_cast<int>(node->entries.size()) + remaining == MinEntries
+                         ? node : sibling;
+            for (int i = 0; i < count; ++i) {
+                if (!assigned[i]) {
+                    target->entries.push_back(entries[i]);
+                    assigned[i] = true;
+                }
+            }
+            break;
+        }
+
+        // Next entry is the one with the strongest preference for a group
+        int next = -1;
+        double bestDiff = -1.0;
+        double growA = 0.0, growB = 0.0;
+        for (int i = 0; i < count; ++i) {
+            if (assigned[i]) continue;
+            double dA = enlargement(boxA, entries[i].bounds);
+            double dB = enlargement(boxB, entries[i].bounds);
+            double diff = qAbs(dA - dB);
+            if (diff > bestDiff) {
+                bestDiff = diff;
+                next = i;
+                growA = dA;
+                growB = dB;
+            }
+        }
+
+        bool toA;
+        if (growA != growB) {
+            toA = growA < growB;
+        } else if (area(boxA) != area(boxB)) {
+            toA = area(boxA) < area(boxB);
+        } else {
+            toA = node->entries.size() <= sibling->entries.size();
+        }
+
+        if (toA) {
+            node->entries.push_back(entries[next]);
+            boxA = unite(boxA, entries[next].bounds);
+        } else {
+            sibling->entries.push_back(entries[next]);
+            boxB = unite(boxB, entries[next].bounds);
+        }
+        assigned[next] = true;
+        --remaining;
+    }
+
+    if (!sibling->leaf) {
+        for (Entry &e : sibling->entries) {
+            e.child->parent = sibling;
+        }
+    }
+    return sibling;
+}
+
+void SpatialIndex::condenseTree(Node *leaf)
+{
+    std::vector<Entry> orphans;
+    Node *node = leaf;
+
+    while (node != m_root) {
+        Node *parent = node->parent;
+
+        for (auto e = parent->entries.begin(); e != parent->entries.end(); ++e) {
+            if (e->child != node) continue;
+
+            if (static_cast<int>(node->entries.size()) < MinEntries) {
+                // Underfull: drop the node and reinsert its shapes later
+                parent->entries.erase(e);
+                collectShapes(node, orphans);
+                destroy(node);
+            } else {
+                e->bounds = nodeBounds(node);
+            }
+            break;
+        }
+        node = parent;
+    }
+
+    // Shorten the tree while the root has a single child
+    while (!m_root->leaf && m_root->entries.size() == 1) {
+        Node *child = m_root->entries.front().child;
+        child->parent = nullptr;
+        delete m_root;
+        m_root = child;
+    }
+    if (!m_root->leaf && m_root->entries.empty()) {
+        m_root->leaf = true;
+    }
+
+    for (const Entry &e : orphans) {
+        insertEntry(e);
+    }
+}
+
+void SpatialIndex::collectShapes(Node *node, std::vector<Entry> &out) const
+{
+    if (node->leaf) {
+        out.insert(out.end(), node->entries.begin(), node->entries.end());
+        return;
+    }
+    for (const Entry &e : node->entries) {
+        collectShapes(e.child, out);
+    }
+}
+
+void SpatialIndex::destroy(Node *node)
+{
+    if (!node) return;
+    if (!node->leaf) {
+        for (const Entry &e : node->entries) {
+            destroy(e.child);
+        }
+    }
+    delete node;
+}
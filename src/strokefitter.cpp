@@ -0,0 +1,259 @@
+#include "strokefitter.h"
+#include <QtMath>
+#include <cmath>
+
+namespace {
+
+// Longest run of samples fitted as one cubic; bounds the cost per sample
+constexpr int MaxWindow = 256;
+// Newton-Raphson passes tried when the first fit misses, as long as it
+// was within this factor (squared) of the tolerance
+constexpr int MaxIterations = 4;
+constexpr double IterationFactor = 4.0;
+
+inline double dot(const QPointF &a, const QPointF &b)
+{
+    return a.x() * b.x() + a.y() * b.y();
+}
+
+inline double length(const QPointF &v)
+{
+    return std::sqrt(dot(v, v));
+}
+
+inline QPointF normalized(const QPointF &v)
+{
+    const double len = length(v);
+    return len > 0.0 ? v / len : QPointF();
+}
+
+inline QPointF evaluate(const QPointF *c, double t)
+{
+    const double s = 1.0 - t;
+    return c[0] * (s * s * s) + c[1] * (3.0 * s * s * t) + c[2] * (3.0 * s * t * t) + c[3] * (t * t * t);
+}
+
+// One Newton-Raphson step towards the parameter of the point on the
+// curve closest to p
+double refine(const QPointF *c, const QPointF &p, double u)
+{
+    const QPointF d1[3] = { (c[1] - c[0]) * 3.0, (c[2] - c[1]) * 3.0, (c[3] - c[2]) * 3.0 };
+    const QPointF d2[2] = { (d1[1] - d1[0]) * 2.0, (d1[2] - d1[1]) * 2.0 };
+
+    const double s = 1.0 - u;
+    const QPointF q = evaluate(c, u) - p;
+    const QPointF q1 = d1[0] * (s * s) + d1[1] * (2.0 * s * u) + d1[2] * (u * u);
+    const QPointF q2 = d2[0] * s + d2[1] * u;
+
+    const double denominator = dot(q1, q1) + dot(q, q2);
+    if (std::abs(denominator) < 1e-12) return u;
+    return qBound(0.0, u - dot(q, q1) / denominator, 1.0);
+}
+
+} // namespace
+
+StrokeFitter::StrokeFitter(double tolerance)
+    : m_tolerance(qMax(tolerance, 1e-6))
+{
+}
+
+void StrokeFitter::setTolerance(double tolerance)
+{
+    m_tolerance = qMax(tolerance, 1e-6);
+}
+
+void StrokeFitter::begin(const QPointF &point)
+{
+    m_fitted.clear();
+    m_fitted.append(point);
+    m_window.clear();
+    m_window.append(point);
+    m_anchorTangent = QPointF();
+    m_hasTail = false;
+}
+
+bool StrokeFitter::addSample(const QPointF &point)
+{
+    if (m_window.isEmpty()) {
+        begin(point);
+        return true;
+    }
+
+    // Sub-tolerance jitter cannot change the fit, only slow it down
+    const double spacing = m_tolerance * 0.25;
+    if (length(point - m_window.last()) < spacing) return false;
+
+    m_window.append(point);
+
+    double error = 0.0;
+    const Cubic candidate = fitWindow(m_window.size(), error);
+    if (error <= m_tolerance * m_tolerance && m_window.size() <= MaxWindow) {
+        m_tail = candidate;
+        m_hasTail = true;
+        return true;
+    }
+
+    // The window no longer fits one cubic: keep the last fit that did and
+    // start again from its end, leaving in the same direction
+    m_fitted.append(m_tail.c1);
+    m_fitted.append(m_tail.c2);
+    m_fitted.append(m_tail.p3);
+
+    const QPointF outgoing = normalized(m_tail.p3 - m_tail.c2);
+    m_anchorTangent = outgoing.isNull() ? normalized(m_tail.p3 - m_tail.p0) : outgoing;
+
+    const QPointF start = m_window[m_window.size() - 2];
+    m_window.clear();
+    m_window.append(start);
+    m_window.append(point);
+
+    m_tail = fitWindow(m_window.size(), error);
+    m_hasTail = true;
+    return true;
+}
+
+QVector<QPointF> StrokeFitter::points() const
+{
+    QVector<QPointF> result = m_fitted;
+    if (m_hasTail) {
+        result.reserve(result.size() + 3);
+        result.append(m_tail.c1);
+        result.append(m_tail.c2);
+        result.append(m_tail.p3);
+    }
+    return result;
+}
+
+QVector<QPointF> StrokeFitter::fit(const QVector<QPointF> &samples, double tolerance)
+{
+    if (samples.isEmpty()) return QVector<QPointF>();
+
+    StrokeFitter fitter(tolerance);
+    fitter.begin(samples.first());
+    for (int i = 1; i < samples.size(); ++i) {
+        fitter.addSample(samples[i]);
+    }
+    return fitter.points();
+}
+
+// ====================
+// Fitting
+// ====================
+QPointF StrokeFitter::leftTangent(int count) const
+{
+    if (!m_anchorTangent.isNull()) return m_anchorTangent;
+
+    // A few samples in smooths out the first, noisiest, steps
+    const int ahead = qMin(3, count - 1);
+    return normalized(m_window[ahead] - m_window[0]);
+}
+
+QPointF StrokeFitter::rightTangent(int count) const
+{
+    const int back = qMin(3, count - 1);
+    return normalized(m_window[count - 1 - back] - m_window[count - 1]);
+}
+
+StrokeFitter::Cubic StrokeFitter::fitWindow(int count, double &maxError) const
+{
+    const QPointF *d = m_window.constData();
+    const QPointF first = d[0];
+    const QPointF last = d[count - 1];
+    const QPointF t1 = leftTangent(count);
+    const QPointF t2 = rightTangent(count);
+    const double chord = length(last - first);
+
+    QPointF c[4];
+    maxError = 0.0;
+
+    if (count <= 2) {
+        c[0] = first;
+        c[1] = first + t1 * (chord / 3.0);
+        c[2] = last + t2 * (chord / 3.0);
+        c[3] = last;
+        return Cubic{c[0], c[1], c[2], c[3]};
+    }
+
+    // Chord-length parameterisation
+    QVector<double> u(count);
+    u[0] = 0.0;
+    for (int i = 1; i < count; ++i) {
+        u[i] = u[i - 1] + length(d[i] - d[i - 1]);
+    }
+    const double total = u[count - 1];
+    for (int i = 1; i < count; ++i) {
+        u[i] = total > 0.0 ? u[i] / total : 0.0;
+    }
+
+    // Least-squares lengths of the two end tangents (Schneider's
+    // generateBezier); falls back to a third of the chord when degenerate
+    auto generate = [&]() {
+        double c00 = 0.0, c01 = 0.0, c11 = 0.0, x0 = 0.0, x1 = 0.0;
+        for (int i = 0; i < count; ++i) {
+            const double t = u[i];
+            const double s = 1.0 - t;
+            const double b0 = s * s * s, b1 = 3.0 * s * s * t, b2 = 3.0 * s * t * t, b3 = t * t * t;
+            const QPointF a1 = t1 * b1;
+            const QPointF a2 = t2 * b2;
+            c00 += dot(a1, a1);
+            c01 += dot(a1, a2);
+            c11 += dot(a2, a2);
+            const QPointF rest = d[i] - (first * (b0 + b1) + last * (b2 + b3));
+            x0 += dot(a1, rest);
+            x1 += dot(a2, rest);
+        }
+
+        const double det = c00 * c11 - c01 * c01;
+        double alpha1 = 0.0, alpha2 = 0.0;
+        if (std::abs(det) > 1e-12) {
+            alpha1 = (x0 * c11 - x1 * c01) / det;
+            alpha2 = (c00 * x1 - c01 * x0) / det;
+        }
+
+        const double epsilon = chord * 1e-6;
+        if (alpha1 < epsilon || alpha2 < epsilon || alpha1 > chord * 3.0 || alpha2 > chord * 3.0) {
+            alpha1 = alpha2 = chord / 3.0;
+        }
+
+        c[0] = first;
+        c[1] = first + t1 * alpha1;
+        c[2] = last + t2 * alpha2;
+        c[3] = last;
+    };
+
+    auto measure = [&]() {
+        double worst = 0.0;
+        for (int i = 1; i < count - 1; ++i) {
+            const QPointF diff = evaluate(c, u[i]) - d[i];
+            worst = qMax(worst, dot(diff, diff));
+        }
+        return worst;
+    };
+
+    generate();
+    maxError = measure();
+
+    const double limit = m_tolerance * m_tolerance;
+    if (maxError <= limit || maxError > limit * IterationFactor) {
+        return Cubic{c[0], c[1], c[2], c[3]};
+    }
+
+    // Close miss: move each parameter to its sample's nearest point on the
+    // curve and fit again, keeping the best result
+    Cubic best{c[0], c[1], c[2], c[3]};
+    double bestError = maxError;
+    for (int pass = 0; pass < MaxIterations && bestError > limit; ++pass) {
+        for (int i = 1; i < count - 1; ++i) {
+            u[i] = refine(c, d[i], u[i]);
+        }
+        generate();
+        const double error = measure();
+        if (error < bestError) {
+            best = Cubic{c[0], c[1], c[2], c[3]};
+            bestError = error;
+        }
+    }
+
+    maxError = bestError;
+    return best;
+}
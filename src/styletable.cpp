@@ -0,0 +1,172 @@
+#include "styletable.h"
+#include <functional>
+#include <new>
+
+namespace {
+
+inline void combine(size_t &seed, size_t value)
+{
+    seed ^= value + 0x9e3779b97f4a7c15ULL + (seed << 6) + (seed >> 2);
+}
+
+// Most interning comes in runs of the same few styles (an import, a
+// clone loop), so each thread remembers its latest results and skips the
+// shared lock for them. Only indices this thread obtained under the lock
+// end up here, so their entries are safely visible to it; the generation
+// tells whether the entry has been recycled since.
+struct RecentStyle {
+    size_t hash = 0;
+    quint32 style = 0;
+    quint32 generation = 0;
+    bool valid = false;
+};
+
+constexpr int RecentCount = 16;
+thread_local RecentStyle t_recent[RecentCount];
+
+} // namespace
+
+StyleTable::StyleTable()
+{
+    m_chunks[0].reset(new Entry[ChunkSize]);
+    Entry &defaults = m_chunks[0][DefaultStyle];
+    defaults.pen = QPen(Qt::black, 1);
+    defaults.brush = QBrush(Qt::white);
+    defaults.refs = 1;                  // Held for good
+    defaults.live = true;
+    m_lookup.emplace(hash(defaults.pen, defaults.brush), DefaultStyle);
+    m_size = 1;
+}
+
+StyleTable& StyleTable::instance()
+{
+    static StyleTable table;
+    return table;
+}
+
+int StyleTable::size() const
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return static_cast<int>(m_size.load(std::memory_order_relaxed) - m_free.size());
+}
+
+size_t StyleTable::hash(const QPen &pen, const QBrush &brush)
+{
+    size_t seed = 0;
+    combine(seed, std::hash<quint64>()(pen.color().rgba64()));
+    combine(seed, std::hash<double>()(pen.widthF()));
+    combine(seed, size_t(pen.style()) | size_t(pen.capStyle()) << 8 | size_t(pen.joinStyle()) << 16
+                  | size_t(pen.isCosmetic()) << 24);
+    if (pen.style() == Qt::CustomDashLine) {
+        for (double dash : pen.dashPattern()) combine(seed, std::hash<double>()(dash));
+    }
+    combine(seed, std::hash<quint64>()(brush.color().rgba64()));
+    combine(seed, size_t(brush.style()));
+    return seed;
+}
+
+StyleRef StyleTable::intern(const QPen &pen, const QBrush &brush)
+{
+    const size_t key = hash(pen, brush);
+
+    RecentStyle &recent = t_recent[key % RecentCount];
+    if (recent.valid && recent.hash == key && tryAcquire(recent.style)) {
+        const Entry &e = entry(recent.style);
+        if (e.generation.load(std::memory_order_relaxed) == recent.generation
+            && e.pen == pen && e.brush == brush) {
+            return StyleRef(recent.style, StyleRef::Adopt);
+        }
+        release(recent.style);
+    }
+
+    std::lock_guard<std::mutex> lock(m_mutex);
+
+    const Entry *found = nullptr;
+    quint32 style = 0;
+    auto range = m_lookup.equal_range(key);
+    for (auto it = range.first; it != range.second; ++it) {
+        const Entry &e = entry(it->second);
+        if (e.pen == pen && e.brush == brush) {
+            found = &e;
+            style = it->second;
+            break;
+        }
+    }
+
+    if (found) {
+        // May revive an entry whose last reference is being released;
+        // release() checks the count again under the lock
+        found->refs.fetch_add(1, std::memory_order_relaxed);
+    } else {
+        if (!m_free.empty()) {
+            style = m_free.back();
+            m_free.pop_back();
+        } else {
+            style = m_size.load(std::memory_order_relaxed);
+            const quint32 chunk = style >> ChunkBits;
+            if (chunk >= quint32(MaxChunks)) throw std::bad_alloc();
+            if (!m_chunks[chunk]) m_chunks[chunk].reset(new Entry[ChunkSize]);
+            m_size.store(style + 1, std::memory_order_release);
+        }
+
+        Entry &e = m_chunks[style >> ChunkBits][style & (ChunkSize - 1)];
+        e.pen = pen;
+        e.brush = brush;
+        e.live = true;
+        e.refs.store(1, std::memory_order_release);
+        m_lookup.emplace(key, style);
+        found = &e;
+    }
+
+    recent.hash = key;
+    recent.style = style;
+    recent.generation = found->generation.load(std::memory_order_relaxed);
+    recent.valid = true;
+    return StyleRef(style, StyleRef::Adopt);
+}
+
+void StyleTable::acquire(quint32 style) const
+{
+    entry(style).refs.fetch_add(1, std::memory_order_relaxed);
+}
+
+bool StyleTable::tryAcquire(quint32 style) const
+{
+    if (style == DefaultStyle) return true;
+    std::atomic<quint32> &refs = entry(style).refs;
+    quint32 count = refs.load(std::memory_order_relaxed);
+    while (count != 0) {
+        if (refs.compare_exchange_weak(count, count + 1, std::memory_order_acquire,
+                                       std::memory_order_relaxed)) {
+            return true;
+        }
+    }
+    return false;
+}
+
+void StyleTable::release(quint32 style)
+{
+    if (style == DefaultStyle) return;
+    const Entry &e = entry(style);
+    if (e.refs.fetch_sub(1, std::memory_order_acq_rel) != 1) return;
+
+    std::lock_guard<std::mutex> lock(m_mutex);
+    // Revived by intern() meanwhile, or already recycled by a release
+    // that raced with the revival
+    if (e.refs.load(std::memory_order_relaxed) != 0 || !e.live) return;
+
+    auto range = m_lookup.equal_range(hash(e.pen, e.brush));
+    for (auto it = range.first; it != range.second; ++it) {
+        if (it->second == style) {
+            m_lookup.erase(it);
+            break;
+        }
+    }
+
+    Entry &slot = m_chunks[style >> ChunkBits][style & (ChunkSize - 1)];
+    slot.live = false;
+    slot.generation.fetch_add(1, std::memory_order_relaxed);
+    slot.pen = QPen();
+    slot.brush = QBrush();
+    m_free.push_back(style);
+}
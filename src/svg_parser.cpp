@@ -6,9 +6,22 @@
 #include "bezier.h"
 #include <QFile>
 #include <QTextStream>
+#include <QBuffer>
 #include <QDebug>
+#include <algorithm>
+#include <charconv>
+#include <cstring>
+#include <limits>
+#include "svgwriter.h"
+#include "threadpool.h"
+#include "styletable.h"
+
+#ifdef ENABLE_LIBXML2
+#include <libxml/xmlreader.h>
+#endif
 
 SVGParser::SVGParser()
+    : m_importThreads(0)
 {
 }
 
@@ -18,6 +31,9 @@ SVGParser::~SVGParser()
 
 bool SVGParser::importFromFile(const QString &filename, Document *document)
 {
+#ifdef ENABLE_LIBXML2
+    return importStreaming(filename, document);
+#else
     QFile file(filename);
     if (!file.open(QIODevice::ReadOnly | QIODevice::Text)) {
         qDebug() << "Failed to open SVG file:" << filename;
@@ -29,22 +45,37 @@ bool SVGParser::importFromFile(const QString &filename, Document *document)
     file.close();
     
     return parseSVGString(svgContent, document);
+#endif
+}
+
+void SVGParser::setImportThreadCount(int count)
+{
+    m_importThreads = qMax(0, count);
+}
+
+int SVGParser::getImportThreadCount() const
+{
+    return m_importThreads;
 }
 
 bool SVGParser::exportToFile(const QString &filename, Document *document)
 {
-    QString svgContent = generateSVGString(document);
-    
+    if (!document) return false;
+
+    // Shapes stream through SvgWriter's buffer straight into the file
+    // descriptor; the document is never held as one string.
     QFile file(filename);
-    if (!file.open(QIODevice::WriteOnly | QIODevice::Text)) {
+    if (!file.open(QIODevice::WriteOnly | QIODevice::Truncate | QIODevice::Unbuffered)) {
         qDebug() << "Failed to create SVG file:" << filename;
         return false;
     }
-    
-    QTextStream out(&file);
-    out << svgContent;
-    file.close();
-    
+
+    SvgWriter out(&file);
+    writeDocument(out, document);
+    if (!out.flush()) {
+        qDebug() << "Failed to write SVG file:" << filename;
+        return false;
+    }
     return true;
 }
 
@@ -56,7 +87,7 @@ bool SVGParser::parseSVGString(const QString &svgString, Document *document)
     if (!document) return false;
     
     // Clear existing content
-    document->clear();
+    resetDocument(document);
     
     // Parse basic SVG structure
     if (svgString.contains("<svg")) {
@@ -82,8 +113,10 @@ bool SVGParser::parseSVGString(const QString &svgString, Document *document)
             }
         }
         
-        // Parse basic shapes (simplified)
+        // Parse basic shapes (simplified), reported and undone as one edit
+        document->beginTransaction();
         parseBasicShapes(svgString, document);
+        document->commitTransaction();
     }
     
     return true;
@@ -92,29 +125,736 @@ bool SVGParser::parseSVGString(const QString &svgString, Document *document)
 QString SVGParser::generateSVGString(Document *document)
 {
     if (!document) return "";
-    
-    QString svg;
-    QTextStream stream(&svg);
-    
-    QSizeF size = document->getSize();
-    
-    stream << "<?xml version=\"1.0\" encoding=\"UTF-8\"?>\n";
-    stream << "<svg xmlns=\"http://www.w3.org/2000/svg\" ";
-    stream << "width=\"" << size.width() << "\" height=\"" << size.height() << "\">\n";
-    
-    // Write shapes
+
+    QByteArray svg;
+    QBuffer buffer(&svg);
+    buffer.open(QIODevice::WriteOnly);
+    {
+        SvgWriter out(&buffer);
+        writeDocument(out, document);
+    }
+    return QString::fromUtf8(svg);
+}
+
+void SVGParser::writeDocument(SvgWriter &out, Document *document)
+{
+    const QSizeF size = document->getSize();
+
+    out << "<?xml version=\"1.0\" encoding=\"UTF-8\"?>\n";
+    out << "<svg xmlns=\"http://www.w3.org/2000/svg\" ";
+    out << "width=\"" << size.width() << "\" height=\"" << size.height() << "\">\n";
+
+    // Write shapes; hidden ones are skipped off the flags column without
+    // touching the Shape objects
     for (Layer *layer : document->getLayers()) {
         if (!layer->isVisible()) continue;
-        
-        for (Shape *shape : layer->getShapes()) {
-            if (shape->isVisible()) {
-                writeShape(stream, shape);
+
+        const ShapeColumns &columns = layer->getColumns();
+        const quint8 *flags = columns.flags();
+        for (int i = 0; i < columns.size(); ++i) {
+            if (flags[i] & ShapeColumns::Visible) {
+                writeShape(out, columns.shape(i));
             }
         }
     }
-    
-    stream << "</svg>\n";
-    return svg;
+
+    out << "</svg>\n";
+}
+
+// ========================
+// Streaming import
+// ========================
+namespace {
+
+bool isSpace(char c)
+{
+    return c == ' ' || c == '\t' || c == '\n' || c == '\r';
+}
+
+std::string_view trimmed(std::string_view text)
+{
+    while (!text.empty() && isSpace(text.front())) text.remove_prefix(1);
+    while (!text.empty() && isSpace(text.back())) text.remove_suffix(1);
+    return text;
+}
+
+// std::from_chars straight off the UTF-8 bytes. Trailing units ("10px")
+// are ignored.
+bool toNumber(std::string_view text, double &value)
+{
+    text = trimmed(text);
+    if (!text.empty() && text.front() == '+') text.remove_prefix(1);
+    auto result = std::from_chars(text.data(), text.data() + text.size(), value);
+    return result.ec == std::errc() && result.ptr != text.data();
+}
+
+double toNumber(std::string_view text)
+{
+    double value = 0.0;
+    return toNumber(text, value) ? value : 0.0;
+}
+
+int hexDigit(char c)
+{
+    if (c >= '0' && c <= '9') return c - '0';
+    if (c >= 'a' && c <= 'f') return c - 'a' + 10;
+    if (c >= 'A' && c <= 'F') return c - 'A' + 10;
+    return -1;
+}
+
+QColor toColor(std::string_view text)
+{
+    text = trimmed(text);
+
+    if (!text.empty() && text.front() == '#') {
+        int digits[6];
+        const size_t count = text.size() - 1;
+        if (count != 3 && count != 6) return Qt::black;
+        for (size_t i = 0; i < count; ++i) {
+            digits[i] = hexDigit(text[i + 1]);
+            if (digits[i] < 0) return Qt::black;
+        }
+        if (count == 3) {
+            return QColor(digits[0] * 17, digits[1] * 17, digits[2] * 17);
+        }
+        return QColor(digits[0] * 16 + digits[1], digits[2] * 16 + digits[3],
+                      digits[4] * 16 + digits[5]);
+    }
+
+    if (text.substr(0, 4) == "rgb(" && text.back() == ')') {
+        std::string_view rest = text.substr(4, text.size() - 5);
+        int components[3];
+        for (int i = 0; i < 3; ++i) {
+            size_t comma = rest.find(',');
+            if ((comma == std::string_view::npos) != (i == 2)) return Qt::black;
+            std::string_view part = trimmed(rest.substr(0, comma));
+            auto result = std::from_chars(part.data(), part.data() + part.size(), components[i]);
+            if (result.ec != std::errc()) return Qt::black;
+            if (comma != std::string_view::npos) rest.remove_prefix(comma + 1);
+        }
+        return QColor(components[0], components[1], components[2]);
+    }
+
+    // Named colours are rare enough to go through QColor's own table
+    QColor color(QString::fromLatin1(text.data(), int(text.size())));
+    return color.isValid() ? color : QColor(Qt::black);
+}
+
+} // namespace
+
+std::string_view SVGParser::SvgAttributes::value(std::string_view name) const
+{
+    for (const auto &item : items) {
+        if (item.first == name) return item.second;
+    }
+    return std::string_view();
+}
+
+bool SVGParser::SvgAttributes::contains(std::string_view name) const
+{
+    for (const auto &item : items) {
+        if (item.first == name) return true;
+    }
+    return false;
+}
+
+#ifdef ENABLE_LIBXML2
+namespace {
+
+inline std::string_view fromXml(const xmlChar *text)
+{
+    return text ? std::string_view(reinterpret_cast<const char*>(text)) : std::string_view();
+}
+
+// Containers whose children are never rendered directly
+bool isNonRenderingContainer(std::string_view tag)
+{
+    return tag == "defs" || tag == "symbol" || tag == "clipPath" || tag == "mask"
+        || tag == "pattern" || tag == "marker" || tag == "linearGradient"
+        || tag == "radialGradient" || tag == "metadata" || tag == "title" || tag == "desc";
+}
+
+// Chunks smaller than this are not worth a reader of their own
+constexpr size_t MinChunkBytes = 64 * 1024;
+
+// Offset just past the '>' closing the tag at pos, skipping quoted values
+size_t tagEnd(std::string_view text, size_t pos)
+{
+    char quote = 0;
+    for (; pos < text.size(); ++pos) {
+        const char c = text[pos];
+        if (quote) {
+            if (c == quote) quote = 0;
+        } else if (c == '"' || c == '\'') {
+            quote = c;
+        } else if (c == '>') {
+            return pos + 1;
+        }
+    }
+    return std::string_view::npos;
+}
+
+size_t skipPast(std::string_view text, size_t pos, std::string_view terminator)
+{
+    size_t found = text.find(terminator, pos);
+    return found == std::string_view::npos ? found : found + terminator.size();
+}
+
+// Element-boundary split of a document for chunked parsing
+struct SvgChunks {
+    std::string_view openTag;               // The root <svg ...> tag, verbatim
+    std::string closeTag;
+    std::vector<std::string_view> chunks;   // Runs of whole top-level children
+};
+
+// Cuts the children of the root <svg> into runs of whole elements of about
+// text.size() / chunkCount bytes, only tracking tag nesting. Returns false
+// whenever the file is anything but plain: non-UTF-8 encodings, an internal
+// DTD subset (entities would not survive the split), or markup that does not
+// balance. The single-pass reader then takes it and reports any error itself.
+bool splitTopLevel(std::string_view text, int chunkCount, SvgChunks &result)
+{
+    constexpr size_t npos = std::string_view::npos;
+    size_t pos = (text.substr(0, 3) == "\xEF\xBB\xBF") ? 3 : 0;
+
+    // Prolog
+    while (true) {
+        pos = text.find('<', pos);
+        if (pos == npos) return false;
+
+        const std::string_view rest = text.substr(pos);
+        size_t end;
+        if (rest.substr(0, 5) == "<?xml") {
+            end = skipPast(text, pos, "?>");
+            if (end == npos) return false;
+            const std::string_view declaration = text.substr(pos, end - pos);
+            if (declaration.find("encoding") != npos && declaration.find("UTF-8") == npos
+                && declaration.find("utf-8") == npos) {
+                return false;
+            }
+        } else if (rest.substr(0, 2) == "<?") {
+            end = skipPast(text, pos, "?>");
+        } else if (rest.substr(0, 4) == "<!--") {
+            end = skipPast(text, pos, "-->");
+        } else if (rest.substr(0, 2) == "<!") {
+            end = tagEnd(text, pos);
+            if (end != npos && text.substr(pos, end - pos).find('[') != npos) return false;
+        } else {
+            break;
+        }
+        if (end == npos) return false;
+        pos = end;
+    }
+
+    // Root element
+    const size_t rootEnd = tagEnd(text, pos);
+    if (rootEnd == npos || text[rootEnd - 2] == '/') return false;
+    size_t nameEnd = pos + 1;
+    while (nameEnd < rootEnd && !isSpace(text[nameEnd]) && text[nameEnd] != '>'
+           && text[nameEnd] != '/') {
+        ++nameEnd;
+    }
+    const std::string_view name = text.substr(pos + 1, nameEnd - pos - 1);
+    const size_t colon = name.find(':');
+    if ((colon == npos ? name : name.substr(colon + 1)) != "svg") return false;
+
+    result.openTag = text.substr(pos, rootEnd - pos);
+    result.closeTag = "</" + std::string(name) + ">";
+    result.chunks.clear();
+
+    // Children, cut wherever the nesting is back at the root after about
+    // the target size
+    const size_t target = (text.size() - rootEnd) / size_t(qMax(1, chunkCount)) + 1;
+    size_t chunkStart = rootEnd;
+    int depth = 0;
+    pos = rootEnd;
+    while (true) {
+        pos = text.find('<', pos);
+        if (pos == npos) return false;
+
+        const std::string_view rest = text.substr(pos);
+        size_t end;
+        if (rest.substr(0, 4) == "<!--") {
+            end = skipPast(text, pos, "-->");
+        } else if (rest.substr(0, 9) == "<![CDATA[") {
+            end = skipPast(text, pos, "]]>");
+        } else if (rest.substr(0, 2) == "<?") {
+            end = skipPast(text, pos, "?>");
+        } else if (rest.substr(0, 2) == "<!") {
+            return false;
+        } else if (rest.substr(0, 2) == "</") {
+            end = tagEnd(text, pos);
+            if (end == npos) return false;
+            if (depth == 0) {
+                // Must be the root's own end tag with only misc after it
+                const std::string_view closing = trimmed(text.substr(pos + 2, end - pos - 3));
+                if (closing != name) return false;
+                result.chunks.push_back(text.substr(chunkStart, pos - chunkStart));
+                pos = end;
+                break;
+            }
+            --depth;
+        } else {
+            end = tagEnd(text, pos);
+            if (end == npos) return false;
+            if (text[end - 2] != '/') ++depth;
+        }
+        if (end == npos) return false;
+        pos = end;
+
+        if (depth == 0 && pos - chunkStart >= target) {
+            result.chunks.push_back(text.substr(chunkStart, pos - chunkStart));
+            chunkStart = pos;
+        }
+    }
+
+    // Trailing comments and processing instructions only
+    while ((pos = text.find_first_not_of(" \t\r\n", pos)) != npos) {
+        const std::string_view rest = text.substr(pos);
+        if (rest.substr(0, 4) == "<!--") pos = skipPast(text, pos, "-->");
+        else if (rest.substr(0, 2) == "<?") pos = skipPast(text, pos, "?>");
+        else return false;
+        if (pos == npos) return false;
+    }
+    return true;
+}
+
+// Feeds libxml2 the root tag, one chunk and the closing tag in sequence,
+// so each chunk parses as a document of its own without being copied
+struct ChunkInput {
+    std::string_view parts[3];
+    int part = 0;
+    size_t offset = 0;
+};
+
+int readChunkInput(void *context, char *buffer, int length)
+{
+    ChunkInput *input = static_cast<ChunkInput*>(context);
+    int written = 0;
+    while (written < length && input->part < 3) {
+        const std::string_view part = input->parts[input->part];
+        const size_t count = std::min(size_t(length - written), part.size() - input->offset);
+        std::memcpy(buffer + written, part.data() + input->offset, count);
+        written += int(count);
+        input->offset += count;
+        if (input->offset == part.size()) {
+            ++input->part;
+            input->offset = 0;
+        }
+    }
+    return written;
+}
+
+constexpr int ReaderOptions = XML_PARSE_NONET | XML_PARSE_COMPACT | XML_PARSE_HUGE;
+
+} // namespace
+
+bool SVGParser::importStreaming(const QString &filename, Document *document)
+{
+    if (!document) return false;
+
+    // Parse the mapped UTF-8 bytes in place: no QString transcode of the
+    // file, and the mapping is backed by the page cache rather than the heap.
+    QFile file(filename);
+    if (!file.open(QIODevice::ReadOnly)) {
+        qDebug() << "Failed to open SVG file:" << filename;
+        return false;
+    }
+    if (file.size() > std::numeric_limits<int>::max()) {
+        qDebug() << "SVG file too large:" << filename;
+        return false;
+    }
+
+    // Must happen on one thread before readers are created concurrently
+    xmlInitParser();
+
+    const QByteArray url = QFile::encodeName(filename);
+    const char *data = file.size() > 0
+        ? reinterpret_cast<const char*>(file.map(0, file.size())) : nullptr;
+
+    if (data && m_importThreads != 1) {
+        const std::string_view text(data, size_t(file.size()));
+        const int threads = m_importThreads > 0
+            ? m_importThreads : ThreadPool::globalInstance().threadCount() + 1;
+        // A few chunks per thread so stealing can even out dense regions
+        const int chunkCount = int(qMin<size_t>(size_t(threads) * 4, text.size() / MinChunkBytes));
+
+        SvgChunks split;
+        if (chunkCount > 1 && splitTopLevel(text, chunkCount, split) && split.chunks.size() > 1) {
+            return importChunked(split.chunks, split.openTag, split.closeTag, url, document);
+        }
+    }
+
+    xmlTextReaderPtr reader = data
+        ? xmlReaderForMemory(data, int(file.size()), url.constData(), nullptr, ReaderOptions)
+        : xmlReaderForFile(url.constData(), nullptr, ReaderOptions);     // Not mappable
+    if (!reader) {
+        qDebug() << "Failed to open SVG file:" << filename;
+        return false;
+    }
+
+    resetDocument(document);
+    SvgContent content;
+    const bool ok = readElements(reader, content);
+    xmlFreeTextReader(reader);
+
+    if (content.hasSize) document->setSize(content.size);
+    document->addShapes(content.shapes);
+
+    if (!ok) {
+        qDebug() << "SVG parse error in" << filename;
+        return false;
+    }
+    return true;
+}
+
+bool SVGParser::importChunked(const std::vector<std::string_view> &chunks, std::string_view openTag,
+                              std::string_view closeTag, const QByteArray &url, Document *document)
+{
+    const int count = int(chunks.size());
+    std::vector<SvgContent> contents(chunks.size());
+    std::vector<char> succeeded(chunks.size(), 0);
+
+    // Each chunk is wrapped in the root tag, so it starts from the same
+    // inherited style and namespaces as the serial pass would
+    auto parseChunk = [&](int index) {
+        ChunkInput input;
+        input.parts[0] = openTag;
+        input.parts[1] = chunks[size_t(index)];
+        input.parts[2] = closeTag;
+
+        xmlTextReaderPtr reader = xmlReaderForIO(readChunkInput, nullptr, &input,
+                                                 url.constData(), "UTF-8", ReaderOptions);
+        if (!reader) return;
+        succeeded[size_t(index)] = readElements(reader, contents[size_t(index)]);
+        xmlFreeTextReader(reader);
+    };
+
+    if (m_importThreads > 1) {
+        ThreadPool pool(m_importThreads - 1);   // The calling thread helps out
+        pool.parallelFor(count, parseChunk);
+    } else {
+        ThreadPool::globalInstance().parallelFor(count, parseChunk);
+    }
+
+    // Append in document order. Like the serial pass, stop at the first
+    // error but keep what came before it.
+    resetDocument(document);
+    if (contents.front().hasSize) document->setSize(contents.front().size);
+
+    QList<Shape*> shapes;
+    bool ok = true;
+    for (int i = 0; i < count; ++i) {
+        if (ok) {
+            shapes.append(contents[size_t(i)].shapes);
+        } else {
+            qDeleteAll(contents[size_t(i)].shapes);
+        }
+        if (ok && !succeeded[size_t(i)]) {
+            qDebug() << "SVG parse error in" << QFile::decodeName(url);
+            ok = false;
+        }
+    }
+    document->addShapes(shapes);
+    return ok;
+}
+
+bool SVGParser::readElements(xmlTextReaderPtr reader, SvgContent &content)
+{
+    QList<SvgStyle> styles;                 // One entry per open <svg>/<g>
+    styles.append(SvgStyle());
+    bool sizeRead = false;
+    SvgAttributes attributes;
+
+    // Views onto the attribute text nodes the reader already holds. Only
+    // values split by entity references (&amp; ...) are joined into a copy.
+    auto readAttributes = [&attributes](xmlNodePtr element) {
+        attributes.items.clear();
+        attributes.owned.clear();
+        for (xmlAttrPtr attribute = element->properties; attribute; attribute = attribute->next) {
+            const std::string_view name = fromXml(attribute->name);
+            xmlNodePtr text = attribute->children;
+
+            if (!text) {
+                attributes.items.emplace_back(name, std::string_view());
+            } else if (text->type == XML_TEXT_NODE && !text->next) {
+                attributes.items.emplace_back(name, fromXml(text->content));
+            } else {
+                xmlChar *joined = xmlNodeListGetString(element->doc, text, 1);
+                attributes.owned.emplace_back(joined ? reinterpret_cast<const char*>(joined) : "");
+                xmlFree(joined);
+                attributes.items.emplace_back(name, attributes.owned.back());
+            }
+        }
+    };
+
+    int status = xmlTextReaderRead(reader);
+    while (status == 1) {
+        const int type = xmlTextReaderNodeType(reader);
+
+        if (type == XML_READER_TYPE_ELEMENT) {
+            const std::string_view tag = fromXml(xmlTextReaderConstLocalName(reader));
+            const bool selfClosing = xmlTextReaderIsEmptyElement(reader) == 1;
+
+            if (isNonRenderingContainer(tag) && !selfClosing) {
+                status = xmlTextReaderNext(reader);     // Skip the whole subtree
+                continue;
+            }
+
+            readAttributes(xmlTextReaderCurrentNode(reader));
+
+            if (tag == "svg" || tag == "g") {
+                if (tag == "svg" && !sizeRead) {
+                    double width, height;
+                    if (toNumber(attributes.value("width"), width)
+                        && toNumber(attributes.value("height"), height)) {
+                        content.size = QSizeF(width, height);
+                        content.hasSize = true;
+                    }
+                    sizeRead = true;
+                }
+                // <g/> has no end tag and nothing to apply its style to
+                if (!selfClosing) styles.append(inheritStyle(styles.last(), attributes));
+            } else if (Shape *shape = createShape(tag, attributes, styles.last())) {
+                content.shapes.append(shape);
+            }
+        } else if (type == XML_READER_TYPE_END_ELEMENT) {
+            const std::string_view tag = fromXml(xmlTextReaderConstLocalName(reader));
+            if ((tag == "svg" || tag == "g") && styles.size() > 1) {
+                styles.removeLast();
+            }
+        }
+
+        status = xmlTextReaderRead(reader);
+    }
+
+    return status == 0;
+}
+#endif
+
+Layer* SVGParser::resetDocument(Document *document)
+{
+    // Document::clear() also drops every layer; imported shapes need one
+    document->clear();
+    Layer *layer = new Layer("Layer 1");
+    document->addLayer(layer);
+    document->setActiveLayer(layer);
+    return layer;
+}
+
+SVGParser::SvgStyle SVGParser::inheritStyle(const SvgStyle &parent, const SvgAttributes &attributes)
+{
+    SvgStyle style = parent;
+
+    auto apply = [&style](std::string_view property, std::string_view value) {
+        value = trimmed(value);
+        if (property == "fill" || property == "stroke") {
+            SvgPaint &paint = (property == "fill") ? style.fill : style.stroke;
+            if (value == "none") {
+                paint.kind = SvgPaint::None;
+            } else if (!value.empty()) {
+                paint.kind = SvgPaint::Color;
+                paint.color = toColor(value);
+            }
+        } else if (property == "stroke-width") {
+            double width;
+            if (toNumber(value, width)) style.strokeWidth = width;
+        }
+    };
+
+    for (const auto &item : attributes.items) {
+        apply(item.first, item.second);
+    }
+
+    // style="fill:...;stroke:..." overrides presentation attributes
+    std::string_view inlineStyle = attributes.value("style");
+    while (!inlineStyle.empty()) {
+        size_t end = inlineStyle.find(';');
+        std::string_view declaration = inlineStyle.substr(0, end);
+        inlineStyle.remove_prefix(end == std::string_view::npos ? inlineStyle.size() : end + 1);
+
+        size_t colon = declaration.find(':');
+        if (colon == std::string_view::npos) continue;
+        apply(trimmed(declaration.substr(0, colon)), declaration.substr(colon + 1));
+    }
+
+    // Only translate() is honoured; other transforms are ignored
+    std::string_view transform = trimmed(attributes.value("transform"));
+    if (transform.substr(0, 10) == "translate(") {
+        std::string_view values = transform.substr(10, transform.find(')') - 10);
+        double offset[2] = { 0.0, 0.0 };
+        for (int i = 0; i < 2; ++i) {
+            while (!values.empty() && (isSpace(values.front()) || values.front() == ',')) {
+                values.remove_prefix(1);
+            }
+            if (!values.empty() && values.front() == '+') values.remove_prefix(1);
+            auto result = std::from_chars(values.data(), values.data() + values.size(), offset[i]);
+            if (result.ec != std::errc()) break;
+            values.remove_prefix(result.ptr - values.data());
+        }
+        style.offset += QPointF(offset[0], offset[1]);
+    }
+    return style;
+}
+
+Shape* SVGParser::createShape(std::string_view tag, const SvgAttributes &attributes, const SvgStyle &parentStyle)
+{
+    auto number = [&attributes](std::string_view name) {
+        return toNumber(attributes.value(name));
+    };
+
+    Shape *shape = nullptr;
+    if (tag == "rect") {
+        shape = new Rectangle(QPointF(number("x"), number("y")),
+                              QSizeF(number("width"), number("height")));
+    } else if (tag == "circle") {
+        double r = number("r");
+        shape = new Ellipse(QPointF(number("cx") - r, number("cy") - r), QSizeF(r * 2, r * 2));
+    } else if (tag == "ellipse") {
+        double rx = number("rx");
+        double ry = number("ry");
+        shape = new Ellipse(QPointF(number("cx") - rx, number("cy") - ry), QSizeF(rx * 2, ry * 2));
+    } else if (tag == "line") {
+        shape = new Line(QPointF(number("x1"), number("y1")), QPointF(number("x2"), number("y2")));
+    } else if (tag == "path") {
+        shape = parsePathData(attributes.value("d"));
+    }
+    if (!shape) return nullptr;
+
+    SvgStyle style = inheritStyle(parentStyle, attributes);
+    if (!style.offset.isNull()) shape->move(style.offset);
+    applyStyle(shape, style);
+    return shape;
+}
+
+void SVGParser::applyStyle(Shape *shape, const SvgStyle &style)
+{
+    if (style.fill.kind == SvgPaint::Unset && style.stroke.kind == SvgPaint::Unset) return;
+
+    // Build the pair and intern it once, rather than pen and brush apart
+    QBrush brush = shape->getBrush();
+    if (style.fill.kind == SvgPaint::None) {
+        brush = QBrush(Qt::NoBrush);
+    } else if (style.fill.kind == SvgPaint::Color) {
+        brush = QBrush(style.fill.color);
+    }
+
+    QPen pen = shape->getPen();
+    if (style.stroke.kind == SvgPaint::None) {
+        pen = QPen(Qt::NoPen);
+    } else if (style.stroke.kind == SvgPaint::Color) {
+        pen.setColor(style.stroke.color);
+        if (style.strokeWidth >= 0.0) {
+            pen.setWidthF(style.strokeWidth);
+        }
+    }
+
+    shape->setStyle(StyleTable::instance().intern(pen, brush));
+}
+
+Bezier* SVGParser::parsePathData(std::string_view data)
+{
+    // Reads the subset the exporter writes (M, L, H, V, C, Q, Z, absolute
+    // and relative) into Bezier's point list, which is a start point
+    // followed by cubic segments: every command adds three points, so a
+    // later C stays aligned. Only the first subpath is kept.
+    Bezier *bezier = new Bezier();
+    const char *pos = data.data();
+    const char *const end = data.data() + data.size();
+    char command = 0;
+    QPointF current;
+    bool started = false;
+
+    auto skipSeparators = [&]() {
+        while (pos < end && (isSpace(*pos) || *pos == ',')) ++pos;
+    };
+    auto readNumber = [&](double &value) {
+        skipSeparators();
+        if (pos < end && *pos == '+') ++pos;
+        auto result = std::from_chars(pos, end, value);
+        if (result.ec != std::errc()) return false;
+        pos = result.ptr;
+        return true;
+    };
+    auto readPoint = [&](QPointF &point, bool relative) {
+        double x, y;
+        if (!readNumber(x) || !readNumber(y)) return false;
+        point = relative ? current + QPointF(x, y) : QPointF(x, y);
+        return true;
+    };
+    auto cubicTo = [&](const QPointF &c1, const QPointF &c2, const QPointF &p) {
+        bezier->addPoint(c1);
+        bezier->addPoint(c2);
+        bezier->addPoint(p);
+        current = p;
+    };
+    auto lineTo = [&](const QPointF &p) { cubicTo(current, p, p); };
+    auto isLetter = [](char c) {
+        return (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z');
+    };
+
+    bool done = false;
+    while (!done) {
+        skipSeparators();
+        if (pos >= end) break;
+
+        // 'e'/'E' never starts a command; from_chars consumes exponents
+        if (isLetter(*pos)) {
+            command = *pos++;
+            if (command == 'Z' || command == 'z') {
+                bezier->setClosed(true);
+                done = true;
+                break;
+            }
+        } else if (!command) {
+            break;
+        }
+
+        const bool relative = command >= 'a';
+        QPointF p1, p2, p3;
+        double value;
+
+        switch (relative ? char(command - 'a' + 'A') : command) {
+        case 'M':
+            if (started || !readPoint(p1, relative)) { done = true; break; }
+            bezier->addPoint(p1);
+            current = p1;
+            started = true;
+            command = relative ? 'l' : 'L';     // Extra pairs are line-tos
+            break;
+        case 'L':
+            if (!started || !readPoint(p1, relative)) { done = true; break; }
+            lineTo(p1);
+            break;
+        case 'H':
+            if (!started || !readNumber(value)) { done = true; break; }
+            lineTo(QPointF(relative ? current.x() + value : value, current.y()));
+            break;
+        case 'V':
+            if (!started || !readNumber(value)) { done = true; break; }
+            lineTo(QPointF(current.x(), relative ? current.y() + value : value));
+            break;
+        case 'C':
+            if (!started || !readPoint(p1, relative) || !readPoint(p2, relative)
+                || !readPoint(p3, relative)) { done = true; break; }
+            cubicTo(p1, p2, p3);
+            break;
+        case 'Q':
+            if (!started || !readPoint(p1, relative) || !readPoint(p2, relative)) { done = true; break; }
+            // Degree elevation: the same curve as a cubic
+            cubicTo(current + (p1 - current) * (2.0 / 3.0), p2 + (p1 - p2) * (2.0 / 3.0), p2);
+            break;
+        default:                                // S, T, A: not representable
+            done = true;
+            break;
+        }
+    }
+
+    if (bezier->getPointCount() < 2) {
+        delete bezier;
+        return nullptr;
+    }
+    return bezier;
 }
 
 void SVGParser::parseBasicShapes(const QString &svgString, Document *document)
@@ -283,129 +1023,109 @@ QColor SVGParser::parseColor(const QString &colorString)
     return Qt::black; // Default color
 }
 
-void SVGParser::writeShape(QTextStream &stream, Shape *shape)
+void SVGParser::writeShape(SvgWriter &out, const Shape *shape)
 {
     switch (shape->getType()) {
         case Shape::Rectangle:
-            writeRectangle(stream, dynamic_cast<Rectangle*>(shape));
+            writeRectangle(out, static_cast<const Rectangle*>(shape));
             break;
         case Shape::Ellipse:
-            writeEllipse(stream, dynamic_cast<Ellipse*>(shape));
+            writeEllipse(out, static_cast<const Ellipse*>(shape));
             break;
         case Shape::Line:
-            writeLine(stream, dynamic_cast<Line*>(shape));
+            writeLine(out, static_cast<const Line*>(shape));
             break;
         case Shape::Bezier:
-            writeBezier(stream, dynamic_cast<Bezier*>(shape));
+            writeBezier(out, static_cast<const Bezier*>(shape));
+            break;
+        default:
             break;
     }
 }
 
-void SVGParser::writeRectangle(QTextStream &stream, Rectangle *rect)
+void SVGParser::writeStyle(SvgWriter &out, const Shape *shape, bool filled)
 {
-    QPointF pos = rect->getPosition();
-    QSizeF size = rect->getSize();
-    QPen pen = rect->getPen();
-    QBrush brush = rect->getBrush();
-    
-    stream << "  <rect x=\"" << pos.x() << "\" y=\"" << pos.y() << "\" ";
-    stream << "width=\"" << size.width() << "\" height=\"" << size.height() << "\" ";
-    
-    if (brush.color() != Qt::white) {
-        stream << "fill=\"" << colorToString(brush.color()) << "\" ";
+    const QPen &pen = shape->getPen();
+    const QBrush &brush = shape->getBrush();
+
+    if (filled && brush.color() != Qt::white) {
+        out << "fill=\"" << brush.color() << "\" ";
     }
     if (pen.color() != Qt::black) {
-        stream << "stroke=\"" << colorToString(pen.color()) << "\" ";
-        stream << "stroke-width=\"" << pen.widthF() << "\" ";
+        out << "stroke=\"" << pen.color() << "\" ";
+        out << "stroke-width=\"" << pen.widthF() << "\" ";
     }
-    
-    stream << "/>\n";
 }
 
-void SVGParser::writeEllipse(QTextStream &stream, Ellipse *ellipse)
+void SVGParser::writeRectangle(SvgWriter &out, const Rectangle *rect)
 {
-    QPointF pos = ellipse->getPosition();
-    QSizeF size = ellipse->getSize();
-    QPen pen = ellipse->getPen();
-    QBrush brush = ellipse->getBrush();
-    
-    double cx = pos.x() + size.width() / 2;
-    double cy = pos.y() + size.height() / 2;
-    double rx = size.width() / 2;
-    double ry = size.height() / 2;
-    
-    stream << "  <ellipse cx=\"" << cx << "\" cy=\"" << cy << "\" ";
-    stream << "rx=\"" << rx << "\" ry=\"" << ry << "\" ";
-    
-    if (brush.color() != Qt::white) {
-        stream << "fill=\"" << colorToString(brush.color()) << "\" ";
-    }
-    if (pen.color() != Qt::black) {
-        stream << "stroke=\"" << colorToString(pen.color()) << "\" ";
-        stream << "stroke-width=\"" << pen.widthF() << "\" ";
-    }
-    
-    stream << "/>\n";
+    const QPointF pos = rect->getPosition();
+    const QSizeF size = rect->getSize();
+
+    out << "  <rect x=\"" << pos.x() << "\" y=\"" << pos.y() << "\" ";
+    out << "width=\"" << size.width() << "\" height=\"" << size.height() << "\" ";
+    writeStyle(out, rect, true);
+    out << "/>\n";
 }
 
-void SVGParser::writeLine(QTextStream &stream, Line *line)
+void SVGParser::writeEllipse(SvgWriter &out, const Ellipse *ellipse)
 {
-    QPointF start = line->getStartPoint();
-    QPointF end = line->getEndPoint();
-    QPen pen = line->getPen();
-    
-    stream << "  <line x1=\"" << start.x() << "\" y1=\"" << start.y() << "\" ";
-    stream << "x2=\"" << end.x() << "\" y2=\"" << end.y() << "\" ";
-    
-    if (pen.color() != Qt::black) {
-        stream << "stroke=\"" << colorToString(pen.color()) << "\" ";
-        stream << "stroke-width=\"" << pen.widthF() << "\" ";
-    }
-    
-    stream << "/>\n";
+    const QPointF pos = ellipse->getPosition();
+    const QSizeF size = ellipse->getSize();
+
+    const double cx = pos.x() + size.width() / 2;
+    const double cy = pos.y() + size.height() / 2;
+    const double rx = size.width() / 2;
+    const double ry = size.height() / 2;
+
+    out << "  <ellipse cx=\"" << cx << "\" cy=\"" << cy << "\" ";
+    out << "rx=\"" << rx << "\" ry=\"" << ry << "\" ";
+    writeStyle(out, ellipse, true);
+    out << "/>\n";
 }
 
-void SVGParser::writeBezier(QTextStream &stream, Bezier *bezier)
+void SVGParser::writeLine(SvgWriter &out, const Line *line)
 {
-    if (bezier->getPointCount() < 2) return;
-    
-    stream << "  <path d=\"";
-    stream << "M " << bezier->getPoint(0).x() << " " << bezier->getPoint(0).y();
-    
-    for (int i = 1; i < bezier->getPointCount(); i += 3) {
-        if (i + 2 < bezier->getPointCount()) {
-            stream << " C " << bezier->getPoint(i).x() << " " << bezier->getPoint(i).y();
-            stream << " " << bezier->getPoint(i + 1).x() << " " << bezier->getPoint(i + 1).y();
-            stream << " " << bezier->getPoint(i + 2).x() << " " << bezier->getPoint(i + 2).y();
-        } else if (i + 1 < bezier->getPointCount()) {
-            stream << " Q " << bezier->getPoint(i).x() << " " << bezier->getPoint(i).y();
-            stream << " " << bezier->getPoint(i + 1).x() << " " << bezier->getPoint(i + 1).y();
+    const QPointF start = line->getStartPoint();
+    const QPointF end = line->getEndPoint();
+
+    out << "  <line x1=\"" << start.x() << "\" y1=\"" << start.y() << "\" ";
+    out << "x2=\"" << end.x() << "\" y2=\"" << end.y() << "\" ";
+    writeStyle(out, line, false);
+    out << "/>\n";
+}
+
+void SVGParser::writeBezier(SvgWriter &out, const Bezier *bezier)
+{
+    const int count = bezier->getPointCount();
+    if (count < 2) return;
+
+    auto point = [&out, bezier](int index) {
+        const QPointF p = bezier->getPoint(index);
+        out << p.x() << ' ' << p.y();
+    };
+
+    out << "  <path d=\"M ";
+    point(0);
+
+    for (int i = 1; i < count; i += 3) {
+        if (i + 2 < count) {
+            out << " C "; point(i);
+            out << ' '; point(i + 1);
+            out << ' '; point(i + 2);
+        } else if (i + 1 < count) {
+            out << " Q "; point(i);
+            out << ' '; point(i + 1);
         } else {
-            stream << " L " << bezier->getPoint(i).x() << " " << bezier->getPoint(i).y();
+            out << " L "; point(i);
         }
     }
-    
+
     if (bezier->isClosed()) {
-        stream << " Z";
+        out << " Z";
     }
-    
-    stream << "\" ";
-    
-    QPen pen = bezier->getPen();
-    QBrush brush = bezier->getBrush();
-    
-    if (brush.color() != Qt::white) {
-        stream << "fill=\"" << colorToString(brush.color()) << "\" ";
-    }
-    if (pen.color() != Qt::black) {
-        stream << "stroke=\"" << colorToString(pen.color()) << "\" ";
-        stream << "stroke-width=\"" << pen.widthF() << "\" ";
-    }
-    
-    stream << "/>\n";
-}
 
-QString SVGParser::colorToString(const QColor &color)
-{
-    return color.name();
-} 
\ No newline at end of file
+    out << "\" ";
+    writeStyle(out, bezier, true);
+    out << "/>\n";
+}
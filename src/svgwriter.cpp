@@ -0,0 +1,89 @@
+#include "svgwriter.h"
+
+#include <charconv>
+#include <cstring>
+
+SvgWriter::SvgWriter(QIODevice *device)
+    : m_device(device)
+    , m_buffer(new char[BufferSize])
+    , m_used(0)
+    , m_error(device == nullptr)
+{
+}
+
+SvgWriter::~SvgWriter()
+{
+    flush();
+}
+
+// ========================
+// Output
+// ========================
+SvgWriter& SvgWriter::operator<<(std::string_view text)
+{
+    while (!text.empty()) {
+        reserve(1);
+        const int count = int(qMin<size_t>(text.size(), size_t(BufferSize - m_used)));
+        std::memcpy(m_buffer.get() + m_used, text.data(), size_t(count));
+        m_used += count;
+        text.remove_prefix(size_t(count));
+    }
+    return *this;
+}
+
+SvgWriter& SvgWriter::operator<<(const char *text)
+{
+    return *this << std::string_view(text);
+}
+
+SvgWriter& SvgWriter::operator<<(char c)
+{
+    reserve(1);
+    m_buffer[m_used++] = c;
+    return *this;
+}
+
+SvgWriter& SvgWriter::operator<<(double value)
+{
+    // 32 bytes hold any shortest-form double ("-1.2345678901234567e-308")
+    reserve(32);
+    char *begin = m_buffer.get() + m_used;
+    auto result = std::to_chars(begin, begin + 32, value);
+    if (result.ec == std::errc()) {
+        m_used += int(result.ptr - begin);
+    }
+    return *this;
+}
+
+SvgWriter& SvgWriter::operator<<(const QColor &color)
+{
+    static const char digits[] = "0123456789abcdef";
+    const int channels[3] = { color.red(), color.green(), color.blue() };
+
+    reserve(7);
+    m_buffer[m_used++] = '#';
+    for (int channel : channels) {
+        m_buffer[m_used++] = digits[(channel >> 4) & 0xf];
+        m_buffer[m_used++] = digits[channel & 0xf];
+    }
+    return *this;
+}
+
+bool SvgWriter::flush()
+{
+    if (m_used > 0 && !m_error) {
+        m_error = m_device->write(m_buffer.get(), m_used) != m_used;
+    }
+    m_used = 0;
+    return !m_error;
+}
+
+bool SvgWriter::hasError() const
+{
+    return m_error;
+}
+
+void SvgWriter::reserve(int bytes)
+{
+    if (BufferSize - m_used < bytes) flush();
+}
@@ -12,13 +12,55 @@ void Text::draw(QPainter &painter)
 {
     if (!isVisible()) return;
 
+    QRectF rect(getPosition(), getSize());
+    QPointF center = rect.center();
+
     painter.save();
+    painter.translate(center.x(), center.y());
+    painter.rotate(getRotation());
+    painter.translate(-center.x(), -center.y());
+
     painter.setPen(getPen());
     painter.setFont(QFont("Arial", 14));
-    painter.drawText(QRectF(getPosition(), getSize()), Qt::AlignLeft, m_text);
+    painter.drawText(rect, Qt::AlignLeft, m_text);
     painter.restore();
 }
 
+#ifdef ENABLE_CAIRO
+void Text::draw(cairo_t *cr)
+{
+    if (!isVisible() || !cr) return;
+
+    QPen pen = getPen();
+    if (pen.style() == Qt::NoPen) return;   // QPainter draws text with the pen
+
+    cairo_save(cr);
+    rotateContext(cr);
+
+    // Same face and size as draw(QPainter&): 14 pt at 96 dpi, lines
+    // top-aligned in the box
+    cairo_select_font_face(cr, "Arial", CAIRO_FONT_SLANT_NORMAL, CAIRO_FONT_WEIGHT_NORMAL);
+    cairo_set_font_size(cr, 14.0 * 96.0 / 72.0);
+    cairo_font_extents_t extents;
+    cairo_font_extents(cr, &extents);
+
+    QColor color = pen.color();
+    cairo_set_source_rgba(cr, color.redF(), color.greenF(), color.blueF(), color.alphaF());
+
+    const QPointF pos = getPosition();
+    double baseline = pos.y() + extents.ascent;
+    for (const QString &line : m_text.split('\n')) {
+        const QByteArray utf8 = line.toUtf8();
+        cairo_move_to(cr, pos.x(), baseline);
+        cairo_show_text(cr, utf8.constData());
+        baseline += extents.height;
+    }
+
+    cairo_new_path(cr);
+    cairo_restore(cr);
+}
+#endif
+
 bool Text::contains(const QPointF &point) const
 {
     return QRectF(getPosition(), getSize()).contains(point);
@@ -30,8 +72,7 @@ Text* Text::clone() const
     t->setText(m_text);
     t->setPosition(getPosition());
     t->setSize(getSize());
-    t->setPen(getPen());
-    t->setBrush(getBrush());
+    t->setStyle(getStyle());
     t->setVisible(isVisible());
     return t;
 }
@@ -0,0 +1,169 @@
+#include "threadpool.h"
+
+#include <QThread>
+
+namespace {
+
+// Which pool/worker the current thread belongs to (-1: not a worker)
+thread_local const ThreadPool *t_pool = nullptr;
+thread_local int t_workerIndex = -1;
+
+} // namespace
+
+ThreadPool::ThreadPool(int threadCount)
+{
+    if (threadCount <= 0) threadCount = qMax(1, QThread::idealThreadCount());
+
+    for (int i = 0; i < threadCount; ++i) {
+        m_workers.push_back(std::make_unique<Worker>());
+    }
+    for (int i = 0; i < threadCount; ++i) {
+        m_threads.emplace_back(&ThreadPool::run, this, i);
+    }
+}
+
+ThreadPool::~ThreadPool()
+{
+    {
+        std::lock_guard<std::mutex> lock(m_sleepMutex);
+        m_stop = true;
+    }
+    m_wake.notify_all();
+
+    for (std::thread &thread : m_threads) {
+        thread.join();
+    }
+}
+
+ThreadPool& ThreadPool::globalInstance()
+{
+    static ThreadPool pool;
+    return pool;
+}
+
+int ThreadPool::threadCount() const
+{
+    return static_cast<int>(m_workers.size());
+}
+
+// ========================
+// Scheduling
+// ========================
+void ThreadPool::submit(Task task)
+{
+    // Workers keep what they spawn (better locality); everyone else spreads
+    // new work round-robin and lets stealing even out the rest.
+    int index = (t_pool == this)
+        ? t_workerIndex
+        : static_cast<int>(m_nextWorker++ % m_workers.size());
+
+    {
+        Worker &worker = *m_workers[index];
+        std::lock_guard<std::mutex> lock(worker.mutex);
+        worker.tasks.push_back(std::move(task));
+    }
+    ++m_queued;
+
+    {
+        std::lock_guard<std::mutex> lock(m_sleepMutex);
+    }
+    m_wake.notify_one();
+}
+
+void ThreadPool::parallelFor(int count, const std::function<void(int)> &body)
+{
+    if (count <= 0) return;
+    if (count == 1) {
+        body(0);
+        return;
+    }
+
+    struct Batch {
+        std::atomic<int> remaining;
+        std::mutex mutex;
+        std::condition_variable done;
+    } batch;
+    batch.remaining = count;
+
+    for (int i = 0; i < count; ++i) {
+        submit([&batch, &body, i]() {
+            body(i);
+            // Count down under the lock so batch cannot go out of scope
+            // while the last task is still signalling
+            std::lock_guard<std::mutex> lock(batch.mutex);
+            if (--batch.remaining == 0) batch.done.notify_all();
+        });
+    }
+
+    // Help instead of blocking; sleep only once nothing is left to take
+    while (batch.remaining > 0) {
+        if (runPendingTask()) continue;
+
+        std::unique_lock<std::mutex> lock(batch.mutex);
+        batch.done.wait(lock, [&batch]() { return batch.remaining == 0; });
+    }
+    std::lock_guard<std::mutex> lock(batch.mutex);
+}
+
+// ========================
+// Workers
+// ========================
+void ThreadPool::run(int index)
+{
+    t_pool = this;
+    t_workerIndex = index;
+
+    Task task;
+    while (true) {
+        if (popLocal(index, task) || steal(index, task)) {
+            task();
+            task = nullptr;
+            continue;
+        }
+
+        std::unique_lock<std::mutex> lock(m_sleepMutex);
+        m_wake.wait(lock, [this]() { return m_stop || m_queued > 0; });
+        if (m_stop && m_queued == 0) return;
+    }
+}
+
+bool ThreadPool::popLocal(int index, Task &task)
+{
+    Worker &worker = *m_workers[index];
+    std::lock_guard<std::mutex> lock(worker.mutex);
+    if (worker.tasks.empty()) return false;
+
+    task = std::move(worker.tasks.back());
+    worker.tasks.pop_back();
+    --m_queued;
+    return true;
+}
+
+bool ThreadPool::steal(int thief, Task &task)
+{
+    const int count = static_cast<int>(m_workers.size());
+    for (int offset = 1; offset <= count; ++offset) {
+        int victim = (thief + offset) % count;
+        if (victim == thief) continue;
+
+        Worker &worker = *m_workers[victim];
+        std::lock_guard<std::mutex> lock(worker.mutex);
+        if (worker.tasks.empty()) continue;
+
+        task = std::move(worker.tasks.front());
+        worker.tasks.pop_front();
+        --m_queued;
+        return true;
+    }
+    return false;
+}
+
+bool ThreadPool::runPendingTask()
+{
+    Task task;
+    bool found = (t_pool == this)
+        ? (popLocal(t_workerIndex, task) || steal(t_workerIndex, task))
+        : steal(-1, task);
+    if (found) task();
+    return found;
+}
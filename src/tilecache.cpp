@@ -0,0 +1,98 @@
+#include "tilecache.h"
+
+#include <cmath>
+
+TileCache::TileCache(qint64 maxBytes)
+    : m_tiles(maxBytes)
+{
+}
+
+// ========================
+// Budget
+// ========================
+void TileCache::setMaxBytes(qint64 bytes)
+{
+    m_tiles.setMaxCost(bytes);
+}
+
+qint64 TileCache::maxBytes() const
+{
+    return m_tiles.maxCost();
+}
+
+qint64 TileCache::usedBytes() const
+{
+    return m_tiles.totalCost();
+}
+
+int TileCache::tileCount() const
+{
+    return m_tiles.size();
+}
+
+// ========================
+// Lookup / Insert
+// ========================
+QImage* TileCache::tile(double zoom, int tx, int ty) const
+{
+    return m_tiles.object(Key{ zoom, tx, ty });
+}
+
+QImage* TileCache::insert(double zoom, int tx, int ty, const QImage &image)
+{
+    Key key{ zoom, tx, ty };
+    QImage *copy = new QImage(image);
+    qint64 cost = qint64(image.bytesPerLine()) * image.height();
+
+    // QCache takes ownership and deletes the copy right away when it can
+    // never fit, so only hand back what is actually stored.
+    if (!m_tiles.insert(key, copy, cost)) return nullptr;
+    return m_tiles.object(key);
+}
+
+// ========================
+// Invalidation
+// ========================
+void TileCache::invalidate(const QRectF &worldRect)
+{
+    if (m_tiles.isEmpty() || worldRect.isNull()) return;
+
+    const QRectF world = worldRect.normalized();
+    const QList<Key> keys = m_tiles.keys();
+    for (const Key &key : keys) {
+        // One device pixel of slack for antialiasing at the tile's zoom
+        QRectF device(world.left() * key.zoom - 1.0, world.top() * key.zoom - 1.0,
+                      world.width() * key.zoom + 2.0, world.height() * key.zoom + 2.0);
+        if (device.intersects(QRectF(tileDeviceRect(key.x, key.y)))) {
+            m_tiles.remove(key);
+        }
+    }
+}
+
+void TileCache::clear()
+{
+    m_tiles.clear();
+}
+
+// ========================
+// Tile geometry
+// ========================
+QRect TileCache::tilesCovering(const QRect &deviceRect)
+{
+    const int x1 = int(std::floor(double(deviceRect.left()) / TileSize));
+    const int y1 = int(std::floor(double(deviceRect.top()) / TileSize));
+    const int x2 = int(std::floor(double(deviceRect.right()) / TileSize));
+    const int y2 = int(std::floor(double(deviceRect.bottom()) / TileSize));
+    return QRect(QPoint(x1, y1), QPoint(x2, y2));
+}
+
+QRect TileCache::tileDeviceRect(int tx, int ty)
+{
+    return QRect(tx * TileSize, ty * TileSize, TileSize, TileSize);
+}
+
+QRectF TileCache::tileWorldRect(double zoom, int tx, int ty)
+{
+    const double size = TileSize / zoom;
+    return QRectF(tx * size, ty * size, size, size);
+}
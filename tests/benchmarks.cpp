@@ -0,0 +1,734 @@
+// Timing runs for the hot paths; not part of the unit tests.
+// Build with -DENABLE_BENCHMARKS=ON, then run
+//     VectorGraphicsEditorBenchmarks [name ...]
+// to run the named benchmarks (all of them without arguments).
+
+#include <QCoreApplication>
+#include <QFile>
+#include <QImage>
+#include <QTemporaryDir>
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <functional>
+#include <random>
+#include <vector>
+#include "../include/document.h"
+#include "../include/svg_parser.h"
+#include "../include/shapepool.h"
+#include "../include/strokefitter.h"
+#include "../include/lodpolicy.h"
+#include "../include/batchrenderer.h"
+#include "../include/ellipse.h"
+#include "../include/line.h"
+#include "../include/bezier.h"
+#include "../include/affinekernel.h"
+
+namespace {
+
+using Clock = std::chrono::steady_clock;
+
+double elapsedMs(Clock::time_point start)
+{
+    return std::chrono::duration<double, std::milli>(Clock::now() - start).count();
+}
+
+// ========================
+// SVG import
+// ========================
+QByteArray makeFlatSvg(int count)
+{
+    QByteArray svg;
+    svg.reserve(count * 64);
+    svg += "<?xml version=\"1.0\" encoding=\"UTF-8\"?>\n"
+           "<svg xmlns=\"http://www.w3.org/2000/svg\" width=\"10000\" height=\"10000\">\n";
+    for (int i = 0; i < count; ++i) {
+        const QByteArray x = QByteArray::number(i % 10000);
+        const QByteArray y = QByteArray::number(i / 10000);
+        switch (i % 4) {
+        case 0:
+            svg += "  <rect x=\"" + x + "\" y=\"" + y + "\" width=\"8\" height=\"6\" fill=\"#3366cc\"/>\n";
+            break;
+        case 1:
+            svg += "  <circle cx=\"" + x + "\" cy=\"" + y + "\" r=\"4\" stroke=\"#000000\"/>\n";
+            break;
+        case 2:
+            svg += "  <line x1=\"" + x + "\" y1=\"" + y + "\" x2=\"" + y + "\" y2=\"" + x + "\"/>\n";
+            break;
+        default:
+            svg += "  <path d=\"M " + x + " " + y + " C 1 2 3 4 5 6 Z\"/>\n";
+            break;
+        }
+    }
+    svg += "</svg>\n";
+    return svg;
+}
+
+void benchmarkSvgImport()
+{
+    const int elements = 1000000;
+    QTemporaryDir dir;
+    const QString path = dir.filePath("flat.svg");
+    {
+        QFile file(path);
+        if (!file.open(QIODevice::WriteOnly)) return;
+        file.write(makeFlatSvg(elements));
+    }
+
+    for (int threads : { 1, 2, 4, 8 }) {
+        SVGParser parser;
+        parser.setImportThreadCount(threads);
+        Document document;
+
+        const Clock::time_point start = Clock::now();
+        const bool ok = parser.importFromFile(path, &document);
+        const double ms = elapsedMs(start);
+
+        std::printf("svg-import   %d elements  threads=%d  %9.1f ms  %s\n", elements, threads, ms,
+                    ok && document.getAllShapes().size() == elements ? "ok" : "FAILED");
+    }
+}
+
+void benchmarkSvgExport()
+{
+    const int shapes = 1000000;
+    Document document;
+    for (int i = 0; i < shapes; ++i) {
+        document.addShape(new Rectangle(QPointF(i % 10000 * 1.25, i / 10000 * 0.75), QSizeF(8.5, 6.25)));
+    }
+
+    QTemporaryDir dir;
+    const QString path = dir.filePath("export.svg");
+    SVGParser parser;
+
+    const Clock::time_point start = Clock::now();
+    const bool ok = parser.exportToFile(path, &document);
+    const double ms = elapsedMs(start);
+
+    std::printf("svg-export   %d shapes  %9.1f ms  %lld bytes  %s\n", shapes, ms,
+                static_cast<long long>(QFile(path).size()), ok ? "ok" : "FAILED");
+}
+
+// ========================
+// Native format
+// ========================
+void benchmarkNativeIo()
+{
+    const int shapes = 1000000;
+    Document document;
+    QList<Shape*> created;
+    created.reserve(shapes);
+    for (int i = 0; i < shapes; ++i) {
+        Shape *shape = i % 2 ? static_cast<Shape*>(new Ellipse(QPointF(i % 10000, i / 10000), QSizeF(8, 6)))
+                             : static_cast<Shape*>(new Rectangle(QPointF(i % 10000, i / 10000), QSizeF(8, 6)));
+        created.append(shape);
+    }
+    document.getActiveLayer()->addShapes(created);
+
+    QTemporaryDir dir;
+    const QString path = dir.filePath("document.vgd");
+
+    Clock::time_point start = Clock::now();
+    const bool saved = document.save(path);
+    const double saveMs = elapsedMs(start);
+
+    Document loaded;
+    start = Clock::now();
+    const bool ok = saved && loaded.load(path);
+    const double loadMs = elapsedMs(start);
+
+    std::printf("native-io    %d shapes  save %9.1f ms  load %9.1f ms  %lld bytes  %s\n", shapes, saveMs,
+                loadMs, static_cast<long long>(QFile(path).size()),
+                ok && loaded.getAllShapes().size() == shapes ? "ok" : "FAILED");
+}
+
+// ========================
+// Viewport culling
+// ========================
+// The same zoomed-out cull three ways: virtual getIndexBounds() on every
+// heap object, the R-tree (plus z-order sort), and the layer's columns.
+void benchmarkCulling()
+{
+    const int shapes = 1000000;
+    Layer layer;
+    QList<Shape*> created;
+    created.reserve(shapes);
+    for (int i = 0; i < shapes; ++i) {
+        created.append(new Rectangle(QPointF(i % 1000 * 10, i / 1000 * 10), QSizeF(8, 6)));
+    }
+    layer.addShapes(created);
+    const QRectF viewport(-100, -100, 8000, 8000);   // About 60% of the shapes
+
+    Clock::time_point start = Clock::now();
+    int objectHits = 0;
+    for (Shape *shape : layer.getShapes()) {
+        if (shape->getIndexBounds().intersects(viewport)) ++objectHits;
+    }
+    const double objectMs = elapsedMs(start);
+
+    start = Clock::now();
+    const int treeHits = layer.getSpatialIndex().query(viewport).size();
+    const double treeMs = elapsedMs(start);
+
+    start = Clock::now();
+    const int columnHits = layer.getColumns().query(viewport).size();
+    const double columnMs = elapsedMs(start);
+
+    // Memory traffic per shape: the object scan loads a pointer and then
+    // the object it points to, the column scan four bounds and the flags
+    // from arrays read front to back
+    const ShapeColumns &columns = layer.getColumns();
+    const int objectBytes = int(sizeof(Shape*) + sizeof(Rectangle));
+    const int columnBytes = int(4 * sizeof(double) + sizeof(quint8));
+    std::printf("cull         %d shapes  objects %7.1f ms  r-tree %7.1f ms  columns %7.1f ms  %s\n",
+                shapes, objectMs, treeMs, columnMs,
+                objectHits == treeHits && treeHits == columnHits ? "ok" : "FAILED");
+    std::printf("cull         bytes read/shape: objects %d  columns %d (%.1fx less)  table %.1f bytes/shape\n",
+                objectBytes, columnBytes, double(objectBytes) / columnBytes,
+                double(columns.memoryUsage()) / shapes);
+}
+
+// ========================
+// Shape allocation
+// ========================
+// Raw allocator cost for Rectangle-sized blocks (pool vs. global heap,
+// freed in shuffled order as a long editing session would), then a full
+// document build and teardown.
+void benchmarkShapeAlloc()
+{
+    const int shapes = 1000000;
+    std::vector<size_t> order(shapes);
+    for (int i = 0; i < shapes; ++i) order[size_t(i)] = size_t(i);
+    std::shuffle(order.begin(), order.end(), std::mt19937(42));
+    std::vector<void*> blocks(shapes);
+
+    Clock::time_point start = Clock::now();
+    for (int i = 0; i < shapes; ++i) blocks[size_t(i)] = ::operator new(sizeof(Rectangle));
+    for (size_t i : order) ::operator delete(blocks[i]);
+    const double heapMs = elapsedMs(start);
+
+    start = Clock::now();
+    for (int i = 0; i < shapes; ++i) blocks[size_t(i)] = ShapePool::allocate(sizeof(Rectangle));
+    for (size_t i : order) ShapePool::deallocate(blocks[i], sizeof(Rectangle));
+    const double poolMs = elapsedMs(start);
+    ShapePool::trim();
+
+    std::printf("shape-alloc  %d blocks  heap %7.1f ms  pool %7.1f ms\n", shapes, heapMs, poolMs);
+
+    Document document;
+    start = Clock::now();
+    QList<Shape*> created;
+    created.reserve(shapes);
+    for (int i = 0; i < shapes; ++i) {
+        created.append(new Rectangle(QPointF(i % 1000, i / 1000), QSizeF(8, 6)));
+    }
+    document.getActiveLayer()->addShapes(created);
+    const double buildMs = elapsedMs(start);
+    const size_t reserved = ShapePool::reservedBytes();
+
+    start = Clock::now();
+    document.clear();
+    const double clearMs = elapsedMs(start);
+
+    std::printf("shape-alloc  %d shapes  build %7.1f ms  clear %7.1f ms  pool %zu MB -> %zu MB\n",
+                shapes, buildMs, clearMs, reserved >> 20, ShapePool::reservedBytes() >> 20);
+}
+
+// ========================
+// Pen strokes
+// ========================
+// A freehand stroke as the Pen tool builds it: one addPoint per mouse
+// move, with the curve already in a layer (so the R-tree follows along)
+void benchmarkPenStroke()
+{
+    const int samples = 100000;
+    Layer layer;
+    Bezier *stroke = new Bezier();
+    layer.addShape(stroke);
+
+    const Clock::time_point start = Clock::now();
+    for (int i = 0; i < samples; ++i) {
+        const double t = i * 0.01;
+        stroke->addPoint(QPointF(t * 10.0 + std::sin(t) * 50.0, std::cos(t * 0.7) * 200.0));
+    }
+    const double ms = elapsedMs(start);
+
+    std::printf("pen-stroke   %d samples  %9.1f ms  %6.3f us/sample  %s\n", samples, ms,
+                ms * 1000.0 / samples, stroke->getPointCount() == samples ? "ok" : "FAILED");
+}
+
+// The same stroke through the Pen tool's fitter: each sample refits the
+// open segment and the curve takes the fitted control points
+void benchmarkStrokeFit()
+{
+    const int samples = 100000;
+    Layer layer;
+    Bezier *stroke = new Bezier();
+    layer.addShape(stroke);
+
+    StrokeFitter fitter(2.0);
+    fitter.begin(QPointF(0.0, 200.0));
+
+    const Clock::time_point start = Clock::now();
+    for (int i = 1; i < samples; ++i) {
+        const double t = i * 0.01;
+        if (fitter.addSample(QPointF(t * 10.0 + std::sin(t) * 50.0, std::cos(t * 0.7) * 200.0))) {
+            stroke->setPoints(fitter.points());
+        }
+    }
+    const double ms = elapsedMs(start);
+
+    std::printf("stroke-fit   %d samples  %9.1f ms  %6.3f us/sample  %d points (%.0fx fewer)\n", samples, ms,
+                ms * 1000.0 / samples, stroke->getPointCount(), double(samples) / stroke->getPointCount());
+}
+
+// ========================
+// Region selection
+// ========================
+// A rubber band and a lasso over part of a 1M-shape drawing, through the
+// layer (range query, then outline tests on the pool) and by testing
+// every shape's outline on one thread
+void benchmarkRegionSelect()
+{
+    const int shapes = 1000000;
+    Layer layer;
+    QList<Shape*> created;
+    created.reserve(shapes);
+    for (int i = 0; i < shapes; ++i) {
+        const QPointF origin(i % 1000 * 10, i / 1000 * 10);
+        if (i % 2) {
+            created.append(new Ellipse(origin, QSizeF(8, 6)));
+        } else {
+            created.append(new Rectangle(origin, QSizeF(8, 6)));
+        }
+    }
+    layer.addShapes(created);
+
+    const QRectF band(1000, 1000, 3000, 3000);      // About 9% of the shapes
+    QPolygonF lasso;
+    for (int k = 0; k < 200; ++k) {
+        const double angle = 2.0 * M_PI * k / 200;
+        const double radius = 1500.0 + 300.0 * std::sin(angle * 7.0);
+        lasso << QPointF(5000 + radius * std::cos(angle), 5000 + radius * std::sin(angle));
+    }
+
+    Clock::time_point start = Clock::now();
+    int bruteBand = 0;
+    for (Shape *shape : layer.getShapes()) {
+        const QRectF outline = shape->getOutline().boundingRect();
+        if (band.contains(outline.topLeft()) && band.contains(outline.bottomRight())) ++bruteBand;
+    }
+    const double bruteBandMs = elapsedMs(start);
+
+    start = Clock::now();
+    const int bandHits = layer.getShapesEnclosedBy(band).size();
+    const double bandMs = elapsedMs(start);
+
+    start = Clock::now();
+    const int lassoHits = layer.getShapesEnclosedBy(lasso).size();
+    const double lassoMs = elapsedMs(start);
+
+    std::printf("region-sel   %d shapes  band: brute %7.1f ms  layer %6.1f ms  %d hits %s  lasso: %6.1f ms  %d hits\n",
+                shapes, bruteBandMs, bandMs, bandHits, bandHits == bruteBand ? "ok" : "FAILED",
+                lassoMs, lassoHits);
+}
+
+// ========================
+// Object snapping
+// ========================
+// About 1M snap candidates (rectangles with nine points each); queries
+// with the radius the canvas uses at zoom 1, then one shape moved per
+// query as a drag would
+void benchmarkSnap()
+{
+    const int shapes = 111112;
+    Layer layer;
+    QList<Shape*> created;
+    created.reserve(shapes);
+    for (int i = 0; i < shapes; ++i) {
+        created.append(new Rectangle(QPointF(i % 334 * 30, i / 334 * 30), QSizeF(20, 12)));
+    }
+    layer.addShapes(created);
+
+    Clock::time_point start = Clock::now();
+    const SnapIndex &snap = layer.getSnapIndex();
+    const double buildMs = elapsedMs(start);
+
+    const int queries = 100000;
+    std::mt19937 random(7);
+    std::uniform_real_distribution<double> coordinate(0.0, 10000.0);
+    std::vector<QPointF> points(queries);
+    for (QPointF &point : points) point = QPointF(coordinate(random), coordinate(random));
+
+    int hits = 0;
+    SnapPoint target;
+    start = Clock::now();
+    for (const QPointF &point : points) {
+        if (snap.nearest(point, 8.0, target)) ++hits;
+    }
+    const double queryMs = elapsedMs(start);
+
+    start = Clock::now();
+    for (int i = 0; i < queries; ++i) {
+        created[i % shapes]->move(QPointF(1, 0));
+        snap.nearest(points[size_t(i)], 8.0, target);
+    }
+    const double editMs = elapsedMs(start);
+
+    std::printf("snap         %d points  build %7.1f ms  query %6.3f us  move+query %6.3f us  %d%% hits\n",
+                snap.size(), buildMs, queryMs * 1000.0 / queries, editMs * 1000.0 / queries,
+                hits * 100 / queries);
+}
+
+// ========================
+// Bulk transforms
+// ========================
+// Moving and scaling a large selection, as a drag or wheel step does it:
+// per-shape virtual move/scale calls against one Layer::transformShapes
+// pass. The mix puts most of the points in Bezier control points.
+void benchmarkBulkTransform()
+{
+    const int shapes = 100000;
+    auto build = [&](Layer &layer) {
+        QList<Shape*> created;
+        created.reserve(shapes);
+        for (int i = 0; i < shapes; ++i) {
+            const QPointF origin(i % 500 * 20.0, i / 500 * 20.0);
+            switch (i % 3) {
+            case 0:
+                created.append(new Rectangle(origin, QSizeF(12, 8)));
+                break;
+            case 1:
+                created.append(new Line(origin, origin + QPointF(12, 8)));
+                break;
+            default: {
+                Bezier *curve = new Bezier();
+                for (int k = 0; k < 7; ++k) curve->addPoint(origin + QPointF(k * 2.0, (k % 2) * 8.0));
+                created.append(curve);
+                break;
+            }
+            }
+        }
+        layer.addShapes(created);
+    };
+    const int steps = 10;
+
+    Layer perShape;
+    build(perShape);
+    const QList<Shape*> perShapeSelection = perShape.getShapes();
+    Clock::time_point start = Clock::now();
+    for (int step = 0; step < steps; ++step) {
+        for (Shape *shape : perShapeSelection) shape->move(QPointF(3, 2));
+        for (Shape *shape : perShapeSelection) shape->scale(1.01);
+    }
+    const double perShapeMs = elapsedMs(start);
+
+    Layer bulk;
+    build(bulk);
+    const QList<Shape*> bulkSelection = bulk.getShapes();
+    start = Clock::now();
+    for (int step = 0; step < steps; ++step) {
+        bulk.transformShapes(bulkSelection, QTransform::fromTranslate(3, 2));
+        const QPointF center(5000, 2000);
+        QTransform scale;
+        scale.translate(center.x(), center.y());
+        scale.scale(1.01, 1.01);
+        scale.translate(-center.x(), -center.y());
+        bulk.transformShapes(bulkSelection, scale);
+    }
+    const double bulkMs = elapsedMs(start);
+
+    std::printf("bulk-xform   %d shapes x %d steps  per-shape %7.1f ms  bulk %7.1f ms  (%s)\n",
+                shapes, steps, perShapeMs, bulkMs, AffineKernel::isVectorised() ? "SSE2" : "scalar");
+}
+
+// ========================
+// Transactions
+// ========================
+// 100k shapes added one by one, first as separate edits (a signal and an
+// undo step each), then inside one transaction
+void benchmarkTransaction()
+{
+    const int shapes = 100000;
+    auto run = [](bool transaction, int &emitted) {
+        Document document;
+        QObject::connect(&document, &Document::changed, [&emitted](const ChangeSet &) { ++emitted; });
+        QObject::connect(&document, &Document::shapeAdded, [&emitted](Shape *) { ++emitted; });
+
+        const Clock::time_point start = Clock::now();
+        if (transaction) document.beginTransaction();
+        for (int i = 0; i < shapes; ++i) {
+            document.addShape(new Rectangle(QPointF(i % 316 * 32, i / 316 * 32), QSizeF(20, 12)));
+        }
+        if (transaction) document.commitTransaction();
+        return elapsedMs(start);
+    };
+
+    int singleSignals = 0, coalescedSignals = 0;
+    const double singleMs = run(false, singleSignals);
+    const double coalescedMs = run(true, coalescedSignals);
+
+    std::printf("transaction  %d adds  one by one %8.1f ms (%d signals)  in a transaction %8.1f ms (%d signals)\n",
+                shapes, singleMs, singleSignals, coalescedMs, coalescedSignals);
+}
+
+// ========================
+// Z-order
+// ========================
+// 10k scattered shapes of a 1M-shape layer restacked by each command,
+// then the one pass that puts the rows back in draw order
+void benchmarkZOrder()
+{
+    const int shapes = 1000000;
+    Layer layer;
+    QList<Shape*> created;
+    created.reserve(shapes);
+    for (int i = 0; i < shapes; ++i) {
+        created.append(new Rectangle(QPointF(i % 1000 * 10, i / 1000 * 10), QSizeF(15, 15)));
+    }
+    layer.addShapes(created);
+
+    QList<Shape*> selection;
+    for (int i = 0; i < shapes; i += 100) selection.append(created[i]);
+
+    auto run = [&](const char *name, void (Layer::*restack)(const QList<Shape*> &)) {
+        Clock::time_point start = Clock::now();
+        (layer.*restack)(selection);
+        const double restackMs = elapsedMs(start);
+        start = Clock::now();
+        layer.getShapes();
+        const double compactMs = elapsedMs(start);
+        std::printf("zorder       %d of %d  %-15s %7.2f ms  compaction %6.1f ms\n",
+                    int(selection.size()), shapes, name, restackMs, compactMs);
+    };
+    run("bring-to-front", &Layer::bringToFront);
+    run("send-to-back", &Layer::sendToBack);
+    run("bring-forward", &Layer::bringForward);
+    run("send-backward", &Layer::sendBackward);
+}
+
+// ========================
+// Undo history
+// ========================
+// A 60-frame drag of 10k shapes out of 100k as one gesture, then its undo
+void benchmarkHistory()
+{
+    const int shapes = 100000;
+    Document document;
+    QList<Shape*> created;
+    created.reserve(shapes);
+    for (int i = 0; i < shapes; ++i) {
+        created.append(new Rectangle(QPointF(i % 316 * 32, i / 316 * 32), QSizeF(20, 12)));
+    }
+    document.addShapes(created);
+    Layer *layer = document.getActiveLayer();
+
+    QList<Shape*> selection;
+    for (int i = 0; i < shapes; i += 10) selection.append(created[i]);
+    const size_t before = document.getHistoryBytes();
+
+    Clock::time_point start = Clock::now();
+    document.beginTransaction();
+    for (int frame = 0; frame < 60; ++frame) {
+        document.aboutToModify(selection);
+        layer->transformShapes(selection, QTransform::fromTranslate(1, 1));
+    }
+    document.commitTransaction();
+    const double gestureMs = elapsedMs(start);
+    const size_t entryBytes = document.getHistoryBytes() - before;
+
+    start = Clock::now();
+    document.undo();
+    const double undoMs = elapsedMs(start);
+
+    std::printf("history      %d of %d shapes  60-frame drag %7.1f ms  entry %6.1f bytes/shape  undo %6.1f ms\n",
+                int(selection.size()), shapes, gestureMs, double(entryBytes) / selection.size(), undoMs);
+}
+
+#ifdef ENABLE_CAIRO
+// ========================
+// Level of detail
+// ========================
+// A fit-to-view frame of a dense map: 500k buildings, trees and road
+// pieces over a 10 km square (1 unit = 0.1 m), rendered into one
+// 1600x1000 surface with the LOD policy off and on
+void benchmarkLod()
+{
+    const int shapes = 500000;
+    const double world = 100000.0;
+    const int width = 1600, height = 1000;
+
+    std::mt19937 rng(17);
+    std::uniform_real_distribution<double> place(0.0, world);
+    std::uniform_real_distribution<double> extent(20.0, 400.0);
+    const QPen outline(QColor(60, 60, 60), 2.0);
+    const QBrush fills[] = { QBrush(QColor(200, 180, 160)), QBrush(QColor(90, 160, 90)) };
+
+    Layer layer;
+    QList<Shape*> created;
+    created.reserve(shapes);
+    for (int i = 0; i < shapes; ++i) {
+        const QPointF at(place(rng), place(rng));
+        Shape *shape = nullptr;
+        if (i % 10 < 6) {
+            shape = new Rectangle(at, QSizeF(extent(rng), extent(rng)));
+            shape->setBrush(fills[0]);
+        } else if (i % 10 < 9) {
+            const double d = extent(rng) * 0.5;
+            shape = new Ellipse(at, QSizeF(d, d));
+            shape->setBrush(fills[1]);
+        } else {
+            Bezier *road = new Bezier();
+            road->setPoints({ at, at + QPointF(300, 80), at + QPointF(600, -80), at + QPointF(900, 0) });
+            road->setBrush(Qt::NoBrush);
+            shape = road;
+        }
+        shape->setPen(outline);
+        created.append(shape);
+    }
+    layer.addShapes(created);
+
+    const double zoom = qMin(width / world, height / world);
+    const QList<Shape*> visible = layer.getShapesIn(QRectF(0, 0, width / zoom, height / zoom));
+
+    QImage image(width, height, QImage::Format_ARGB32_Premultiplied);
+    auto frame = [&](const LodPolicy &lod, LodPolicy::Counts &counts) {
+        image.fill(Qt::white);
+        cairo_surface_t *surface = cairo_image_surface_create_for_data(
+            image.bits(), CAIRO_FORMAT_ARGB32, image.width(), image.height(), image.bytesPerLine());
+        cairo_t *cr = cairo_create(surface);
+        cairo_scale(cr, zoom, zoom);
+
+        const Clock::time_point start = Clock::now();
+        BatchRenderer renderer(cr);
+        counts = lod.draw(renderer, visible, zoom);
+        renderer.flush();
+        cairo_surface_flush(surface);
+        const double ms = elapsedMs(start);
+
+        cairo_destroy(cr);
+        cairo_surface_destroy(surface);
+        return ms;
+    };
+
+    LodPolicy off;
+    off.enabled = false;
+    const LodPolicy on;
+
+    LodPolicy::Counts fullCounts, lodCounts;
+    const double fullMs = frame(off, fullCounts);
+    const double lodMs = frame(on, lodCounts);
+
+    std::printf("lod          %d shapes  zoom %.4f  full %8.1f ms  lod %8.1f ms  (%d full, %d reduced, %d skipped)\n",
+                int(visible.size()), zoom, fullMs, lodMs, lodCounts.full, lodCounts.reduced, lodCounts.skipped);
+}
+
+// ========================
+// Batched submission
+// ========================
+// A zoomed-in frame of 200k shapes that come in runs of 50 with the same
+// style (as imports and clone loops produce), drawn shape by shape and
+// through merged runs
+void benchmarkBatch()
+{
+    const int shapes = 200000;
+    const int width = 2048, height = 2048;
+    const QColor colors[] = { QColor(200, 180, 160), QColor(90, 160, 90), QColor(70, 110, 200), QColor(220, 90, 60) };
+
+    Layer layer;
+    QList<Shape*> created;
+    created.reserve(shapes);
+    for (int i = 0; i < shapes; ++i) {
+        const QPointF at(i % 500 * 12.0, i / 500 * 12.0);
+        const QColor &color = colors[(i / 50) % 4];
+        Shape *shape = nullptr;
+        if ((i / 50) % 3 == 2) {
+            shape = new Line(at, at + QPointF(9, 9));
+            shape->setBrush(Qt::NoBrush);
+        } else {
+            shape = (i / 50) % 3 ? static_cast<Shape*>(new Ellipse(at, QSizeF(9, 9)))
+                                 : static_cast<Shape*>(new Rectangle(at, QSizeF(9, 9)));
+            shape->setBrush(color);
+        }
+        shape->setPen(QPen(color.darker(), 1.0));
+        created.append(shape);
+    }
+    layer.addShapes(created);
+    const QList<Shape*> &all = layer.getShapes();
+
+    LodPolicy lod;
+    lod.enabled = false;
+    const double zoom = double(width) / (500 * 12.0);
+    QImage image(width, height, QImage::Format_ARGB32_Premultiplied);
+
+    auto frame = [&](bool batching, BatchRenderer::Stats &stats) {
+        image.fill(Qt::white);
+        cairo_surface_t *surface = cairo_image_surface_create_for_data(
+            image.bits(), CAIRO_FORMAT_ARGB32, image.width(), image.height(), image.bytesPerLine());
+        cairo_t *cr = cairo_create(surface);
+        cairo_scale(cr, zoom, zoom);
+
+        const Clock::time_point start = Clock::now();
+        BatchRenderer renderer(cr, batching);
+        lod.draw(renderer, all, zoom);
+        renderer.flush();
+        cairo_surface_flush(surface);
+        const double ms = elapsedMs(start);
+        stats = renderer.stats();
+
+        cairo_destroy(cr);
+        cairo_surface_destroy(surface);
+        return ms;
+    };
+
+    BatchRenderer::Stats single, batched;
+    const double singleMs = frame(false, single);
+    const double batchedMs = frame(true, batched);
+
+    std::printf("batch        %d shapes  per-shape %8.1f ms (%d state changes)  batched %8.1f ms (%d state changes, %d batches)\n",
+                shapes, singleMs, single.stateChanges, batchedMs, batched.stateChanges, batched.batches);
+}
+#endif
+
+struct Benchmark {
+    const char *name;
+    std::function<void()> run;
+};
+
+} // namespace
+
+int main(int argc, char *argv[])
+{
+    QCoreApplication app(argc, argv);
+
+    const Benchmark benchmarks[] = {
+        { "svg-import", benchmarkSvgImport },
+        { "svg-export", benchmarkSvgExport },
+        { "native-io", benchmarkNativeIo },
+        { "cull", benchmarkCulling },
+        { "shape-alloc", benchmarkShapeAlloc },
+        { "pen-stroke", benchmarkPenStroke },
+        { "stroke-fit", benchmarkStrokeFit },
+        { "bulk-transform", benchmarkBulkTransform },
+        { "region-select", benchmarkRegionSelect },
+        { "snap", benchmarkSnap },
+        { "transaction", benchmarkTransaction },
+        { "zorder", benchmarkZOrder },
+        { "history", benchmarkHistory },
+#ifdef ENABLE_CAIRO
+        { "lod", benchmarkLod },
+        { "batch", benchmarkBatch },
+#endif
+    };
+
+    for (const Benchmark &benchmark : benchmarks) {
+        bool selected = argc < 2;
+        for (int i = 1; i < argc; ++i) {
+            if (std::strcmp(argv[i], benchmark.name) == 0) selected = true;
+        }
+        if (selected) benchmark.run();
+    }
+    return 0;
+}
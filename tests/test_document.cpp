@@ -1,8 +1,34 @@
 #include <gtest/gtest.h>
 #include <QApplication>
+#include <QFile>
+#include <QTemporaryDir>
 #include "../include/document.h"
 #include "../include/rectangle.h"
 #include "../include/ellipse.h"
+#include "../include/line.h"
+#include "../include/bezier.h"
+#include "../include/text.h"
+#include "../include/shapepool.h"
+#include "../include/affinekernel.h"
+#include "../include/threadpool.h"
+#include "../include/tilecache.h"
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <vector>
+
+namespace {
+
+// Counts its deletions, to see what the undo history frees
+int destroyedShapes = 0;
+
+class CountedRectangle : public Rectangle {
+public:
+    using Rectangle::Rectangle;
+    ~CountedRectangle() override { ++destroyedShapes; }
+};
+
+} // namespace
 
 class DocumentTest : public ::testing::Test {
 protected:
@@ -84,7 +110,652 @@ TEST_F(LayerTest, LayerRemoveNonExistentShape) {
     delete rect;
 }
 
+TEST_F(LayerTest, LayerHitTestFollowsMovedShape) {
+    Rectangle* rect = new Rectangle(QPointF(10, 20), QSizeF(30, 40));
+    layer->addShape(rect);
+    EXPECT_EQ(layer->getShapeAt(QPointF(25, 35)), rect);
+
+    rect->move(QPointF(500, 500));
+    EXPECT_EQ(layer->getShapeAt(QPointF(25, 35)), nullptr);
+    EXPECT_EQ(layer->getShapeAt(QPointF(525, 535)), rect);
+
+    layer->removeShape(rect);
+    EXPECT_EQ(layer->getShapeAt(QPointF(525, 535)), nullptr);
+    delete rect;
+}
+
+TEST_F(LayerTest, LayerHitTestManyShapesKeepsZOrder) {
+    EXPECT_TRUE(layer->getShapesIn(QRectF(0, 0, 35, 35)).isEmpty());  // Empty extent
+
+    // Enough shapes to force several levels of R-tree splits
+    for (int i = 0; i < 500; ++i) {
+        layer->addShape(new Rectangle(QPointF((i % 25) * 40, (i / 25) * 40), QSizeF(30, 30)));
+    }
+    Rectangle* top = new Rectangle(QPointF(0, 0), QSizeF(1000, 1000));
+    layer->addShape(top);
+
+    EXPECT_EQ(layer->getShapeAt(QPointF(415, 415)), top);
+    EXPECT_EQ(layer->getShapesIn(QRectF(0, 0, 35, 35)).size(), 2);
+    EXPECT_EQ(layer->getShapesIn(QRectF(0, 0, 35, 35)).last(), top);
+
+    layer->removeShape(top);
+    delete top;
+    Shape* hit = layer->getShapeAt(QPointF(415, 415));
+    ASSERT_NE(hit, nullptr);
+    EXPECT_EQ(hit->getPosition(), QPointF(400, 400));
+    EXPECT_EQ(layer->getShapeAt(QPointF(435, 435)), nullptr);
+}
+
+TEST_F(LayerTest, LayerDeletedShapeLeavesIndex) {
+    Rectangle* rect = new Rectangle(QPointF(10, 20), QSizeF(30, 40));
+    layer->addShape(rect);
+    delete rect;
+
+    EXPECT_EQ(layer->getShapes().size(), 0);
+    EXPECT_EQ(layer->getShapeAt(QPointF(25, 35)), nullptr);
+}
+
+TEST_F(LayerTest, LayerBulkAddMatchesBruteForce) {
+    QList<Shape*> shapes;
+    for (int i = 0; i < 3000; ++i) {
+        shapes.append(new Rectangle(QPointF((i * 37) % 1000, (i * 91) % 700), QSizeF(5 + i % 20, 5 + i % 13)));
+    }
+    layer->addShapes(shapes);
+    ASSERT_EQ(layer->getShapes(), shapes);
+
+    for (const QRectF& query : { QRectF(0.25, 0.25, 50, 50), QRectF(300.25, 200.25, 120, 80), QRectF(-10, -10, 2000, 2000) }) {
+        QList<Shape*> expected;
+        for (Shape* shape : shapes) {
+            if (shape->getIndexBounds().intersects(query)) expected.append(shape);
+        }
+        EXPECT_EQ(layer->getShapesIn(query), expected);
+    }
+
+    // Still an ordinary index afterwards
+    Rectangle* top = new Rectangle(QPointF(0, 0), QSizeF(1000, 1000));
+    layer->addShape(top);
+    EXPECT_EQ(layer->getShapeAt(QPointF(500, 500)), top);
+    layer->removeShape(top);
+    delete top;
+}
+
+TEST_F(LayerTest, LayerColumnsFollowShapes) {
+    Rectangle* a = new Rectangle(QPointF(0, 0), QSizeF(10, 10));
+    Rectangle* b = new Rectangle(QPointF(20, 0), QSizeF(10, 10));
+    Ellipse* c = new Ellipse(QPointF(40, 0), QSizeF(10, 10));
+    layer->addShape(a);
+    layer->addShape(b);
+    layer->addShape(c);
+
+    layer->removeShape(a);
+    delete a;
+    b->setPosition(QPointF(100, 50));
+    c->setVisible(false);
+
+    const ShapeColumns& columns = layer->getColumns();
+    ASSERT_EQ(columns.size(), 2);
+    EXPECT_EQ(columns.shape(0), b);
+    EXPECT_EQ(columns.shape(1), c);
+    EXPECT_DOUBLE_EQ(columns.minX()[0], b->getIndexBounds().left());
+    EXPECT_DOUBLE_EQ(columns.minY()[0], b->getIndexBounds().top());
+    EXPECT_EQ(columns.style()[1], c->getStyle());
+    EXPECT_EQ(columns.flags()[1] & ShapeColumns::Visible, 0);
+
+    EXPECT_EQ(columns.query(QRectF(0, 0, 200, 200)), (QList<Shape*>{ b, c }));
+    EXPECT_EQ(columns.query(QRectF(0, 0, 200, 200), ShapeColumns::Visible), QList<Shape*>{ b });
+    EXPECT_TRUE(columns.query(QRectF(60, 20, 5, 5)).isEmpty());
+}
+
+TEST_F(LayerTest, LayerBulkRemoveKeepsOrder) {
+    QList<Shape*> shapes;
+    for (int i = 0; i < 10; ++i) {
+        shapes.append(new Rectangle(QPointF(i * 20, 0), QSizeF(10, 10)));
+    }
+    layer->addShapes(shapes);
+
+    // A few: index entries removed one by one
+    const QList<Shape*> few{ shapes[1], shapes[4] };
+    layer->removeShapes(few);
+    EXPECT_EQ(layer->getShapes().size(), 8);
+    EXPECT_EQ(layer->getShapes()[1], shapes[2]);
+    EXPECT_EQ(layer->getColumns().shape(3), shapes[5]);
+    EXPECT_EQ(layer->getShapeAt(QPointF(25, 5)), nullptr);
+    EXPECT_EQ(layer->getShapeAt(QPointF(105, 5)), shapes[5]);
+    EXPECT_EQ(shapes[1]->getLayer(), nullptr);
+
+    // Most of the layer: the index is repacked
+    const QList<Shape*> most{ shapes[0], shapes[2], shapes[3], shapes[5], shapes[6], shapes[8] };
+    layer->removeShapes(most);
+    EXPECT_EQ(layer->getShapes(), (QList<Shape*>{ shapes[7], shapes[9] }));
+    EXPECT_EQ(layer->getSpatialIndex().size(), 2);
+    EXPECT_EQ(layer->getShapeAt(QPointF(185, 5)), shapes[9]);
+    EXPECT_EQ(layer->getColumns().size(), 2);
+
+    qDeleteAll(few);
+    qDeleteAll(most);
+}
+
+TEST_F(LayerTest, LayerRemovalCompactsLazily) {
+    QList<Shape*> shapes;
+    for (int i = 0; i < 6; ++i) {
+        shapes.append(new Rectangle(QPointF(i * 20, 0), QSizeF(10, 10)));
+    }
+    layer->addShapes(shapes);
+
+    layer->removeShape(shapes[2]);
+    layer->removeShape(shapes[4]);
+    EXPECT_EQ(layer->shapeCount(), 4);
+
+    // Queries skip the tombstones before anything is compacted
+    EXPECT_EQ(layer->getShapeAt(QPointF(45, 5)), nullptr);
+    EXPECT_EQ(layer->getShapesIn(QRectF(-100, -100, 1000, 1000)),
+              (QList<Shape*>{ shapes[0], shapes[1], shapes[3], shapes[5] }));
+
+    // Reading the rows compacts them
+    const QList<Shape*>& live = layer->getShapes();
+    EXPECT_EQ(live, (QList<Shape*>{ shapes[0], shapes[1], shapes[3], shapes[5] }));
+    ASSERT_EQ(layer->getColumns().size(), 4);
+    for (int row = 0; row < live.size(); ++row) {
+        EXPECT_EQ(layer->getColumns().shape(row), live[row]);
+    }
+
+    // Removing what getShapes() hands out is safe
+    layer->removeShapes(layer->getShapes());
+    EXPECT_EQ(layer->shapeCount(), 0);
+    EXPECT_TRUE(layer->getShapes().isEmpty());
+    EXPECT_EQ(layer->getSpatialIndex().size(), 0);
+
+    qDeleteAll(shapes);
+}
+
+TEST_F(LayerTest, LayerZOrderCommands) {
+    Rectangle* a = new Rectangle(QPointF(0, 0), QSizeF(10, 10));
+    Rectangle* b = new Rectangle(QPointF(0, 0), QSizeF(10, 10));
+    Rectangle* c = new Rectangle(QPointF(0, 0), QSizeF(10, 10));
+    Rectangle* d = new Rectangle(QPointF(0, 0), QSizeF(10, 10));
+    Rectangle* e = new Rectangle(QPointF(0, 0), QSizeF(10, 10));
+    Rectangle* f = new Rectangle(QPointF(100, 0), QSizeF(10, 10));
+    layer->addShapes(QList<Shape*>{ a, b, c, d, e, f });
+
+    layer->bringToFront(QList<Shape*>{ b });
+    EXPECT_EQ(layer->getShapeAt(QPointF(5, 5)), b);
+    EXPECT_EQ(layer->getShapes(), (QList<Shape*>{ a, c, d, e, f, b }));
+
+    layer->sendToBack(QList<Shape*>{ d, b });
+    EXPECT_EQ(layer->getShapes(), (QList<Shape*>{ b, d, a, c, e, f }));
+
+    // One step past the nearest overlapping shape; f overlaps nothing
+    layer->bringForward(QList<Shape*>{ a, f });
+    EXPECT_EQ(layer->getShapes(), (QList<Shape*>{ b, d, c, a, e, f }));
+    layer->sendBackward(QList<Shape*>{ e });
+    EXPECT_EQ(layer->getShapes(), (QList<Shape*>{ b, d, c, e, a, f }));
+
+    // Enough steps into the same gap to use up its labels
+    for (int i = 0; i < 40; ++i) {
+        layer->bringForward(QList<Shape*>{ i % 2 ? c : d });
+    }
+    EXPECT_EQ(layer->getShapes(), (QList<Shape*>{ b, d, c, e, a, f }));
+    EXPECT_EQ(layer->getShapeAt(QPointF(5, 5)), a);
+    for (int row = 0; row < layer->getShapes().size(); ++row) {
+        EXPECT_EQ(layer->getColumns().shape(row), layer->getShapes()[row]);
+    }
+}
+
+TEST_F(LayerTest, LayerBulkTransformMatchesPerPoint) {
+    Rectangle* rect = new Rectangle(QPointF(0, 0), QSizeF(20, 10));
+    Line* line = new Line(QPointF(100, 0), QPointF(140, 30));
+    Bezier* curve = new Bezier();
+    curve->addPoint(QPointF(200, 0));
+    curve->addPoint(QPointF(210, 40));
+    curve->addPoint(QPointF(250, 40));
+    curve->addPoint(QPointF(260, 0));
+    layer->addShape(rect);
+    layer->addShape(line);
+    layer->addShape(curve);
+    for (int i = 0; i < 20; ++i) {
+        layer->addShape(new Rectangle(QPointF(i * 30, 500), QSizeF(10, 10)));
+    }
+    const QList<QPointF> curvePoints = curve->getPoints();
+
+    // Three of 23 shapes: the index is updated entry by entry
+    QTransform transform;
+    transform.translate(1000, 500);
+    transform.rotate(30);
+    transform.scale(2, 2);
+    QRectF oldBounds, newBounds;
+    layer->transformShapes(QList<Shape*>{ rect, line, curve }, transform, &oldBounds, &newBounds);
+
+    auto near = [](const QPointF &a, const QPointF &b) {
+        return std::abs(a.x() - b.x()) < 1e-9 && std::abs(a.y() - b.y()) < 1e-9;
+    };
+    EXPECT_TRUE(near(line->getStartPoint(), transform.map(QPointF(100, 0))));
+    EXPECT_TRUE(near(line->getEndPoint(), transform.map(QPointF(140, 30))));
+    for (int i = 0; i < curvePoints.size(); ++i) {
+        EXPECT_TRUE(near(curve->getPoint(i), transform.map(curvePoints[i])));
+    }
+    EXPECT_TRUE(near(rect->getBoundingRect().center(), transform.map(QPointF(10, 5))));
+    EXPECT_DOUBLE_EQ(rect->getSize().width(), 40);
+    EXPECT_NEAR(rect->getRotation(), 30, 1e-9);
+
+    EXPECT_TRUE(oldBounds.contains(QPointF(250, 40)));
+    EXPECT_TRUE(newBounds.contains(curve->getIndexBounds()));
+    EXPECT_EQ(layer->getShapeAt(transform.map(QPointF(10, 5))), rect);
+    EXPECT_EQ(layer->getShapeAt(QPointF(10, 5)), nullptr);
+    EXPECT_EQ(layer->getColumns().minX()[2], curve->getIndexBounds().left());
+
+    // The whole layer: the index is repacked, and still answers
+    layer->transformShapes(layer->getShapes(), QTransform::fromTranslate(-1000, 0));
+    EXPECT_EQ(layer->getShapeAt(transform.map(QPointF(10, 5)) - QPointF(1000, 0)), rect);
+    EXPECT_EQ(layer->getShapeAt(QPointF(-995, 505)), layer->getShapes()[3]);
+    EXPECT_EQ(layer->getSpatialIndex().query(QRectF(-2000, -2000, 10000, 10000)).size(), 23);
+
+    // Shapes of another layer are left alone
+    Rectangle stray(QPointF(0, 0), QSizeF(5, 5));
+    layer->transformShapes(QList<Shape*>{ &stray }, transform, &oldBounds, &newBounds);
+    EXPECT_EQ(stray.getPosition(), QPointF(0, 0));
+    EXPECT_TRUE(newBounds.isNull());
+}
+
+TEST_F(LayerTest, LayerRegionSelectionUsesOutlines) {
+    Rectangle* rect = new Rectangle(QPointF(0, 0), QSizeF(10, 10));
+    Ellipse* ellipse = new Ellipse(QPointF(20, 0), QSizeF(10, 10));
+    Line* line = new Line(QPointF(40, 0), QPointF(50, 10));
+    Rectangle* tilted = new Rectangle(QPointF(100, 0), QSizeF(20, 20));
+    tilted->rotate(45);
+    layer->addShape(rect);
+    layer->addShape(ellipse);
+    layer->addShape(line);
+    layer->addShape(tilted);
+
+    // Enclosed, not merely touched
+    EXPECT_EQ(layer->getShapesEnclosedBy(QRectF(-1, -1, 60, 12)), (QList<Shape*>{ rect, ellipse, line }));
+    EXPECT_EQ(layer->getShapesEnclosedBy(QRectF(-1, -1, 25, 12)), QList<Shape*>{ rect });
+
+    // The bounding rect fits, the rotated outline does not
+    EXPECT_TRUE(layer->getShapesEnclosedBy(QRectF(99, -1, 22, 22)).isEmpty());
+    EXPECT_EQ(layer->getShapesEnclosedBy(QRectF(95, -5, 30, 30)), QList<Shape*>{ tilted });
+
+    // A diamond holds the ellipse but would cut the corners of its box
+    const QPolygonF diamond({ QPointF(25, -3), QPointF(33, 5), QPointF(25, 13), QPointF(17, 5) });
+    EXPECT_EQ(layer->getShapesEnclosedBy(diamond), QList<Shape*>{ ellipse });
+    EXPECT_TRUE(layer->getShapesEnclosedBy(QPolygonF({ QPointF(0, 0), QPointF(100, 100) })).isEmpty());
+
+    ellipse->setVisible(false);
+    EXPECT_EQ(layer->getShapesEnclosedBy(QRectF(-1, -1, 60, 12)), (QList<Shape*>{ rect, line }));
+
+    // Enough candidates for the outline test to be split across the pool
+    QList<Shape*> grid;
+    for (int i = 0; i < 10000; ++i) {
+        grid.append(new Rectangle(QPointF(i % 100 * 10, 1000 + i / 100 * 10), QSizeF(8, 8)));
+    }
+    layer->addShapes(grid);
+    const QRectF region(0, 1000, 505, 505);
+    QList<Shape*> expected;
+    for (Shape* shape : grid) {
+        if (region.contains(shape->getBoundingRect().bottomRight())) expected.append(shape);
+    }
+    EXPECT_EQ(expected.size(), 2500);
+    EXPECT_EQ(layer->getShapesEnclosedBy(region), expected);
+}
+
+TEST_F(LayerTest, LayerSnapIndexFollowsShapes) {
+    Line* line = new Line(QPointF(0, 0), QPointF(100, 0));
+    Rectangle* rect = new Rectangle(QPointF(200, 0), QSizeF(40, 20));
+    Bezier* curve = new Bezier();
+    curve->addPoint(QPointF(300, 0));
+    curve->addPoint(QPointF(310, 40));
+    curve->addPoint(QPointF(350, 40));
+    curve->addPoint(QPointF(360, 0));
+    layer->addShape(line);
+    layer->addShape(rect);
+
+    const SnapIndex& snap = layer->getSnapIndex();
+    SnapPoint target;
+    ASSERT_TRUE(snap.nearest(QPointF(98, 3), 5, target));
+    EXPECT_EQ(target.point, QPointF(100, 0));
+    EXPECT_EQ(target.kind, SnapPoint::Endpoint);
+    ASSERT_TRUE(snap.nearest(QPointF(51, 1), 5, target));
+    EXPECT_EQ(target.kind, SnapPoint::Midpoint);
+    ASSERT_TRUE(snap.nearest(QPointF(219, 11), 5, target));
+    EXPECT_EQ(target.point, QPointF(220, 10));
+    EXPECT_EQ(target.kind, SnapPoint::Center);
+    ASSERT_TRUE(snap.nearest(QPointF(241, 9), 5, target));
+    EXPECT_EQ(target.point, QPointF(240, 10));
+    EXPECT_EQ(target.kind, SnapPoint::Edge);
+    EXPECT_FALSE(snap.nearest(QPointF(150, 50), 5, target));
+
+    // Added, moved and removed shapes are followed without a rebuild
+    layer->addShape(curve);
+    ASSERT_TRUE(snap.nearest(QPointF(358, 2), 5, target));
+    EXPECT_EQ(target.point, QPointF(360, 0));
+    EXPECT_FALSE(snap.nearest(QPointF(310, 40), 1, target));   // Control point
+
+    line->move(QPointF(10, 0));
+    EXPECT_FALSE(snap.nearest(QPointF(0, 0), 5, target));
+    ASSERT_TRUE(snap.nearest(QPointF(108, 0), 5, target));
+    EXPECT_EQ(target.point, QPointF(110, 0));
+
+    layer->transformShapes(QList<Shape*>{ rect }, QTransform::fromTranslate(0, 100));
+    EXPECT_TRUE(snap.nearest(QPointF(200, 100), 1, target));
+    EXPECT_FALSE(snap.nearest(QPointF(200, 0), 1, target));
+
+    EXPECT_FALSE(snap.nearest(QPointF(108, 0), 5, target,
+                              [line](const Shape* shape) { return shape == line; }));
+
+    layer->removeShape(line);
+    delete line;
+    EXPECT_FALSE(snap.nearest(QPointF(110, 0), 5, target));
+    EXPECT_FALSE(snap.contains(line));
+}
+
+TEST(AffineKernelTest, MapMatchesQTransform) {
+    QTransform transform;
+    transform.translate(-3.5, 7);
+    transform.rotate(-71);
+    transform.scale(1.5, 0.25);
+
+    std::vector<QPointF> points;
+    for (int i = 0; i < 7; ++i) points.emplace_back(i * 13.0 - 40.0, i * i * 0.5);
+    const std::vector<QPointF> original = points;
+    AffineKernel::map(transform, points.data(), points.size());
+    for (size_t i = 0; i < points.size(); ++i) {
+        const QPointF expected = transform.map(original[i]);
+        EXPECT_NEAR(points[i].x(), expected.x(), 1e-9);
+        EXPECT_NEAR(points[i].y(), expected.y(), 1e-9);
+    }
+
+    QPointF min, max;
+    AffineKernel::bounds(original.data(), original.size(), min, max);
+    EXPECT_EQ(min, QPointF(-40, 0));
+    EXPECT_EQ(max, QPointF(38, 18));
+
+    const AffineKernel::Parts parts = AffineKernel::decompose(transform);
+    EXPECT_NEAR(parts.scaleX, 1.5, 1e-9);
+    EXPECT_NEAR(parts.scaleY, 0.25, 1e-9);
+    EXPECT_NEAR(parts.angle, -71, 1e-9);
+}
+
+// Runs parallelFor over count indices and checks each ran exactly once
+static void expectEachIndexOnce(ThreadPool &pool, int count)
+{
+    std::vector<std::atomic<int>> hits(count);
+    pool.parallelFor(count, [&hits](int i) {
+        // Uneven jobs, so idle workers steal from the busy ones
+        if (i % 97 == 0) std::this_thread::sleep_for(std::chrono::microseconds(200));
+        ++hits[i];
+    });
+    for (int i = 0; i < count; ++i) {
+        ASSERT_EQ(hits[i].load(), 1) << "index " << i;
+    }
+}
+
+TEST(ThreadPoolTest, ParallelForRunsEachIndexOnce) {
+    ThreadPool pool(4);
+    for (int round = 0; round < 20; ++round) expectEachIndexOnce(pool, 5000);
+}
+
+TEST(ThreadPoolTest, ParallelForFromInsideTask) {
+    // One worker is the worst case: the outer task must run the inner
+    // loop itself rather than wait for a free thread
+    for (int threads : { 1, 3 }) {
+        ThreadPool pool(threads);
+        const int outer = 8, inner = 200;
+        std::vector<std::atomic<int>> hits(outer * inner);
+        pool.parallelFor(outer, [&](int i) {
+            pool.parallelFor(inner, [&](int j) { ++hits[i * inner + j]; });
+        });
+        for (int i = 0; i < outer * inner; ++i) {
+            ASSERT_EQ(hits[i].load(), 1) << threads << " threads, index " << i;
+        }
+    }
+}
+
+TEST(ThreadPoolTest, ParallelForOnSmallPools) {
+    ThreadPool single(1);
+    EXPECT_EQ(single.threadCount(), 1);
+    ThreadPool perCore(0);
+    EXPECT_GE(perCore.threadCount(), 1);
+
+    for (ThreadPool *pool : { &single, &perCore }) {
+        bool called = false;
+        pool->parallelFor(0, [&called](int) { called = true; });
+        EXPECT_FALSE(called);
+        expectEachIndexOnce(*pool, 1);
+        expectEachIndexOnce(*pool, 1000);
+    }
+}
+
+TEST(TileCacheTest, EvictsLeastRecentlyUsedUnderCap) {
+    const QImage image(TileCache::TileSize, TileCache::TileSize, QImage::Format_ARGB32_Premultiplied);
+    TileCache cache(3 * TileCache::TileBytes);
+    for (int x = 0; x < 3; ++x) ASSERT_NE(cache.insert(1.0, x, 0, image), nullptr);
+    EXPECT_EQ(cache.tileCount(), 3);
+    EXPECT_EQ(cache.usedBytes(), 3 * TileCache::TileBytes);
+
+    // A hit makes (0, 0) recent, so (1, 0) is the one to go
+    ASSERT_NE(cache.tile(1.0, 0, 0), nullptr);
+    ASSERT_NE(cache.insert(1.0, 3, 0, image), nullptr);
+    EXPECT_EQ(cache.tileCount(), 3);
+    EXPECT_EQ(cache.tile(1.0, 1, 0), nullptr);
+    EXPECT_NE(cache.tile(1.0, 2, 0), nullptr);
+    EXPECT_NE(cache.tile(1.0, 3, 0), nullptr);
+    EXPECT_NE(cache.tile(1.0, 0, 0), nullptr);
+
+    // Shrinking the cap keeps only the most recently used tile
+    cache.setMaxBytes(TileCache::TileBytes);
+    EXPECT_EQ(cache.maxBytes(), TileCache::TileBytes);
+    EXPECT_EQ(cache.tileCount(), 1);
+    EXPECT_LE(cache.usedBytes(), cache.maxBytes());
+    EXPECT_NE(cache.tile(1.0, 0, 0), nullptr);
+
+    // Nothing fits below one tile
+    cache.setMaxBytes(TileCache::TileBytes / 2);
+    EXPECT_EQ(cache.tileCount(), 0);
+    EXPECT_EQ(cache.insert(1.0, 0, 0, image), nullptr);
+    EXPECT_EQ(cache.usedBytes(), 0);
+}
+
+TEST(TileCacheTest, InvalidateDropsTilesAtEveryZoom) {
+    const QImage image(TileCache::TileSize, TileCache::TileSize, QImage::Format_ARGB32_Premultiplied);
+    TileCache cache;
+    for (double zoom : { 0.5, 1.0, 2.0 }) {
+        for (int x = 0; x < 3; ++x) cache.insert(zoom, x, 0, image);
+    }
+
+    // World x 300..320 is device x 150..160, 300..320 and 600..640 at
+    // the three zooms: tile 0, 1 and 2 respectively
+    cache.invalidate(QRectF(300, 10, 20, 20));
+    EXPECT_EQ(cache.tileCount(), 6);
+    EXPECT_EQ(cache.tile(0.5, 0, 0), nullptr);
+    EXPECT_EQ(cache.tile(1.0, 1, 0), nullptr);
+    EXPECT_EQ(cache.tile(2.0, 2, 0), nullptr);
+    EXPECT_NE(cache.tile(0.5, 1, 0), nullptr);
+    EXPECT_NE(cache.tile(1.0, 0, 0), nullptr);
+    EXPECT_NE(cache.tile(1.0, 2, 0), nullptr);
+    EXPECT_NE(cache.tile(2.0, 1, 0), nullptr);
+
+    // Tiles of rows the rect does not reach stay
+    cache.invalidate(QRectF(0, 600, 10, 10));
+    EXPECT_EQ(cache.tileCount(), 6);
+}
+
 // Document Tests
+TEST_F(DocumentTest, TransactionCoalescesSignalsAndUndo) {
+    int changedCount = 0;
+    int documentChangedCount = 0;
+    int shapeAddedCount = 0;
+    ChangeSet last;
+    QObject::connect(document, &Document::changed, [&](const ChangeSet& changes) {
+        ++changedCount;
+        last = changes;
+    });
+    QObject::connect(document, &Document::documentChanged, [&]() { ++documentChangedCount; });
+    QObject::connect(document, &Document::shapeAdded, [&](Shape*) { ++shapeAddedCount; });
+
+    Rectangle* a = new Rectangle(QPointF(0, 0), QSizeF(10, 10));
+    Rectangle* b = new Rectangle(QPointF(100, 0), QSizeF(10, 10));
+    Ellipse* c = new Ellipse(QPointF(0, 100), QSizeF(10, 10));
+
+    document->beginTransaction();
+    document->addShape(a);
+    document->beginTransaction();           // Nested: part of the outer one
+    document->addShapes(QList<Shape*>{ b, c });
+    document->commitTransaction();
+    EXPECT_TRUE(document->inTransaction());
+    EXPECT_EQ(changedCount, 0);
+    document->commitTransaction();
+
+    EXPECT_EQ(changedCount, 1);
+    EXPECT_EQ(documentChangedCount, 1);
+    EXPECT_EQ(shapeAddedCount, 0);
+    EXPECT_EQ(last.added, (QList<quint64>{ a->getId(), b->getId(), c->getId() }));
+    EXPECT_EQ(last.bounds, a->getIndexBounds().united(b->getIndexBounds()).united(c->getIndexBounds()));
+
+    // The whole transaction is one undo step
+    document->undo();
+    EXPECT_TRUE(document->getActiveLayer()->getShapes().isEmpty());
+    EXPECT_FALSE(document->canUndo());
+    EXPECT_EQ(changedCount, 2);
+    EXPECT_EQ(last.removed.size(), 3);
+    document->redo();
+    EXPECT_EQ(document->getActiveLayer()->getShapes(), (QList<Shape*>{ a, b, c }));
+    EXPECT_EQ(document->getShapeAt(QPointF(105, 5)), b);
+
+    // Single edits outside a transaction still report on their own
+    Rectangle* d = new Rectangle(QPointF(200, 0), QSizeF(10, 10));
+    document->addShape(d);
+    EXPECT_EQ(shapeAddedCount, 1);
+    EXPECT_EQ(last.added, QList<quint64>{ d->getId() });
+
+    Shape* copy = d->clone();
+    EXPECT_NE(copy->getId(), d->getId());
+    delete copy;
+}
+
+TEST_F(DocumentTest, HistoryUndoesModifications) {
+    Rectangle* rect = new Rectangle(QPointF(0, 0), QSizeF(10, 10));
+    Line* line = new Line(QPointF(0, 50), QPointF(20, 50));
+    document->addShapes(QList<Shape*>{ rect, line });
+    const quint32 style = rect->getStyle();
+
+    // A gesture: only the first snapshot of each shape counts
+    document->beginTransaction();
+    for (int i = 0; i < 10; ++i) {
+        document->aboutToModify(QList<Shape*>{ rect, line });
+        rect->move(QPointF(5, 0));
+        line->move(QPointF(0, 5));
+    }
+    document->commitTransaction();
+    EXPECT_EQ(rect->getPosition(), QPointF(50, 0));
+
+    // Snapshots of edits that changed nothing leave no entry
+    document->beginTransaction();
+    document->aboutToModify(QList<Shape*>{ rect });
+    document->commitTransaction();
+
+    document->undo();
+    EXPECT_EQ(rect->getPosition(), QPointF(0, 0));
+    EXPECT_EQ(line->getStartPoint(), QPointF(0, 50));
+    EXPECT_EQ(line->getEndPoint(), QPointF(20, 50));
+    EXPECT_EQ(rect->getStyle(), style);
+    EXPECT_EQ(document->getShapeAt(QPointF(5, 5)), rect);
+    ASSERT_TRUE(document->canUndo());       // Still the add
+
+    document->redo();
+    EXPECT_EQ(rect->getPosition(), QPointF(50, 0));
+    EXPECT_EQ(line->getStartPoint(), QPointF(0, 100));
+    EXPECT_EQ(document->getShapeAt(QPointF(55, 5)), rect);
+
+    // Quick repeats on the same shapes (wheel ticks) merge, across fields;
+    // each is reported once its edit is done
+    int changedCount = 0;
+    const QMetaObject::Connection connection =
+        QObject::connect(document, &Document::changed, [&](const ChangeSet& changes) {
+            ++changedCount;
+            EXPECT_EQ(changes.modified, QList<quint64>{ rect->getId() });
+            EXPECT_NE(rect->getRotation(), 0.0);
+        });
+    document->beginTransaction();
+    document->aboutToModify(QList<Shape*>{ rect });
+    rect->rotate(10);
+    document->commitTransaction();
+    document->beginTransaction();
+    document->aboutToModify(QList<Shape*>{ rect });
+    rect->setPen(QPen(Qt::red, 4));
+    document->commitTransaction();
+    EXPECT_EQ(changedCount, 2);
+    QObject::disconnect(connection);
+    document->undo();
+    EXPECT_EQ(rect->getRotation(), 0.0);
+    EXPECT_EQ(rect->getStyle(), style);
+    EXPECT_EQ(rect->getPosition(), QPointF(50, 0));
+}
+
+TEST_F(DocumentTest, HistoryBudgetFreesRemovedShapes) {
+    destroyedShapes = 0;
+    QList<Shape*> shapes;
+    for (int i = 0; i < 100; ++i) {
+        shapes.append(new CountedRectangle(QPointF(i * 20, 0), QSizeF(10, 10)));
+    }
+    document->addShapes(shapes);
+
+    // Every removal is its own step holding its shape
+    for (Shape* shape : shapes) document->removeShape(shape);
+    EXPECT_EQ(destroyedShapes, 0);
+
+    document->setHistoryBudget(4096);
+    EXPECT_LE(document->getHistoryBytes(), size_t(4096));
+    EXPECT_GT(destroyedShapes, 0);
+    EXPECT_LT(destroyedShapes, 100);
+
+    // What is left still undoes, newest first
+    document->undo();
+    EXPECT_EQ(document->getShapeAt(QPointF(1985, 5)), shapes.last());
+
+    // A new edit drops the redo branch; its shapes are back in the
+    // document, so nothing more is freed. Clearing frees the rest.
+    const int freed = destroyedShapes;
+    document->addShape(new Rectangle(QPointF(0, 100), QSizeF(10, 10)));
+    EXPECT_EQ(destroyedShapes, freed);
+    document->clearHistory();
+    EXPECT_EQ(destroyedShapes, 99);
+    EXPECT_EQ(document->getHistoryBytes(), size_t(0));
+}
+
+TEST_F(DocumentTest, ClearResetsDocument) {
+    int resets = 0;
+    QObject::connect(document, &Document::documentReset, [&]() { ++resets; });
+    document->beginTransaction();
+    document->addShape(new Rectangle(QPointF(0, 0), QSizeF(10, 10)));
+
+    // Drops the open transaction with the shapes it was collecting
+    document->clear();
+    EXPECT_EQ(resets, 1);
+    EXPECT_FALSE(document->inTransaction());
+    EXPECT_TRUE(document->getLayers().isEmpty());
+}
+
+TEST_F(DocumentTest, HistoryForgetsRemovedLayers) {
+    destroyedShapes = 0;
+    Layer* layer = new Layer("Doomed");
+    document->addLayer(layer);
+    document->setActiveLayer(layer);
+    CountedRectangle* kept = new CountedRectangle(QPointF(0, 0), QSizeF(10, 10));
+    CountedRectangle* removed = new CountedRectangle(QPointF(20, 0), QSizeF(10, 10));
+    document->addShapes(QList<Shape*>{ kept, removed });
+    document->removeShape(removed);
+
+    // The layer takes kept with it; removed, held by the history, is freed
+    document->removeLayer(layer);
+    EXPECT_EQ(destroyedShapes, 2);
+    EXPECT_FALSE(document->canUndo());
+
+    document->undo();
+    document->redo();
+    EXPECT_EQ(document->getHistoryBytes(), size_t(0));
+    EXPECT_EQ(destroyedShapes, 2);
+}
+
 TEST_F(DocumentTest, DocumentCreation) {
     EXPECT_EQ(document->getLayers().size(), 1);
     EXPECT_EQ(document->getSize(), QSizeF(800, 600));
@@ -275,4 +946,166 @@ TEST_F(DocumentTest, DocumentMemoryManagement) {
 
     document->clear();
     EXPECT_EQ(document->getLayers().size(), 0);
-}
\ No newline at end of file
+}
+TEST_F(DocumentTest, DocumentClearReleasesShapeMemory) {
+    const size_t before = ShapePool::reservedBytes();
+    for (int i = 0; i < 20000; ++i) {
+        document->addShape(new Rectangle(QPointF(i, i)));
+        document->addShape(new Ellipse(QPointF(i, i)));
+    }
+    Shape* copy = document->getShapes().first()->clone();
+    EXPECT_GT(ShapePool::reservedBytes(), before);
+
+    document->clear();
+    delete copy;
+    document->clear();
+    EXPECT_LE(ShapePool::reservedBytes(), before);
+}
+
+TEST_F(DocumentTest, NativeSaveLoadRoundTrip) {
+    QTemporaryDir dir;
+    const QString path = dir.filePath("drawing.vgd");
+
+    Rectangle* rect = new Rectangle(QPointF(10.5, 20.25), QSizeF(30, 40));
+    rect->setCornerRadius(4);
+    rect->rotate(30);
+    rect->setBrush(QBrush(QColor(10, 20, 30, 128)));
+    Ellipse* ellipse = new Ellipse(QPointF(100, 100), QSizeF(50, 25));
+    ellipse->setStartAngle(15);
+    ellipse->setEndAngle(200);
+    ellipse->setVisible(false);
+    Line* line = new Line(QPointF(1, 2), QPointF(3, 4));
+    line->setLineWidth(2.5);
+    line->setPen(QPen(QColor(Qt::red), 2.5, Qt::DashLine));
+    Bezier* bezier = new Bezier();
+    bezier->addPoint(QPointF(0, 0));
+    bezier->addPoint(QPointF(10, 20));
+    bezier->addPoint(QPointF(30, 20));
+    bezier->addPoint(QPointF(40, 0));
+    bezier->setClosed(true);
+    Text* text = new Text();
+    text->setText(QString::fromUtf8("Grüße"));
+    text->setPosition(QPointF(5, 6));
+
+    document->addShape(rect);
+    document->addShape(ellipse);
+    Layer* second = new Layer(QString::fromUtf8("Ébauche"));
+    second->setLocked(true);
+    second->setVisible(false);
+    second->addShape(line);
+    second->addShape(bezier);
+    second->addShape(text);
+    document->addLayer(second);
+    document->setActiveLayer(second);
+    document->setSize(QSizeF(1024, 768));
+    document->setBackgroundColor(QColor(200, 210, 220));
+
+    ASSERT_TRUE(document->save(path));
+
+    Document loaded;
+    ASSERT_TRUE(loaded.load(path));
+    EXPECT_EQ(loaded.getSize(), QSizeF(1024, 768));
+    EXPECT_EQ(loaded.getBackgroundColor(), QColor(200, 210, 220));
+    ASSERT_EQ(loaded.getLayers().size(), 2);
+    EXPECT_EQ(loaded.getActiveLayer(), loaded.getLayers().at(1));
+
+    const QList<Shape*> first = loaded.getLayers().at(0)->getShapes();
+    ASSERT_EQ(first.size(), 2);
+    ASSERT_EQ(first[0]->getType(), Shape::Rectangle);
+    const Rectangle* loadedRect = static_cast<const Rectangle*>(first[0]);
+    EXPECT_EQ(loadedRect->getPosition(), QPointF(10.5, 20.25));
+    EXPECT_EQ(loadedRect->getSize(), QSizeF(30, 40));
+    EXPECT_DOUBLE_EQ(loadedRect->getCornerRadius(), 4);
+    EXPECT_DOUBLE_EQ(loadedRect->getRotation(), 30);
+    EXPECT_EQ(loadedRect->getBrush().color(), QColor(10, 20, 30, 128));
+    ASSERT_EQ(first[1]->getType(), Shape::Ellipse);
+    const Ellipse* loadedEllipse = static_cast<const Ellipse*>(first[1]);
+    EXPECT_DOUBLE_EQ(loadedEllipse->getStartAngle(), 15);
+    EXPECT_DOUBLE_EQ(loadedEllipse->getEndAngle(), 200);
+    EXPECT_FALSE(loadedEllipse->isVisible());
+    EXPECT_EQ(loadedEllipse->getPen(), ellipse->getPen());
+
+    const Layer* loadedSecond = loaded.getLayers().at(1);
+    EXPECT_EQ(loadedSecond->getName(), QString::fromUtf8("Ébauche"));
+    EXPECT_TRUE(loadedSecond->isLocked());
+    EXPECT_FALSE(loadedSecond->isVisible());
+    const QList<Shape*> rest = loadedSecond->getShapes();
+    ASSERT_EQ(rest.size(), 3);
+    ASSERT_EQ(rest[0]->getType(), Shape::Line);
+    const Line* loadedLine = static_cast<const Line*>(rest[0]);
+    EXPECT_EQ(loadedLine->getStartPoint(), QPointF(1, 2));
+    EXPECT_EQ(loadedLine->getEndPoint(), QPointF(3, 4));
+    EXPECT_DOUBLE_EQ(loadedLine->getLineWidth(), 2.5);
+    EXPECT_EQ(loadedLine->getPen(), line->getPen());
+    ASSERT_EQ(rest[1]->getType(), Shape::Bezier);
+    const Bezier* loadedBezier = static_cast<const Bezier*>(rest[1]);
+    EXPECT_EQ(loadedBezier->getPoints(), bezier->getPoints());
+    EXPECT_TRUE(loadedBezier->isClosed());
+    ASSERT_EQ(rest[2]->getType(), Shape::Text);
+    EXPECT_EQ(static_cast<const Text*>(rest[2])->getText(), QString::fromUtf8("Grüße"));
+    EXPECT_EQ(rest[2]->getPosition(), QPointF(5, 6));
+
+    // Loaded shapes are indexed
+    EXPECT_EQ(loaded.getLayers().at(0)->getShapeAt(QPointF(110, 110)), nullptr);  // Hidden ellipse
+    EXPECT_EQ(loaded.getLayers().at(0)->getShapesIn(QRectF(95, 95, 10, 10)).size(), 1);
+}
+
+TEST_F(DocumentTest, NativeSharesStyles) {
+    QTemporaryDir dir;
+    const QString one = dir.filePath("one.vgd");
+    const QString many = dir.filePath("many.vgd");
+
+    document->addShape(new Rectangle());
+    ASSERT_TRUE(document->save(one));
+    for (int i = 0; i < 999; ++i) {
+        document->addShape(new Rectangle(QPointF(i, i)));
+    }
+    ASSERT_TRUE(document->save(many));
+
+    // One style record shared by all of them: only the shape records grow
+    const qint64 perShape = (QFile(many).size() - QFile(one).size()) / 999;
+    EXPECT_LT(perShape, 64);
+}
+
+TEST_F(DocumentTest, NativeLoadRejectsBadFiles) {
+    QTemporaryDir dir;
+    const QString good = dir.filePath("good.vgd");
+    Layer* layer = new Layer("Saved");
+    for (int i = 0; i < 20; ++i) {
+        layer->addShape(new Rectangle(QPointF(i * 10, 0), QSizeF(5, 5)));
+    }
+    document->addLayer(layer);
+    ASSERT_TRUE(document->save(good));
+
+    QFile file(good);
+    ASSERT_TRUE(file.open(QIODevice::ReadOnly));
+    const QByteArray bytes = file.readAll();
+    file.close();
+
+    auto writeFile = [&dir](const QString& name, const QByteArray& data) {
+        QFile out(dir.filePath(name));
+        out.open(QIODevice::WriteOnly);
+        out.write(data);
+        return dir.filePath(name);
+    };
+
+    Document target;
+    target.addShape(new Rectangle());
+    const QString truncated = writeFile("truncated.vgd", bytes.left(bytes.size() - 200));
+    QByteArray badMagic = bytes;
+    badMagic[0] = 'X';
+    const QString notNative = writeFile("magic.vgd", badMagic);
+
+    EXPECT_FALSE(target.load(truncated));
+    EXPECT_FALSE(target.load(notNative));
+    EXPECT_FALSE(target.load(dir.filePath("missing.vgd")));
+    EXPECT_FALSE(target.load(writeFile("empty.vgd", QByteArray())));
+
+    // Untouched by the failed loads
+    ASSERT_EQ(target.getLayers().size(), 1);
+    EXPECT_EQ(target.getLayers().first()->getName(), "Default Layer");
+    EXPECT_EQ(target.getAllShapes().size(), 1);
+
+    EXPECT_TRUE(target.load(good));
+    EXPECT_EQ(target.getAllShapes().size(), 20);
+}
@@ -7,10 +7,19 @@
 #include "../include/ellipse.h"
 #include "../include/line.h"
 #include "../include/bezier.h"
+#include "../include/styletable.h"
+#include "../include/strokefitter.h"
+#include "../include/lodpolicy.h"
+#include "../include/batchrenderer.h"
+#ifdef ENABLE_CAIRO
 #include <cairo.h>
+#endif
+#include <cmath>
+#include <limits>
 
 class ShapeTest : public ::testing::Test {
 protected:
+#ifdef ENABLE_CAIRO
     void SetUp() override {
         // Initialize Cairo surface for testing
         surface = cairo_image_surface_create(CAIRO_FORMAT_ARGB32, 100, 100);
@@ -24,6 +33,7 @@ protected:
     
     cairo_surface_t* surface = nullptr;
     cairo_t* cr = nullptr;
+#endif
 };
 
 // Rectangle Tests
@@ -69,6 +79,7 @@ TEST_F(ShapeTest, RectangleClone) {
     delete clone;
 }
 
+#ifdef ENABLE_CAIRO
 TEST_F(ShapeTest, RectangleDraw) {
     Rectangle rect(QPointF(10, 20), QSizeF(50, 30));
     rect.setPen(QPen(Qt::black, 1));
@@ -80,6 +91,7 @@ TEST_F(ShapeTest, RectangleDraw) {
     // Test with null context
     EXPECT_NO_THROW(rect.draw(nullptr));
 }
+#endif
 
 // Ellipse Tests
 TEST_F(ShapeTest, EllipseCreation) {
@@ -116,6 +128,7 @@ TEST_F(ShapeTest, EllipseAngles) {
     EXPECT_DOUBLE_EQ(ellipse.getEndAngle(), 315.0);
 }
 
+#ifdef ENABLE_CAIRO
 TEST_F(ShapeTest, EllipseDraw) {
     Ellipse ellipse(QPointF(10, 20), QSizeF(50, 30));
     ellipse.setPen(QPen(Qt::blue, 2));
@@ -127,6 +140,7 @@ TEST_F(ShapeTest, EllipseDraw) {
     // Test with null context
     EXPECT_NO_THROW(ellipse.draw(nullptr));
 }
+#endif
 
 // Line Tests
 TEST_F(ShapeTest, LineCreation) {
@@ -150,6 +164,16 @@ TEST_F(ShapeTest, LineContainment) {
     EXPECT_FALSE(line.contains(QPointF(0, 100)));
 }
 
+TEST_F(ShapeTest, LineMove) {
+    Line line(QPointF(10, 20), QPointF(50, 80));
+    line.move(QPointF(5, -10));
+
+    EXPECT_EQ(line.getStartPoint(), QPointF(15, 10));
+    EXPECT_EQ(line.getEndPoint(), QPointF(55, 70));
+    EXPECT_TRUE(line.contains(QPointF(35, 40)));
+}
+
+#ifdef ENABLE_CAIRO
 TEST_F(ShapeTest, LineDraw) {
     Line line(QPointF(10, 20), QPointF(50, 80));
     line.setPen(QPen(Qt::green, 3));
@@ -160,6 +184,7 @@ TEST_F(ShapeTest, LineDraw) {
     // Test with null context
     EXPECT_NO_THROW(line.draw(nullptr));
 }
+#endif
 
 // Bezier Tests
 TEST_F(ShapeTest, BezierCreation) {
@@ -192,6 +217,7 @@ TEST_F(ShapeTest, BezierClosed) {
     EXPECT_TRUE(bezier.isClosed());
 }
 
+#ifdef ENABLE_CAIRO
 TEST_F(ShapeTest, BezierDraw) {
     Bezier bezier;
     bezier.addPoint(QPointF(10, 20));
@@ -209,6 +235,268 @@ TEST_F(ShapeTest, BezierDraw) {
     Bezier emptyBezier;
     EXPECT_NO_THROW(emptyBezier.draw(cr));
 }
+#endif
+
+TEST_F(ShapeTest, BezierGeometryCacheFollowsEdits) {
+    Bezier bezier;
+    bezier.addPoint(QPointF(0, 0));
+    bezier.addPoint(QPointF(0, 100));
+    bezier.addPoint(QPointF(100, 100));
+    bezier.addPoint(QPointF(100, 0));
+    bezier.setClosed(true);
+
+    EXPECT_TRUE(bezier.contains(QPointF(50, 40)));
+    EXPECT_FALSE(bezier.contains(QPointF(150, 40)));
+    const int elements = bezier.path().elementCount();
+
+    // Every mutator drops what was built from the old points
+    bezier.move(QPointF(100, 0));
+    EXPECT_FALSE(bezier.contains(QPointF(50, 40)));
+    EXPECT_TRUE(bezier.contains(QPointF(150, 40)));
+
+    bezier.setPoint(3, QPointF(400, 0));
+    EXPECT_EQ(bezier.path().controlPointRect().right(), 400);
+
+    bezier.addPoint(QPointF(500, 50));
+    EXPECT_GT(bezier.path().elementCount(), elements);
+
+    bezier.setClosed(false);
+    EXPECT_FALSE(bezier.flattened().isClosed());
+
+    bezier.clearPoints();
+    EXPECT_TRUE(bezier.path().isEmpty());
+    EXPECT_FALSE(bezier.contains(QPointF(150, 40)));
+
+#ifdef ENABLE_CAIRO
+    // The cairo path is reused across draws and rebuilt after edits
+    bezier.addPoint(QPointF(10, 10));
+    bezier.addPoint(QPointF(20, 30));
+    bezier.addPoint(QPointF(40, 30));
+    bezier.addPoint(QPointF(50, 10));
+    const cairo_path_t* first = bezier.cairoPath();
+    ASSERT_NE(first, nullptr);
+    EXPECT_GT(first->num_data, 0);
+    EXPECT_NO_THROW(bezier.draw(cr));
+    EXPECT_EQ(bezier.cairoPath(), first);
+#endif
+}
+
+TEST_F(ShapeTest, BezierBoundsFollowPoints) {
+    Bezier bezier;
+    auto expectBounds = [&bezier]() {
+        const QList<QPointF> points = bezier.getPoints();
+        QPointF minPoint = points.first(), maxPoint = points.first();
+        for (const QPointF& p : points) {
+            minPoint = QPointF(qMin(minPoint.x(), p.x()), qMin(minPoint.y(), p.y()));
+            maxPoint = QPointF(qMax(maxPoint.x(), p.x()), qMax(maxPoint.y(), p.y()));
+        }
+        EXPECT_EQ(bezier.getPosition(), minPoint);
+        EXPECT_EQ(bezier.getSize(), QSizeF(maxPoint.x() - minPoint.x(), maxPoint.y() - minPoint.y()));
+    };
+
+    for (int i = 0; i < 50; ++i) {
+        bezier.addPoint(QPointF((i * 37) % 23 - 11.5, (i * 53) % 19 * 0.5));
+        expectBounds();
+    }
+
+    bezier.setPoint(10, QPointF(5, 5));        // Interior point moved inside
+    expectBounds();
+    bezier.setPoint(20, QPointF(-100, 200));   // Pushes the box out
+    expectBounds();
+    bezier.setPoint(20, QPointF(0, 0));        // Pulls an edge back in
+    expectBounds();
+
+    bezier.move(QPointF(3, -4));
+    expectBounds();
+    bezier.addPoint(QPointF(100, 100));
+    expectBounds();
+}
+
+TEST_F(ShapeTest, StrokeFitterStaysWithinTolerance) {
+    // A wavy freehand stroke with a little deterministic jitter
+    QVector<QPointF> samples;
+    for (int i = 0; i < 4000; ++i) {
+        const double x = i * 0.5;
+        samples.append(QPointF(x, 60.0 * std::sin(x / 40.0) + 0.3 * std::sin(i * 12.9898)));
+    }
+
+    const double tolerance = 2.0;
+    const QVector<QPointF> fitted = StrokeFitter::fit(samples, tolerance);
+    ASSERT_EQ((fitted.size() - 1) % 3, 0);       // Whole cubics only
+    EXPECT_LE(fitted.size() * 10, samples.size());
+    EXPECT_EQ(fitted.first(), samples.first());
+    EXPECT_EQ(fitted.last(), samples.last());
+
+    Bezier bezier;
+    bezier.setPoints(fitted);
+    EXPECT_EQ(bezier.getPointCount(), fitted.size());
+
+    // Every sample lies within the tolerance of the drawn curve (plus a
+    // little for the path flattening)
+    const QPolygonF curve = bezier.flattened();
+    auto distance = [&curve](const QPointF& p) {
+        double best = std::numeric_limits<double>::max();
+        for (int i = 1; i < curve.size(); ++i) {
+            const QPointF a = curve[i - 1], ab = curve[i] - a;
+            const double len2 = QPointF::dotProduct(ab, ab);
+            const double t = len2 > 0 ? qBound(0.0, QPointF::dotProduct(p - a, ab) / len2, 1.0) : 0.0;
+            const QPointF d = a + ab * t - p;
+            best = qMin(best, std::sqrt(QPointF::dotProduct(d, d)));
+        }
+        return best;
+    };
+    for (const QPointF& p : samples) {
+        EXPECT_LE(distance(p), tolerance + 0.25);
+    }
+
+    // Fed one sample at a time, the committed part never changes and the
+    // live result matches the one-shot fit
+    StrokeFitter fitter(tolerance);
+    fitter.begin(samples.first());
+    QVector<QPointF> committed;
+    for (int i = 1; i < samples.size(); ++i) {
+        fitter.addSample(samples[i]);
+        const QVector<QPointF> live = fitter.points();
+        for (int j = 0; j < committed.size(); ++j) {
+            ASSERT_EQ(live[j], committed[j]);
+        }
+        committed = live.mid(0, fitter.committedPointCount());
+    }
+    EXPECT_EQ(fitter.points(), fitted);
+}
+
+TEST_F(ShapeTest, LodPolicyClassifiesByScreenSize) {
+    Rectangle filled(QPointF(0, 0), QSizeF(10, 10));
+    filled.setBrush(QBrush(Qt::red));
+    filled.setPen(QPen(Qt::NoPen));
+    Line line(QPointF(0, 0), QPointF(10, 10));
+
+    LodPolicy lod;
+    EXPECT_EQ(lod.classify(&filled, 1.0), LodPolicy::Full);
+    EXPECT_EQ(lod.classify(&filled, 0.2), LodPolicy::Box);      // 2 px
+    EXPECT_EQ(lod.classify(&line, 0.2), LodPolicy::Full);       // No area to box
+    EXPECT_EQ(lod.classify(&filled, 0.05), LodPolicy::Point);   // Half a pixel
+    EXPECT_EQ(lod.classify(&filled, 0.001), LodPolicy::Skip);
+
+    EXPECT_DOUBLE_EQ(lod.flatteningTolerance(2.0), lod.tolerance);
+    EXPECT_GT(lod.flatteningTolerance(0.5), lod.tolerance);
+    EXPECT_DOUBLE_EQ(lod.flatteningTolerance(0.01), lod.maxTolerance);
+
+    lod.enabled = false;
+    EXPECT_EQ(lod.classify(&filled, 0.001), LodPolicy::Full);
+
+#ifdef ENABLE_CAIRO
+    // Reduced shapes still cover their pixel
+    lod.enabled = true;
+    cairo_set_source_rgb(cr, 1, 1, 1);
+    cairo_paint(cr);
+    cairo_scale(cr, 0.05, 0.05);
+    Rectangle tiny(QPointF(390, 390), QSizeF(10, 10));
+    tiny.setBrush(QBrush(Qt::red));
+    BatchRenderer renderer(cr);
+    const LodPolicy::Counts counts = lod.draw(renderer, { &tiny }, 0.05);
+    renderer.flush();
+    EXPECT_EQ(counts.reduced, 1);
+    EXPECT_EQ(counts.full, 0);
+    cairo_surface_flush(surface);
+    const quint32 pixel = *reinterpret_cast<const quint32*>(
+        cairo_image_surface_get_data(surface) + 19 * cairo_image_surface_get_stride(surface) + 19 * 4);
+    EXPECT_NE(pixel, 0xffffffffu);
+#endif
+}
+
+#ifdef ENABLE_CAIRO
+TEST_F(ShapeTest, BatchRendererMergesSameStyleRuns) {
+    const QPen outline(Qt::black, 2);
+    const QBrush fill(Qt::red);
+    auto pixelAt = [this](int x, int y) {
+        cairo_surface_flush(surface);
+        return *reinterpret_cast<const quint32*>(
+            cairo_image_surface_get_data(surface) + y * cairo_image_surface_get_stride(surface) + x * 4);
+    };
+
+    // Ten separate squares in one style: one fill and one stroke in all
+    QList<Rectangle*> squares;
+    for (int i = 0; i < 10; ++i) {
+        Rectangle *square = new Rectangle(QPointF(2 + (i % 5) * 20, 2 + (i / 5) * 20), QSizeF(8, 8));
+        square->setPen(outline);
+        square->setBrush(fill);
+        squares.append(square);
+    }
+    {
+        BatchRenderer renderer(cr);
+        for (Rectangle *square : squares) renderer.draw(square);
+        renderer.flush();
+        EXPECT_EQ(renderer.stats().shapes, 10);
+        EXPECT_EQ(renderer.stats().batches, 1);
+        EXPECT_EQ(renderer.stats().single, 0);
+        EXPECT_EQ(renderer.stats().stateChanges, 3);
+    }
+    EXPECT_EQ(pixelAt(6, 6), 0xffff0000u);      // Inside the first square
+
+    {
+        BatchRenderer renderer(cr, false);
+        for (Rectangle *square : squares) renderer.draw(square);
+        EXPECT_EQ(renderer.stats().batches, 0);
+        EXPECT_EQ(renderer.stats().single, 10);
+        EXPECT_EQ(renderer.stats().stateChanges, 30);
+    }
+    qDeleteAll(squares);
+
+    // Overlapping members split the run, so the upper square's fill still
+    // covers the lower one's outline
+    cairo_set_source_rgb(cr, 1, 1, 1);
+    cairo_paint(cr);
+    Rectangle lower(QPointF(10, 10), QSizeF(40, 40));
+    Rectangle upper(QPointF(30, 30), QSizeF(40, 40));
+    lower.setPen(outline);
+    lower.setBrush(fill);
+    upper.setStyle(lower.getStyle());
+    Line line(QPointF(0, 90), QPointF(100, 90));     // Same pen, different style
+    line.setPen(outline);
+    {
+        BatchRenderer renderer(cr);
+        renderer.draw(&lower);
+        renderer.draw(&upper);
+        renderer.draw(&line);
+        renderer.flush();
+        EXPECT_EQ(renderer.stats().batches, 3);
+    }
+    EXPECT_EQ(pixelAt(50, 40), 0xffff0000u);    // Lower's right edge, under upper
+    EXPECT_NE(pixelAt(50, 90), 0xffffffffu);
+}
+#endif
+
+#ifdef ENABLE_CAIRO
+TEST_F(ShapeTest, BatchRendererDrawsRotatedShapes) {
+    auto pixelAt = [this](int x, int y) {
+        cairo_surface_flush(surface);
+        return *reinterpret_cast<const quint32*>(
+            cairo_image_surface_get_data(surface) + y * cairo_image_surface_get_stride(surface) + x * 4);
+    };
+    cairo_set_source_rgb(cr, 1, 1, 1);
+    cairo_paint(cr);
+
+    // A 40x10 bar turned upright about its centre (50, 50)
+    Rectangle bar(QPointF(30, 45), QSizeF(40, 10));
+    bar.setBrush(QBrush(Qt::red));
+    bar.setPen(QPen(Qt::NoPen));
+    bar.rotate(90);
+    Rectangle corner(QPointF(0, 0), QSizeF(10, 10));
+    corner.setStyle(bar.getStyle());
+    {
+        BatchRenderer renderer(cr);
+        renderer.draw(&corner);
+        renderer.draw(&bar);
+        renderer.flush();
+        EXPECT_EQ(renderer.stats().single, 1);
+        EXPECT_EQ(renderer.stats().batches, 1);
+    }
+    EXPECT_EQ(pixelAt(50, 35), 0xffff0000u);    // Only the rotated bar covers this
+    EXPECT_EQ(pixelAt(35, 50), 0xffffffffu);    // Only the unrotated one would
+    EXPECT_EQ(pixelAt(5, 5), 0xffff0000u);
+}
+#endif
 
 // Base Shape Tests
 TEST_F(ShapeTest, ShapeProperties) {
@@ -239,6 +527,49 @@ TEST_F(ShapeTest, ShapeProperties) {
     EXPECT_FALSE(rect.isSelected());
 }
 
+TEST_F(ShapeTest, ShapeStylesAreShared) {
+    Rectangle a;
+    Ellipse b;
+    EXPECT_EQ(a.getStyle(), StyleTable::DefaultStyle);
+    EXPECT_EQ(a.getStyle(), b.getStyle());
+
+    // Equal pen + brush pairs intern to one entry
+    a.setPen(QPen(Qt::darkGreen, 3));
+    b.setPen(QPen(Qt::darkGreen, 3));
+    EXPECT_EQ(a.getStyle(), b.getStyle());
+    const int styles = StyleTable::instance().size();
+
+    // Editing one shape leaves the other on the old entry
+    b.setBrush(QBrush(Qt::yellow));
+    EXPECT_NE(a.getStyle(), b.getStyle());
+    EXPECT_EQ(a.getBrush().color(), QColor(Qt::white));
+    EXPECT_EQ(b.getBrush().color(), QColor(Qt::yellow));
+    EXPECT_EQ(b.getPen().widthF(), 3);
+
+    Rectangle* copy = a.clone();
+    EXPECT_EQ(copy->getStyle(), a.getStyle());
+    delete copy;
+    EXPECT_LE(StyleTable::instance().size(), styles + 1);
+}
+
+TEST_F(ShapeTest, UnusedStylesAreRecycled) {
+    Rectangle rect;
+    const int styles = StyleTable::instance().size();
+
+    // Dragging a colour picker interns a style per step; each one the
+    // shape leaves behind is recycled
+    for (int i = 0; i < 2000; ++i) rect.setBrush(QBrush(QColor(i % 256, i / 256, 7)));
+    EXPECT_LE(StyleTable::instance().size(), styles + 1);
+
+    // A saved state keeps its style after the shape moves on
+    const Shape::State saved = rect.saveState();
+    const QColor kept = rect.getBrush().color();
+    rect.setBrush(QBrush(Qt::cyan));
+    EXPECT_EQ(StyleTable::instance().brush(saved.style).color(), kept);
+    rect.exchangeState(saved);
+    EXPECT_EQ(rect.getBrush().color(), kept);
+}
+
 TEST_F(ShapeTest, ShapeTransformations) {
     Rectangle rect(QPointF(10, 20), QSizeF(50, 30));
     
@@ -257,6 +588,7 @@ TEST_F(ShapeTest, ShapeTransformations) {
 }
 
 // Integration test
+#ifdef ENABLE_CAIRO
 TEST_F(ShapeTest, MultipleShapesDraw) {
     Rectangle rect(QPointF(10, 10), QSizeF(30, 20));
     Ellipse ellipse(QPointF(50, 50), QSizeF(40, 40));
@@ -269,8 +601,10 @@ TEST_F(ShapeTest, MultipleShapesDraw) {
         line.draw(cr);
     });
 }
+#endif
 
 // Test with invalid inputs
+#ifdef ENABLE_CAIRO
 TEST_F(ShapeTest, InvalidInputsHandling) {
     Rectangle rect;
     
@@ -285,4 +619,5 @@ TEST_F(ShapeTest, InvalidInputsHandling) {
     // Very large coordinates
     rect.setPosition(QPointF(1e6, 1e6));
     EXPECT_NO_THROW(rect.draw(cr));
-}
\ No newline at end of file
+}
+#endif
@@ -0,0 +1,235 @@
+#include <gtest/gtest.h>
+#include <QApplication>
+#include <QFile>
+#include <QTemporaryDir>
+#include "../include/document.h"
+#include "../include/svg_parser.h"
+
+class SVGParserTest : public ::testing::Test {
+protected:
+    void SetUp() override {
+        document = new Document();
+    }
+
+    void TearDown() override {
+        delete document;
+    }
+
+    QString writeFile(const QString &name, const QByteArray &content) {
+        QString path = dir.filePath(name);
+        QFile file(path);
+        file.open(QIODevice::WriteOnly);
+        file.write(content);
+        return path;
+    }
+
+    QTemporaryDir dir;
+    Document* document = nullptr;
+};
+
+TEST_F(SVGParserTest, ImportBasicShapes) {
+    QString path = writeFile("basic.svg",
+        "<?xml version=\"1.0\"?>\n"
+        "<svg xmlns=\"http://www.w3.org/2000/svg\" width=\"640\" height=\"480\">\n"
+        "  <rect x=\"10\" y=\"20\" width=\"30\" height=\"40\" fill=\"#ff0000\"/>\n"
+        "  <circle cx=\"100\" cy=\"100\" r=\"25\"></circle>\n"
+        "  <line x1=\"0\" y1=\"0\" x2=\"50\" y2=\"50\" stroke=\"#0000ff\" stroke-width=\"3\"/>\n"
+        "</svg>\n");
+
+    SVGParser parser;
+    ASSERT_TRUE(parser.importFromFile(path, document));
+
+    EXPECT_EQ(document->getSize(), QSizeF(640, 480));
+    QList<Shape*> shapes = document->getAllShapes();
+    ASSERT_EQ(shapes.size(), 3);
+
+    EXPECT_EQ(shapes[0]->getType(), Shape::Rectangle);
+    EXPECT_EQ(shapes[0]->getPosition(), QPointF(10, 20));
+    EXPECT_EQ(shapes[0]->getBrush().color(), QColor(255, 0, 0));
+
+    EXPECT_EQ(shapes[1]->getType(), Shape::Ellipse);
+    EXPECT_EQ(shapes[1]->getBoundingRect(), QRectF(75, 75, 50, 50));
+
+    EXPECT_EQ(shapes[2]->getType(), Shape::Line);
+    EXPECT_DOUBLE_EQ(shapes[2]->getPen().widthF(), 3.0);
+}
+
+#ifdef ENABLE_LIBXML2
+TEST_F(SVGParserTest, ImportNestedGroups) {
+    QString path = writeFile("groups.svg",
+        "<svg xmlns=\"http://www.w3.org/2000/svg\" width=\"100\" height=\"100\">\n"
+        "  <defs><rect x=\"0\" y=\"0\" width=\"5\" height=\"5\"/></defs>\n"
+        "  <g fill=\"#00ff00\" transform=\"translate(10, 5)\">\n"
+        "    <g/>\n"
+        "    <g transform=\"translate(1 1)\">\n"
+        "      <rect x=\"0\" y=\"0\" width=\"5\" height=\"5\"/>\n"
+        "    </g>\n"
+        "    <rect x=\"0\" y=\"0\" width=\"5\" height=\"5\" style=\"fill:#0000ff\"/>\n"
+        "  </g>\n"
+        "  <rect x=\"0\" y=\"0\" width=\"5\" height=\"5\"/>\n"
+        "</svg>\n");
+
+    SVGParser parser;
+    ASSERT_TRUE(parser.importFromFile(path, document));
+
+    QList<Shape*> shapes = document->getAllShapes();
+    ASSERT_EQ(shapes.size(), 3);    // The <defs> child is not drawn
+
+    EXPECT_EQ(shapes[0]->getPosition(), QPointF(11, 6));
+    EXPECT_EQ(shapes[0]->getBrush().color(), QColor(0, 255, 0));
+    EXPECT_EQ(shapes[1]->getPosition(), QPointF(10, 5));
+    EXPECT_EQ(shapes[1]->getBrush().color(), QColor(0, 0, 255));
+    EXPECT_EQ(shapes[2]->getPosition(), QPointF(0, 0));
+    EXPECT_EQ(shapes[2]->getBrush().color(), QColor(Qt::white));
+}
+
+TEST_F(SVGParserTest, ImportPathRoundTrip) {
+    Bezier* bezier = new Bezier();
+    bezier->addPoint(QPointF(0, 0));
+    bezier->addPoint(QPointF(10, 0));
+    bezier->addPoint(QPointF(20, 10));
+    bezier->addPoint(QPointF(30, 30));
+    bezier->setClosed(true);
+    document->addShape(bezier);
+
+    SVGParser parser;
+    QString path = dir.filePath("path.svg");
+    ASSERT_TRUE(parser.exportToFile(path, document));
+
+    Document imported;
+    ASSERT_TRUE(parser.importFromFile(path, &imported));
+    QList<Shape*> shapes = imported.getAllShapes();
+    ASSERT_EQ(shapes.size(), 1);
+
+    Bezier* result = dynamic_cast<Bezier*>(shapes[0]);
+    ASSERT_NE(result, nullptr);
+    EXPECT_EQ(result->getPoints(), bezier->getPoints());
+    EXPECT_TRUE(result->isClosed());
+}
+
+TEST_F(SVGParserTest, ImportPathLinesAsCubics) {
+    QString path = writeFile("lines.svg",
+        "<svg xmlns=\"http://www.w3.org/2000/svg\" width=\"100\" height=\"100\">\n"
+        "  <path d=\"M 0 0 L 10 0 v 10\"/>\n"
+        "</svg>\n");
+
+    SVGParser parser;
+    ASSERT_TRUE(parser.importFromFile(path, document));
+    QList<Shape*> shapes = document->getAllShapes();
+    ASSERT_EQ(shapes.size(), 1);
+
+    // Each line-to is a degenerate cubic (current, p, p)
+    Bezier* bezier = dynamic_cast<Bezier*>(shapes[0]);
+    ASSERT_NE(bezier, nullptr);
+    EXPECT_EQ(bezier->getPoints(), (QList<QPointF>{
+        QPointF(0, 0),
+        QPointF(0, 0), QPointF(10, 0), QPointF(10, 0),
+        QPointF(10, 0), QPointF(10, 10), QPointF(10, 10) }));
+}
+
+TEST_F(SVGParserTest, ImportPathMixedLinesAndCurves) {
+    QString path = writeFile("mixed.svg",
+        "<svg xmlns=\"http://www.w3.org/2000/svg\" width=\"100\" height=\"100\">\n"
+        "  <path d=\"M 0 0 L 10 0 C 10 5 20 5 20 0 Q 26 6 29 0\"/>\n"
+        "</svg>\n");
+
+    SVGParser parser;
+    ASSERT_TRUE(parser.importFromFile(path, document));
+    QList<Shape*> shapes = document->getAllShapes();
+    ASSERT_EQ(shapes.size(), 1);
+
+    // The curve after the line keeps its own control points
+    Bezier* bezier = dynamic_cast<Bezier*>(shapes[0]);
+    ASSERT_NE(bezier, nullptr);
+    ASSERT_EQ(bezier->getPointCount(), 10);
+    EXPECT_EQ(bezier->getPoint(4), QPointF(10, 5));
+    EXPECT_EQ(bezier->getPoint(5), QPointF(20, 5));
+    EXPECT_EQ(bezier->getPoint(6), QPointF(20, 0));
+    EXPECT_EQ(bezier->getPoint(7), QPointF(24, 4));    // Quad control (26, 6) elevated
+    EXPECT_EQ(bezier->getPoint(8), QPointF(27, 4));
+    EXPECT_EQ(bezier->getPoint(9), QPointF(29, 0));
+}
+
+TEST_F(SVGParserTest, ImportChunkedMatchesSerial) {
+    // Large enough to be split into several chunks
+    QByteArray svg = "<?xml version=\"1.0\" encoding=\"UTF-8\"?>\n"
+                     "<svg xmlns=\"http://www.w3.org/2000/svg\" width=\"800\" height=\"600\" fill=\"#808080\">\n";
+    for (int i = 0; i < 20000; ++i) {
+        if (i % 50 == 0) svg += "<g stroke=\"#ff0000\" transform=\"translate(" + QByteArray::number(i % 7) + ",1)\">\n";
+        switch (i % 4) {
+        case 0:
+            svg += "<rect x=\"" + QByteArray::number(i) + "\" y=\"1\" width=\"4\" height=\"5\"/>\n";
+            break;
+        case 1:
+            svg += "<circle cx=\"" + QByteArray::number(i) + "\" cy=\"2\" r=\"3\" fill=\"none\"/>\n";
+            break;
+        case 2:
+            svg += "<line x1=\"0\" y1=\"0\" x2=\"" + QByteArray::number(i) + "\" y2=\"9\" stroke-width=\"2\"/>\n";
+            break;
+        default:
+            svg += "<path d=\"M 0 0 C 1 2 3 4 " + QByteArray::number(i) + " 5 Z\"/>\n";
+            break;
+        }
+        if (i % 50 == 49) svg += "</g>\n";
+    }
+    svg += "</svg>\n";
+    QString path = writeFile("large.svg", svg);
+
+    SVGParser serial;
+    serial.setImportThreadCount(1);
+    ASSERT_TRUE(serial.importFromFile(path, document));
+
+    SVGParser chunked;
+    chunked.setImportThreadCount(4);
+    Document imported;
+    ASSERT_TRUE(chunked.importFromFile(path, &imported));
+
+    EXPECT_EQ(imported.getSize(), document->getSize());
+    QList<Shape*> expected = document->getAllShapes();
+    QList<Shape*> actual = imported.getAllShapes();
+    ASSERT_EQ(expected.size(), 20000);
+    ASSERT_EQ(actual.size(), expected.size());
+    for (int i = 0; i < expected.size(); ++i) {
+        ASSERT_EQ(actual[i]->getType(), expected[i]->getType()) << i;
+        EXPECT_EQ(actual[i]->getBoundingRect(), expected[i]->getBoundingRect()) << i;
+        EXPECT_EQ(actual[i]->getPen(), expected[i]->getPen()) << i;
+        EXPECT_EQ(actual[i]->getBrush(), expected[i]->getBrush()) << i;
+    }
+}
+
+TEST_F(SVGParserTest, ExportLargeDocumentRoundTrips) {
+    // More than one writer buffer, with coordinates that need all 17 digits
+    for (int i = 0; i < 5000; ++i) {
+        Rectangle* rect = new Rectangle(QPointF(i / 3.0, 0.1 + 0.2), QSizeF(1e-7 * i, 12345.678901));
+        rect->setBrush(QBrush(QColor(i % 256, 0, 15)));
+        document->addShape(rect);
+    }
+
+    SVGParser parser;
+    QString path = dir.filePath("large.svg");
+    ASSERT_TRUE(parser.exportToFile(path, document));
+
+    QFile file(path);
+    ASSERT_TRUE(file.open(QIODevice::ReadOnly));
+    EXPECT_EQ(QString::fromUtf8(file.readAll()), parser.generateSVGString(document));
+
+    Document imported;
+    ASSERT_TRUE(parser.importFromFile(path, &imported));
+    QList<Shape*> expected = document->getAllShapes();
+    QList<Shape*> actual = imported.getAllShapes();
+    ASSERT_EQ(actual.size(), expected.size());
+    for (int i = 0; i < expected.size(); ++i) {
+        EXPECT_EQ(actual[i]->getPosition(), expected[i]->getPosition()) << i;
+        EXPECT_EQ(actual[i]->getSize(), expected[i]->getSize()) << i;
+        EXPECT_EQ(actual[i]->getBrush().color(), expected[i]->getBrush().color()) << i;
+    }
+}
+
+TEST_F(SVGParserTest, ImportMalformedFileFails) {
+    QString path = writeFile("broken.svg",
+        "<svg xmlns=\"http://www.w3.org/2000/svg\"><rect x=\"1\" y=\"2\" width=\"3\" height=\"4\"/>");
+
+    SVGParser parser;
+    EXPECT_FALSE(parser.importFromFile(path, document));
+}
+#endif